@@ -0,0 +1,346 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define UTF_SSE2_DECODE 1
+#include <emmintrin.h>
+#endif
+
+/*
+    Code points over UTF-8, UTF-16 or UTF-32 text, decoded inline.
+
+    utf::code_points(s) is a forward, common, borrowed view of char32_t over any string, view, array or pointer of
+    char, char8_t, char16_t, char32_t or wchar_t (UTF-16 or UTF-32 by its size), so std::ranges algorithms and the
+    classic ones both take it, and two encodings can be compared code point by code point. The iterator decodes
+    as it advances and keeps the value, so dereferencing is free and equality is a pointer compare.
+
+    decode_into fills a span of char32_t in bulk, widening whole blocks of ASCII (or of UTF-16 with no surrogates,
+    or of valid UTF-32) with SSE2 and decoding the rest a sequence at a time.
+
+    Malformed input decodes as U+FFFD: one per maximal invalid UTF-8 subpart (as ICU and WHATWG do), per unpaired
+    surrogate, and per UTF-32 value that is not a scalar value - the same replacements utf16_to_utf8 and
+    utf32_to_utf8 make.
+*/
+namespace utf
+{
+    template<typename TUnit> concept code_unit =
+        std::is_same_v<TUnit, char> || std::is_same_v<TUnit, char8_t> || std::is_same_v<TUnit, char16_t> ||
+        std::is_same_v<TUnit, char32_t> || std::is_same_v<TUnit, wchar_t>;
+
+    struct decoded
+    {
+        char32_t value;
+        uint32_t length;
+    };
+
+    // Decodes the sequence starting at p, which must be before end.
+    template<code_unit TUnit> constexpr decoded decode_one(TUnit const* p, TUnit const* end)
+    {
+        constexpr char32_t replacement = 0xFFFD;
+        if constexpr (sizeof(TUnit) == 1)
+        {
+            uint32_t lead = static_cast<uint8_t>(p[0]);
+            if (lead < 0x80)
+            {
+                return { lead, 1 };
+            }
+
+            // The lead byte fixes the number of trail bytes and narrows the range of the first one, which rules
+            // out overlong forms, surrogates and values past U+10FFFF.
+            uint32_t trails;
+            uint32_t value;
+            uint32_t low = 0x80;
+            uint32_t high = 0xBF;
+            if ((lead >= 0xC2) && (lead <= 0xDF))
+            {
+                trails = 1;
+                value = lead & 0x1F;
+            }
+            else if ((lead >= 0xE0) && (lead <= 0xEF))
+            {
+                trails = 2;
+                value = lead & 0x0F;
+                low = (lead == 0xE0) ? 0xA0 : 0x80;
+                high = (lead == 0xED) ? 0x9F : 0xBF;
+            }
+            else if ((lead >= 0xF0) && (lead <= 0xF4))
+            {
+                trails = 3;
+                value = lead & 0x07;
+                low = (lead == 0xF0) ? 0x90 : 0x80;
+                high = (lead == 0xF4) ? 0x8F : 0xBF;
+            }
+            else
+            {
+                return { replacement, 1 };
+            }
+
+            for (uint32_t length = 1; length <= trails; length++)
+            {
+                if (p + length == end)
+                {
+                    return { replacement, length };
+                }
+
+                uint32_t trail = static_cast<uint8_t>(p[length]);
+                if ((trail < low) || (trail > high))
+                {
+                    return { replacement, length };
+                }
+                value = (value << 6) | (trail & 0x3F);
+                low = 0x80;
+                high = 0xBF;
+            }
+            return { value, trails + 1 };
+        }
+        else if constexpr (sizeof(TUnit) == 2)
+        {
+            uint32_t c = static_cast<uint16_t>(p[0]);
+            if ((c & 0xF800) != 0xD800)
+            {
+                return { c, 1 };
+            }
+
+            if ((c < 0xDC00) && (p + 1 != end))
+            {
+                uint32_t next = static_cast<uint16_t>(p[1]);
+                if ((next & 0xFC00) == 0xDC00)
+                {
+                    return { 0x10000 + ((c - 0xD800) << 10) + (next - 0xDC00), 2 };
+                }
+            }
+            return { replacement, 1 };
+        }
+        else
+        {
+            uint32_t c = static_cast<uint32_t>(p[0]);
+            return { ((c > 0x10FFFF) || ((c & 0xFFFFF800) == 0xD800)) ? replacement : c, 1 };
+        }
+    }
+
+    template<code_unit TUnit> class code_point_iterator
+    {
+    public:
+        using value_type = char32_t;
+        using difference_type = std::ptrdiff_t;
+        using iterator_concept = std::forward_iterator_tag;
+        // Dereferencing yields a value, not a reference, which the classic categories only allow of input iterators.
+        using iterator_category = std::input_iterator_tag;
+
+        code_point_iterator() = default;
+
+        code_point_iterator(TUnit const* position, TUnit const* end) : position_(position), end_(end)
+        {
+            decode();
+        }
+
+        char32_t operator*() const
+        {
+            return value_;
+        }
+
+        code_point_iterator& operator++()
+        {
+            position_ += length_;
+            decode();
+            return *this;
+        }
+
+        code_point_iterator operator++(int)
+        {
+            auto i = *this;
+            ++(*this);
+            return i;
+        }
+
+        bool operator==(code_point_iterator const& other) const
+        {
+            return position_ == other.position_;
+        }
+
+        // The first code unit of the current code point.
+        TUnit const* base() const
+        {
+            return position_;
+        }
+
+    private:
+        void decode()
+        {
+            if (position_ != end_)
+            {
+                auto d = decode_one(position_, end_);
+                value_ = d.value;
+                length_ = d.length;
+            }
+        }
+
+        TUnit const* position_ = nullptr;
+        TUnit const* end_ = nullptr;
+        char32_t value_ = 0;
+        uint32_t length_ = 0;
+    };
+
+    // Code points written to the output and code units read from the input.
+    struct decode_result
+    {
+        size_t decoded;
+        size_t consumed;
+    };
+
+    // Decodes as much of input as fits in output. Call again with the unconsumed rest to continue.
+    template<code_unit TUnit> decode_result decode_into(std::basic_string_view<TUnit> input, std::span<char32_t> output)
+    {
+        auto p = input.data();
+        auto n = input.size();
+        size_t i = 0;
+        size_t o = 0;
+
+        // A block that is not all plain is decoded a sequence at a time, to the first sequence that ends past it.
+        auto decode_block = [&](size_t width) {
+            auto blockEnd = i + width;
+            while ((i < blockEnd) && (o < output.size()))
+            {
+                auto d = decode_one(p + i, p + n);
+                output[o++] = d.value;
+                i += d.length;
+            }
+        };
+
+#if defined(UTF_SSE2_DECODE)
+        auto zero = _mm_setzero_si128();
+        if constexpr (sizeof(TUnit) == 1)
+        {
+            while ((i + 16 <= n) && (o + 16 <= output.size()))
+            {
+                auto v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i));
+                if (_mm_movemask_epi8(v) != 0)
+                {
+                    decode_block(16);
+                    continue;
+                }
+
+                auto low = _mm_unpacklo_epi8(v, zero);
+                auto high = _mm_unpackhi_epi8(v, zero);
+                auto at = reinterpret_cast<__m128i*>(output.data() + o);
+                _mm_storeu_si128(at, _mm_unpacklo_epi16(low, zero));
+                _mm_storeu_si128(at + 1, _mm_unpackhi_epi16(low, zero));
+                _mm_storeu_si128(at + 2, _mm_unpacklo_epi16(high, zero));
+                _mm_storeu_si128(at + 3, _mm_unpackhi_epi16(high, zero));
+                i += 16;
+                o += 16;
+            }
+        }
+        else if constexpr (sizeof(TUnit) == 2)
+        {
+            auto surrogateBits = _mm_set1_epi16(static_cast<short>(0xF800));
+            auto surrogate = _mm_set1_epi16(static_cast<short>(0xD800));
+            while ((i + 8 <= n) && (o + 8 <= output.size()))
+            {
+                auto v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, surrogateBits), surrogate)) != 0)
+                {
+                    decode_block(8);
+                    continue;
+                }
+
+                auto at = reinterpret_cast<__m128i*>(output.data() + o);
+                _mm_storeu_si128(at, _mm_unpacklo_epi16(v, zero));
+                _mm_storeu_si128(at + 1, _mm_unpackhi_epi16(v, zero));
+                i += 8;
+                o += 8;
+            }
+        }
+        else
+        {
+            // Scalar values are 0..0x10FFFF less the surrogates; anything with the sign bit set compares below zero.
+            auto largest = _mm_set1_epi32(0x10FFFF);
+            auto surrogateBits = _mm_set1_epi32(static_cast<int>(0xFFFFF800));
+            auto surrogate = _mm_set1_epi32(0xD800);
+            while ((i + 4 <= n) && (o + 4 <= output.size()))
+            {
+                auto v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i));
+                auto invalid = _mm_or_si128(_mm_or_si128(_mm_cmpgt_epi32(v, largest), _mm_cmplt_epi32(v, zero)),
+                    _mm_cmpeq_epi32(_mm_and_si128(v, surrogateBits), surrogate));
+                if (_mm_movemask_epi8(invalid) != 0)
+                {
+                    decode_block(4);
+                    continue;
+                }
+
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(output.data() + o), v);
+                i += 4;
+                o += 4;
+            }
+        }
+#endif
+
+        decode_block(n - i);
+        return { o, i };
+    }
+
+    // The code points of a run of code units. Like the string_view it holds, it does not own the text.
+    template<code_unit TUnit> class code_point_view : public std::ranges::view_interface<code_point_view<TUnit>>
+    {
+    public:
+        using iterator = code_point_iterator<TUnit>;
+
+        code_point_view() = default;
+
+        explicit code_point_view(std::basic_string_view<TUnit> units) : units_(units)
+        {
+        }
+
+        iterator begin() const
+        {
+            return { units_.data(), units_.data() + units_.size() };
+        }
+
+        iterator end() const
+        {
+            auto last = units_.data() + units_.size();
+            return { last, last };
+        }
+
+        std::basic_string_view<TUnit> units() const
+        {
+            return units_;
+        }
+
+        decode_result decode_into(std::span<char32_t> output) const
+        {
+            return utf::decode_into(units_, output);
+        }
+
+    private:
+        std::basic_string_view<TUnit> units_;
+    };
+
+    template<code_unit TUnit, typename TTraits> code_point_view<TUnit> code_points(std::basic_string_view<TUnit, TTraits> s)
+    {
+        return code_point_view<TUnit>(std::basic_string_view<TUnit>(s.data(), s.size()));
+    }
+
+    template<code_unit TUnit, typename TTraits, typename TAllocator> code_point_view<TUnit> code_points(std::basic_string<TUnit, TTraits, TAllocator> const& s)
+    {
+        return code_point_view<TUnit>(std::basic_string_view<TUnit>(s.data(), s.size()));
+    }
+
+    template<code_unit TUnit> code_point_view<TUnit> code_points(TUnit const* s)
+    {
+        return code_point_view<TUnit>(std::basic_string_view<TUnit>(s));
+    }
+}
+
+namespace std::ranges
+{
+    template<typename TUnit> inline constexpr bool enable_borrowed_range<utf::code_point_view<TUnit>> = true;
+}
@@ -0,0 +1,345 @@
+// format_bench.cpp : Throughput of the wide-to-UTF-8 conversions behind std::format - codecvt ({:c}), ICU ({:u})
+// and the built-in codec ({:v}) - plus the codec alone at each SIMD level the CPU supports, for UTF-16 and UTF-32
+// input, and the heap allocations each way of producing a std::string makes. Backends that are not built in are
+// left out. The decode rows walk the same text as code points, one at a time and in bulk, from UTF-8, UTF-16 and
+// UTF-32, and the compare rows set the UTF-8 and UTF-16 forms of the text against each other.
+//
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "wide_formatter.h"
+#include "code_points.h"
+#include "utf_compare.h"
+
+namespace
+{
+    size_t allocations = 0;
+}
+
+void* operator new(std::size_t size)
+{
+    ++allocations;
+    if (auto p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+    struct corpus
+    {
+        char const* name;
+        std::u16string utf16;
+        std::u32string utf32{};
+        std::string utf8{};
+    };
+
+    // Repeats a sample until the corpus is about `units` UTF-16 code units long.
+    std::u16string repeat(std::u16string_view sample, size_t units)
+    {
+        std::u16string text;
+        while (text.size() < units)
+        {
+            text.append(sample);
+        }
+        return text;
+    }
+
+    std::u32string widen(std::u16string_view text)
+    {
+        std::u32string wide;
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            char32_t c = text[i];
+            if (((c & 0xFC00) == 0xD800) && (i + 1 < text.size()))
+            {
+                c = 0x10000 + ((c - 0xD800) << 10) + (text[++i] - 0xDC00);
+            }
+            wide.push_back(c);
+        }
+        return wide;
+    }
+
+    std::vector<corpus> make_corpora(size_t units)
+    {
+        std::vector<corpus> corpora{
+            { "ascii", repeat(u"The quick brown fox jumps over the lazy dog; 0123456789. ", units) },
+            { "latin", repeat(u"Größenwahn führt zu naïve Ästhetik, déjà vu, señor! ", units) },
+            { "cyrillic", repeat(u"Съешь же ещё этих мягких французских булок. ", units) },
+            { "cjk", repeat(u"敏捷的棕色狐狸跳过了懒狗。日本語のテキストも。", units) },
+            { "emoji", repeat(u"ok ♻️ 😀🚀 done 🎉 ", units) },
+        };
+
+        for (auto& c : corpora)
+        {
+            c.utf32 = widen(c.utf16);
+            c.utf8 = utf::to_utf8(c.utf16);
+        }
+        return corpora;
+    }
+
+    using clock_type = std::chrono::steady_clock;
+
+    // Runs fn until at least 200ms have passed and returns the rate in millions of input code units per second.
+    template<typename Fn> double units_per_microsecond(size_t units, Fn&& fn)
+    {
+        size_t iterations = 0;
+        auto start = clock_type::now();
+        std::chrono::duration<double> elapsed{};
+        do
+        {
+            fn();
+            ++iterations;
+            elapsed = clock_type::now() - start;
+        } while (elapsed.count() < 0.2);
+
+        return (static_cast<double>(units * iterations) / 1e6) / elapsed.count();
+    }
+
+    // The heap allocations one call of fn makes, averaged over a few calls.
+    template<typename Fn> double allocations_per_call(Fn&& fn)
+    {
+        const size_t calls = 8;
+        auto before = allocations;
+        for (size_t i = 0; i < calls; i++)
+        {
+            fn();
+        }
+        return static_cast<double>(allocations - before) / calls;
+    }
+
+    constexpr utf::simd_level all_levels[] = { utf::simd_level::scalar, utf::simd_level::sse41, utf::simd_level::avx2, utf::simd_level::avx512 };
+}
+
+int main()
+{
+    auto corpora = make_corpora(64 * 1024);
+    size_t longest = 0;
+    size_t longestUtf8 = 0;
+    for (auto const& c : corpora)
+    {
+        longest = std::max(longest, c.utf16.size());
+        longestUtf8 = std::max(longestUtf8, c.utf8.size());
+    }
+
+    std::string output;
+    output.reserve(utf::utf8_capacity_for_utf16(longest));
+    std::vector<char> direct(utf::utf8_capacity_for_utf32(longest));
+    std::vector<char32_t> decoded(std::max(longest, longestUtf8));
+
+    std::cout << "Detected SIMD level: " << utf::simd_level_name(utf::detected_simd_level()) << "\n\n";
+    std::cout << std::left << std::setw(26) << "M units/s";
+    for (auto const& c : corpora)
+    {
+        std::cout << std::right << std::setw(10) << c.name;
+    }
+    std::cout << "\n";
+
+    auto row = [&](std::string_view label, auto member, auto&& convert) {
+        std::cout << std::left << std::setw(26) << label << std::right << std::fixed << std::setprecision(0);
+        for (auto const& c : corpora)
+        {
+            auto const& text = c.*member;
+            std::cout << std::setw(10) << units_per_microsecond(text.size(), [&] { convert(text); });
+        }
+        std::cout << "\n";
+    };
+
+    auto utf16 = &corpus::utf16;
+    auto utf32 = &corpus::utf32;
+    auto utf8 = &corpus::utf8;
+
+#if defined(FORMATTER_HAS_CODECVT)
+    row("utf16 format {:c}", utf16, [&](std::u16string const& s) {
+        output.clear();
+        std::format_to(std::back_inserter(output), "{:c}", s);
+    });
+#endif
+#if defined(FORMATTER_HAS_ICU)
+    row("utf16 format {:u}", utf16, [&](std::u16string const& s) {
+        output.clear();
+        std::format_to(std::back_inserter(output), "{:u}", s);
+    });
+#endif
+    row("utf16 format {:v}", utf16, [&](std::u16string const& s) {
+        output.clear();
+        std::format_to(std::back_inserter(output), "{:v}", s);
+    });
+
+    for (auto level : all_levels)
+    {
+        if (utf::simd_level_supported(level))
+        {
+            row(std::string("utf16 codec ") + std::string(utf::simd_level_name(level)), utf16, [&](std::u16string const& s) {
+                utf::utf16_to_utf8(s.data(), s.size(), direct.data(), level);
+            });
+        }
+    }
+
+    for (auto level : all_levels)
+    {
+        if (utf::simd_level_supported(level))
+        {
+            row(std::string("utf16 length ") + std::string(utf::simd_level_name(level)), utf16, [&](std::u16string const& s) {
+                volatile auto length = utf::utf8_length(s.data(), s.size(), level);
+                (void)length;
+            });
+        }
+    }
+
+    row("utf16 to_utf8", utf16, [&](std::u16string const& s) {
+        output = utf::to_utf8(s);
+    });
+    row("utf16 format_to_n 4K", utf16, [&](std::u16string const& s) {
+        utf::format_to_n(direct.data(), 4096, s);
+    });
+
+#if defined(FORMATTER_HAS_CODECVT)
+    row("utf32 format {:c}", utf32, [&](std::u32string const& s) {
+        output.clear();
+        std::format_to(std::back_inserter(output), "{:c}", s);
+    });
+#endif
+#if defined(FORMATTER_HAS_ICU)
+    row("utf32 format {:u}", utf32, [&](std::u32string const& s) {
+        output.clear();
+        std::format_to(std::back_inserter(output), "{:u}", s);
+    });
+#endif
+    row("utf32 format {:v}", utf32, [&](std::u32string const& s) {
+        output.clear();
+        std::format_to(std::back_inserter(output), "{:v}", s);
+    });
+
+    for (auto level : all_levels)
+    {
+        if (utf::simd_level_supported(level))
+        {
+            row(std::string("utf32 codec ") + std::string(utf::simd_level_name(level)), utf32, [&](std::u32string const& s) {
+                utf::utf32_to_utf8(s.data(), s.size(), direct.data(), level);
+            });
+        }
+    }
+
+    for (auto level : all_levels)
+    {
+        if (utf::simd_level_supported(level))
+        {
+            row(std::string("utf32 length ") + std::string(utf::simd_level_name(level)), utf32, [&](std::u32string const& s) {
+                volatile auto length = utf::utf8_length(s.data(), s.size(), level);
+                (void)length;
+            });
+        }
+    }
+
+    row("utf32 to_utf8", utf32, [&](std::u32string const& s) {
+        output = utf::to_utf8(s);
+    });
+    row("utf32 format_to_n 4K", utf32, [&](std::u32string const& s) {
+        utf::format_to_n(direct.data(), 4096, s);
+    });
+
+    // The decode rows count input code units, so UTF-8 rows are in bytes.
+    auto decode_rows = [&](std::string_view encoding, auto member) {
+        using text_type = std::remove_cvref_t<decltype(std::declval<corpus>().*member)>;
+        row(std::string(encoding) + " code_points", member, [&](text_type const& s) {
+            char32_t sum = 0;
+            for (auto c : utf::code_points(s))
+            {
+                sum += c;
+            }
+            volatile auto result = sum;
+            (void)result;
+        });
+        row(std::string(encoding) + " decode_into", member, [&](text_type const& s) {
+            utf::decode_into(std::basic_string_view(s), std::span(decoded));
+        });
+    };
+
+    decode_rows("utf8", utf8);
+    decode_rows("utf16", utf16);
+    decode_rows("utf32", utf32);
+
+    // Both encodings of the same text against each other; the rate is in UTF-8 bytes.
+    auto compare_row = [&](std::string_view label, auto&& compare) {
+        std::cout << std::left << std::setw(26) << label << std::right << std::fixed << std::setprecision(0);
+        for (auto const& c : corpora)
+        {
+            std::cout << std::setw(10) << units_per_microsecond(c.utf8.size(), [&] {
+                volatile auto result = compare(c.utf8, c.utf16);
+                (void)result;
+            });
+        }
+        std::cout << "\n";
+    };
+
+    compare_row("utf8 ranges::equal utf16", [](std::string const& a, std::u16string const& b) {
+        return std::ranges::equal(utf::code_points(a), utf::code_points(b));
+    });
+    compare_row("utf8 equal utf16", [](std::string const& a, std::u16string const& b) {
+        return utf::equal(a, b);
+    });
+    // The UTF-8 side is one byte short, so the order is only known at the end.
+    compare_row("utf8 compare utf16", [](std::string const& a, std::u16string const& b) {
+        return utf::compare(std::string_view(a).substr(0, a.size() - 1), b) < 0;
+    });
+    compare_row("utf8 hash", [](std::string const& a, std::u16string const&) {
+        return utf::hash(a);
+    });
+
+    row("utf16 hash", utf16, [&](std::u16string const& s) {
+        volatile auto result = utf::hash(s);
+        (void)result;
+    });
+    row("utf32 hash", utf32, [&](std::u32string const& s) {
+        volatile auto result = utf::hash(s);
+        (void)result;
+    });
+
+    // Each call builds a fresh std::string, as std::format does.
+    std::cout << "\n" << std::left << std::setw(26) << "allocations per call";
+    for (auto const& c : corpora)
+    {
+        std::cout << std::right << std::setw(10) << c.name;
+    }
+    std::cout << "\n";
+
+    auto allocation_row = [&](std::string_view label, auto&& convert) {
+        std::cout << std::left << std::setw(26) << label << std::right << std::fixed << std::setprecision(1);
+        for (auto const& c : corpora)
+        {
+            std::cout << std::setw(10) << allocations_per_call([&] { convert(c.utf16); });
+        }
+        std::cout << "\n";
+    };
+
+#if defined(FORMATTER_HAS_CODECVT)
+    allocation_row("utf16 format {:c}", [](std::u16string const& s) { return std::format("{:c}", s); });
+#endif
+#if defined(FORMATTER_HAS_ICU)
+    allocation_row("utf16 format {:u}", [](std::u16string const& s) { return std::format("{:u}", s); });
+#endif
+    allocation_row("utf16 format {:v}", [](std::u16string const& s) { return std::format("{:v}", s); });
+    allocation_row("utf16 to_utf8", [](std::u16string const& s) { return utf::to_utf8(s); });
+    allocation_row("utf16 format_to_n 4K", [&](std::u16string const& s) { return utf::format_to_n(direct.data(), 4096, s); });
+    allocation_row("utf16 compare utf8", [&](std::u16string const& s) { return utf::compare(s, corpora.front().utf8); });
+    allocation_row("utf16 hash", [](std::u16string const& s) { return utf::hash(s); });
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <format>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "utf_transcode.h"
+
+/*
+    Writing wide strings out as UTF-8 with the built-in codec, measuring first.
+
+    utf8_length counts the exact output size with the SIMD counters, so the output can be sized once and the
+    transcoder can write straight into it: append_utf8 and to_utf8 make at most one allocation, and format_to_n
+    stops transcoding at the limit yet still reports the full size, as std::format_to_n does. Anything that can
+    only take bytes through an iterator gets them a chunk at a time from for_each_utf8_chunk.
+
+    Sources are char16_t, char32_t or wchar_t strings, views, arrays or pointers. wchar_t is UTF-16 where it is
+    two bytes (Windows) and UTF-32 where it is four.
+*/
+namespace utf
+{
+    // The fixed-width unit a wide character type holds.
+    template<typename TChar> struct unit_of;
+    template<> struct unit_of<char16_t> { using type = char16_t; };
+    template<> struct unit_of<char32_t> { using type = char32_t; };
+    template<> struct unit_of<wchar_t> { using type = std::conditional_t<sizeof(wchar_t) == 2, char16_t, char32_t>; };
+
+    template<typename TChar> using unit_t = typename unit_of<TChar>::type;
+
+    template<typename TChar> concept wide_char = requires { typename unit_of<TChar>::type; };
+
+    template<typename TString> concept wide_string =
+        std::is_convertible_v<TString const&, std::u16string_view> ||
+        std::is_convertible_v<TString const&, std::u32string_view> ||
+        std::is_convertible_v<TString const&, std::wstring_view>;
+
+    template<wide_string TString> auto wide_view(TString const& s)
+    {
+        if constexpr (std::is_convertible_v<TString const&, std::u16string_view>)
+        {
+            return std::u16string_view{ s };
+        }
+        else if constexpr (std::is_convertible_v<TString const&, std::u32string_view>)
+        {
+            return std::u32string_view{ s };
+        }
+        else
+        {
+            return std::wstring_view{ s };
+        }
+    }
+
+    template<wide_char TChar, typename TTraits> size_t utf8_length(std::basic_string_view<TChar, TTraits> s)
+    {
+        return utf8_length(reinterpret_cast<unit_t<TChar> const*>(s.data()), s.size());
+    }
+
+    // Writes exactly utf8_length(s) bytes to output and returns that count.
+    template<wide_char TChar, typename TTraits> size_t write_utf8(std::basic_string_view<TChar, TTraits> s, char* output)
+    {
+        auto units = reinterpret_cast<unit_t<TChar> const*>(s.data());
+        if constexpr (sizeof(unit_t<TChar>) == 2)
+        {
+            return utf16_to_utf8(units, s.size(), output);
+        }
+        else
+        {
+            return utf32_to_utf8(units, s.size(), output);
+        }
+    }
+
+    // Transcodes s a chunk at a time into a stack buffer and hands each chunk to fn(char const*, size_t), stopping
+    // early if fn returns false. UTF-16 chunks back off by one unit rather than split a surrogate pair.
+    template<wide_char TChar, typename TTraits, typename Fn> void for_each_utf8_chunk(std::basic_string_view<TChar, TTraits> s, Fn&& fn)
+    {
+        using unit_type = unit_t<TChar>;
+        const size_t chunkUnits = 256;
+        std::array<char, utf8_capacity_for_utf32(chunkUnits)> utf8Data;
+        auto inputPtr = reinterpret_cast<unit_type const*>(s.data());
+        auto remaining = s.size();
+
+        while (remaining != 0)
+        {
+            auto count = std::min(remaining, chunkUnits);
+            size_t written;
+            if constexpr (sizeof(unit_type) == 2)
+            {
+                if ((count < remaining) && ((inputPtr[count - 1] & 0xFC00) == 0xD800))
+                {
+                    --count;
+                }
+                written = utf16_to_utf8(inputPtr, count, utf8Data.data());
+            }
+            else
+            {
+                written = utf32_to_utf8(inputPtr, count, utf8Data.data());
+            }
+
+            if (!fn(utf8Data.data(), written))
+            {
+                return;
+            }
+            inputPtr += count;
+            remaining -= count;
+        }
+    }
+
+    // A contiguous char container that can grow at the end: std::string, std::vector<char> and the like.
+    template<typename TContainer> concept utf8_container = requires(TContainer & c, size_t n) {
+        { c.data() } -> std::same_as<char*>;
+        { c.size() } -> std::convertible_to<size_t>;
+        c.resize(n);
+    };
+
+    template<utf8_container TContainer, wide_string TString> void append_utf8(TContainer& output, TString const& s)
+    {
+        // resize zero-fills what the transcoder is about to overwrite; resize_and_overwrite would skip that, but
+        // libstdc++ 12 sets the size to the capacity rather than the count it returns.
+        auto view = wide_view(s);
+        auto at = output.size();
+        output.resize(at + utf8_length(view));
+        write_utf8(view, output.data() + at);
+    }
+
+    template<wide_string TString> std::string to_utf8(TString const& s)
+    {
+        std::string result;
+        append_utf8(result, s);
+        return result;
+    }
+
+    // std::format_to_n for one string: writes at most n bytes (cutting a sequence short at the limit, as
+    // format_to_n does) and reports the untruncated length in size, without transcoding past the limit.
+    template<wide_string TString> std::format_to_n_result<char*> format_to_n(char* output, std::iter_difference_t<char*> n, TString const& s)
+    {
+        auto view = wide_view(s);
+        auto length = utf8_length(view);
+        auto limit = static_cast<size_t>(std::max<std::iter_difference_t<char*>>(n, 0));
+        if (length <= limit)
+        {
+            return { output + write_utf8(view, output), static_cast<std::iter_difference_t<char*>>(length) };
+        }
+
+        auto out = output;
+        for_each_utf8_chunk(view, [&](char const* chunk, size_t size) {
+            auto take = std::min(size, limit - static_cast<size_t>(out - output));
+            out = std::copy_n(chunk, take, out);
+            return static_cast<size_t>(out - output) < limit;
+        });
+        return { out, static_cast<std::iter_difference_t<char*>>(length) };
+    }
+
+    // The container behind a back_insert_iterator, through its protected member.
+    template<typename TContainer> TContainer& container_of(std::back_insert_iterator<TContainer> it)
+    {
+        struct access : std::back_insert_iterator<TContainer>
+        {
+            static TContainer* get(std::back_insert_iterator<TContainer> const& it)
+            {
+                return it.*(&access::container);
+            }
+        };
+        return *access::get(it);
+    }
+
+    // Appending through a back_insert_iterator can size its container once instead of growing it per byte.
+    template<typename TIterator> struct growable_output : std::false_type {};
+    template<utf8_container TContainer> struct growable_output<std::back_insert_iterator<TContainer>> : std::true_type {};
+
+    // Writes s through an output iterator: straight into the destination when it is a pointer or a growable
+    // container, otherwise a chunk at a time.
+    template<typename TIterator, wide_char TChar, typename TTraits> TIterator put_utf8(std::basic_string_view<TChar, TTraits> s, TIterator it)
+    {
+        if constexpr (std::is_same_v<TIterator, char*>)
+        {
+            return it + write_utf8(s, it);
+        }
+        else if constexpr (growable_output<TIterator>::value)
+        {
+            append_utf8(container_of(it), s);
+            return it;
+        }
+        else
+        {
+            for_each_utf8_chunk(s, [&](char const* chunk, size_t size) {
+                it = std::copy_n(chunk, size, it);
+                return true;
+            });
+            return it;
+        }
+    }
+}
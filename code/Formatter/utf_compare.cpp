@@ -0,0 +1,420 @@
+#include "utf_compare.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+
+#include "code_points.h"
+#include "utf_transcode.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define UTF_SSE2_COMPARE 1
+#include <emmintrin.h>
+#endif
+
+namespace utf
+{
+    namespace
+    {
+        bool is_continuation(char c)
+        {
+            return (static_cast<uint8_t>(c) & 0xC0) == 0x80;
+        }
+
+        uint32_t utf8_size(char32_t c)
+        {
+            return (c < 0x80) ? 1 : (c < 0x800) ? 2 : (c < 0x10000) ? 3 : 4;
+        }
+
+        // The index of the first byte where a and b differ, or n if the first n bytes match.
+        size_t mismatch(char const* a, char const* b, size_t n)
+        {
+            size_t i = 0;
+#if defined(UTF_SSE2_COMPARE)
+            while (i + 16 <= n)
+            {
+                auto x = _mm_loadu_si128(reinterpret_cast<__m128i const*>(a + i));
+                auto y = _mm_loadu_si128(reinterpret_cast<__m128i const*>(b + i));
+                auto same = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)));
+                if (same != 0xFFFF)
+                {
+                    return i + std::countr_one(same);
+                }
+                i += 16;
+            }
+#endif
+            while ((i < n) && (a[i] == b[i]))
+            {
+                i++;
+            }
+            return i;
+        }
+
+        // One side of a comparison, seen as UTF-8 bytes. UTF-8 input is its own window; wider input is
+        // transcoded a chunk at a time, never splitting a surrogate pair, so every chunk ends on a code point.
+        template<typename TUnit> class utf8_source
+        {
+        public:
+            static constexpr bool in_place = (sizeof(TUnit) == 1);
+
+            utf8_source(TUnit const* input, size_t count) : position_(input), end_(input + count)
+            {
+            }
+
+            bool empty() const
+            {
+                return position_ == end_;
+            }
+
+            // The bytes from the current position: all that is left of UTF-8 input, the rest of the chunk
+            // otherwise.
+            std::string_view window()
+            {
+                if constexpr (in_place)
+                {
+                    return { reinterpret_cast<char const*>(position_), static_cast<size_t>(end_ - position_) };
+                }
+                else
+                {
+                    if (offset_ == size_)
+                    {
+                        fill();
+                    }
+                    return { buffer_.data() + offset_, size_ - offset_ };
+                }
+            }
+
+            // Whether decoding this side alone puts a code point boundary at byte j of the window.
+            bool boundary(size_t j) const
+            {
+                if constexpr (in_place)
+                {
+                    // Decoding only ever consumes continuation bytes after a lead, so any other byte starts
+                    // a code point, malformed input or not.
+                    return (position_ + j == end_) || !is_continuation(static_cast<char>(position_[j]));
+                }
+                else
+                {
+                    return (offset_ + j == size_) || !is_continuation(buffer_[offset_ + j]);
+                }
+            }
+
+            // Moves past the first j bytes of the window, which must end on a code point.
+            void skip(size_t j)
+            {
+                if constexpr (in_place)
+                {
+                    position_ += j;
+                }
+                else if (offset_ + j == size_)
+                {
+                    position_ = chunkEnd_;
+                    offset_ = size_;
+                }
+                else
+                {
+                    // Every code point has one lead byte; only four-byte ones take two UTF-16 units.
+                    size_t units = 0;
+                    for (size_t k = offset_; k < offset_ + j; k++)
+                    {
+                        auto c = static_cast<uint8_t>(buffer_[k]);
+                        units += ((c & 0xC0) != 0x80) + ((sizeof(TUnit) == 2) && (c >= 0xF0));
+                    }
+                    position_ += units;
+                    offset_ += j;
+                }
+            }
+
+            char32_t next()
+            {
+                auto d = decode_one(position_, end_);
+                position_ += d.length;
+                if constexpr (!in_place)
+                {
+                    // The transcoder writes the same code point, replacements included.
+                    if (offset_ != size_)
+                    {
+                        offset_ += utf8_size(d.value);
+                    }
+                }
+                return d.value;
+            }
+
+        private:
+            static constexpr size_t chunkUnits = 256;
+
+            void fill()
+            {
+                auto count = std::min(static_cast<size_t>(end_ - position_), chunkUnits);
+                if constexpr (sizeof(TUnit) == 2)
+                {
+                    if ((position_ + count != end_) && ((position_[count - 1] & 0xFC00) == 0xD800))
+                    {
+                        --count;
+                    }
+                    size_ = utf16_to_utf8(position_, count, buffer_.data());
+                }
+                else
+                {
+                    size_ = utf32_to_utf8(position_, count, buffer_.data());
+                }
+                offset_ = 0;
+                chunkEnd_ = position_ + count;
+            }
+
+            TUnit const* position_;
+            TUnit const* end_;
+            TUnit const* chunkEnd_ = nullptr;
+            std::array<char, in_place ? 1 : utf8_capacity_for_utf32(chunkUnits)> buffer_;
+            size_t offset_ = 0;
+            size_t size_ = 0;
+        };
+
+        template<typename TA, typename TB> std::strong_ordering compare_sources(utf8_source<TA> a, utf8_source<TB> b)
+        {
+            // Equal bytes that end on a code point of a transcoded side are whole, well-formed code points on
+            // both sides; two in-place sides need a code point start on each.
+            auto whole = [&](size_t j) {
+                if constexpr (!utf8_source<TA>::in_place)
+                {
+                    return a.boundary(j);
+                }
+                else if constexpr (!utf8_source<TB>::in_place)
+                {
+                    return b.boundary(j);
+                }
+                else
+                {
+                    return a.boundary(j) && b.boundary(j);
+                }
+            };
+
+            while (!a.empty() && !b.empty())
+            {
+                auto x = a.window();
+                auto y = b.window();
+                auto n = std::min(x.size(), y.size());
+                auto j = mismatch(x.data(), y.data(), n);
+                while ((j != 0) && !whole(j))
+                {
+                    --j;
+                }
+
+                if (j != 0)
+                {
+                    a.skip(j);
+                    b.skip(j);
+                    if ((j == n) || a.empty() || b.empty())
+                    {
+                        continue;
+                    }
+                }
+
+                // A difference, or malformed input, or the end of a window in the middle of a code point.
+                auto c = a.next();
+                auto d = b.next();
+                if (c != d)
+                {
+                    return c <=> d;
+                }
+            }
+            return !a.empty() <=> !b.empty();
+        }
+
+        template<typename TUnit> utf8_source<TUnit> source(text_view s)
+        {
+            return { static_cast<TUnit const*>(s.data()), s.size() };
+        }
+
+        template<typename TA> std::strong_ordering compare_with(utf8_source<TA> a, text_view b)
+        {
+            switch (b.unit_size())
+            {
+            case 1: return compare_sources(a, source<char>(b));
+            case 2: return compare_sources(a, source<char16_t>(b));
+            default: return compare_sources(a, source<char32_t>(b));
+            }
+        }
+
+        // XXH64 with seed 0, fed in pieces of any size.
+        class xxh64
+        {
+        public:
+            void update(char const* data, size_t size)
+            {
+                total_ += size;
+                if (buffered_ + size < stripe)
+                {
+                    std::memcpy(buffer_.data() + buffered_, data, size);
+                    buffered_ += size;
+                    return;
+                }
+
+                if (buffered_ != 0)
+                {
+                    auto fill = stripe - buffered_;
+                    std::memcpy(buffer_.data() + buffered_, data, fill);
+                    consume(buffer_.data());
+                    data += fill;
+                    size -= fill;
+                    buffered_ = 0;
+                }
+
+                for (; size >= stripe; data += stripe, size -= stripe)
+                {
+                    consume(data);
+                }
+                std::memcpy(buffer_.data(), data, size);
+                buffered_ = size;
+            }
+
+            uint64_t digest() const
+            {
+                uint64_t h;
+                if (total_ >= stripe)
+                {
+                    h = std::rotl(lanes_[0], 1) + std::rotl(lanes_[1], 7) + std::rotl(lanes_[2], 12) + std::rotl(lanes_[3], 18);
+                    for (auto lane : lanes_)
+                    {
+                        h = (h ^ round(0, lane)) * prime1 + prime4;
+                    }
+                }
+                else
+                {
+                    h = prime5;
+                }
+                h += total_;
+
+                auto p = buffer_.data();
+                auto left = buffered_;
+                for (; left >= 8; p += 8, left -= 8)
+                {
+                    h = std::rotl(h ^ round(0, load<uint64_t>(p)), 27) * prime1 + prime4;
+                }
+                if (left >= 4)
+                {
+                    h = std::rotl(h ^ (load<uint32_t>(p) * prime1), 23) * prime2 + prime3;
+                    p += 4;
+                    left -= 4;
+                }
+                for (; left != 0; p++, left--)
+                {
+                    h = std::rotl(h ^ (static_cast<uint8_t>(*p) * prime5), 11) * prime1;
+                }
+
+                h = (h ^ (h >> 33)) * prime2;
+                h = (h ^ (h >> 29)) * prime3;
+                return h ^ (h >> 32);
+            }
+
+        private:
+            static constexpr uint64_t prime1 = 0x9E3779B185EBCA87;
+            static constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4F;
+            static constexpr uint64_t prime3 = 0x165667B19E3779F9;
+            static constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63;
+            static constexpr uint64_t prime5 = 0x27D4EB2F165667C5;
+            static constexpr size_t stripe = 32;
+
+            template<typename T> static T load(char const* p)
+            {
+                T value;
+                std::memcpy(&value, p, sizeof(T));
+                return value;
+            }
+
+            static uint64_t round(uint64_t lane, uint64_t input)
+            {
+                return std::rotl(lane + input * prime2, 31) * prime1;
+            }
+
+            void consume(char const* p)
+            {
+                for (size_t i = 0; i < 4; i++)
+                {
+                    lanes_[i] = round(lanes_[i], load<uint64_t>(p + i * 8));
+                }
+            }
+
+            std::array<uint64_t, 4> lanes_ = { prime1 + prime2, prime2, 0, 0 - prime1 };
+            std::array<char, stripe> buffer_;
+            size_t buffered_ = 0;
+            uint64_t total_ = 0;
+        };
+
+        // UTF-8 input is hashed in place, with each malformed sequence hashed as the U+FFFD that decodes from it.
+        void hash_utf8(char const* p, size_t count, xxh64& h)
+        {
+            static constexpr char replacement[] = { '\xEF', '\xBF', '\xBD' };
+            auto end = p + count;
+            auto run = p;
+            while (p != end)
+            {
+#if defined(UTF_SSE2_COMPARE)
+                while ((end - p >= 16) && (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(p))) == 0))
+                {
+                    p += 16;
+                }
+                if (p == end)
+                {
+                    break;
+                }
+#endif
+                if (static_cast<uint8_t>(*p) < 0x80)
+                {
+                    p++;
+                    continue;
+                }
+
+                // A literal U+FFFD is the only well-formed sequence that decodes to it.
+                auto d = decode_one(p, end);
+                if ((d.value == 0xFFFD) && ((d.length != 3) || (static_cast<uint8_t>(*p) != 0xEF)))
+                {
+                    h.update(run, static_cast<size_t>(p - run));
+                    h.update(replacement, sizeof(replacement));
+                    run = p + d.length;
+                }
+                p += d.length;
+            }
+            h.update(run, static_cast<size_t>(p - run));
+        }
+
+        template<typename TUnit> void hash_wide(TUnit const* input, size_t count, xxh64& h)
+        {
+            utf8_source<TUnit> s(input, count);
+            while (!s.empty())
+            {
+                auto w = s.window();
+                h.update(w.data(), w.size());
+                s.skip(w.size());
+            }
+        }
+    }
+
+    std::strong_ordering compare(text_view a, text_view b)
+    {
+        switch (a.unit_size())
+        {
+        case 1: return compare_with(source<char>(a), b);
+        case 2: return compare_with(source<char16_t>(a), b);
+        default: return compare_with(source<char32_t>(a), b);
+        }
+    }
+
+    bool equal(text_view a, text_view b)
+    {
+        return compare(a, b) == 0;
+    }
+
+    uint64_t hash(text_view s)
+    {
+        xxh64 h;
+        switch (s.unit_size())
+        {
+        case 1: hash_utf8(static_cast<char const*>(s.data()), s.size(), h); break;
+        case 2: hash_wide(static_cast<char16_t const*>(s.data()), s.size(), h); break;
+        default: hash_wide(static_cast<char32_t const*>(s.data()), s.size(), h); break;
+        }
+        return h.digest();
+    }
+}
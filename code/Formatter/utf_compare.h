@@ -0,0 +1,147 @@
+#pragma once
+
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+/*
+    Equality, ordering and hashing of text in any of UTF-8, UTF-16 and UTF-32 against any other, with no heap
+    allocation: UTF-8 text is read in place, and UTF-16 and UTF-32 text is transcoded 256 units at a time into a
+    stack buffer.
+
+    Every function gives the answer that decoding both sides with utf::code_points and comparing the code points
+    would, malformed input included (it compares as U+FFFD), and hash gives equal text the same value whatever
+    its encoding. That lets a std::string, a std::u16string and a std::wstring holding the same text find the
+    same entry in one table: an unordered_map<std::string, V, utf::text_hash, utf::text_equal> can be searched
+    with a u"..." key directly.
+
+    Both sides are compared as UTF-8 bytes, since UTF-8 sorts in code point order; the wide text's chunks go
+    through the built-in codec and never split a surrogate pair. Matching runs are skipped a 16-byte block at a
+    time, and only the code points around a difference (or around malformed input) are decoded one by one. The
+    hash is XXH64 of the text's well-formed UTF-8.
+*/
+namespace utf
+{
+    // Borrowed text in one of the Unicode encodings: char and char8_t are UTF-8, char16_t UTF-16, char32_t
+    // UTF-32, and wchar_t UTF-16 or UTF-32 by its size.
+    class text_view
+    {
+    public:
+        text_view(std::string_view s) : data_(s.data()), size_(s.size()), unitSize_(1)
+        {
+        }
+
+        text_view(std::u8string_view s) : data_(s.data()), size_(s.size()), unitSize_(1)
+        {
+        }
+
+        text_view(std::u16string_view s) : data_(s.data()), size_(s.size()), unitSize_(2)
+        {
+        }
+
+        text_view(std::u32string_view s) : data_(s.data()), size_(s.size()), unitSize_(4)
+        {
+        }
+
+        text_view(std::wstring_view s) : data_(s.data()), size_(s.size()), unitSize_(sizeof(wchar_t))
+        {
+        }
+
+        // Strings, arrays and pointers, which would otherwise need two conversions to get here.
+        template<typename TString>
+            requires (!std::is_same_v<std::remove_cvref_t<TString>, text_view>) &&
+                (std::is_convertible_v<TString const&, std::string_view> ||
+                    std::is_convertible_v<TString const&, std::u8string_view> ||
+                    std::is_convertible_v<TString const&, std::u16string_view> ||
+                    std::is_convertible_v<TString const&, std::u32string_view> ||
+                    std::is_convertible_v<TString const&, std::wstring_view>)
+        text_view(TString const& s) : text_view(view_of(s))
+        {
+        }
+
+        void const* data() const
+        {
+            return data_;
+        }
+
+        // The length in code units.
+        size_t size() const
+        {
+            return size_;
+        }
+
+        // 1 for UTF-8, 2 for UTF-16, 4 for UTF-32.
+        uint32_t unit_size() const
+        {
+            return unitSize_;
+        }
+
+    private:
+        template<typename TString> static auto view_of(TString const& s)
+        {
+            if constexpr (std::is_convertible_v<TString const&, std::string_view>)
+            {
+                return std::string_view{ s };
+            }
+            else if constexpr (std::is_convertible_v<TString const&, std::u8string_view>)
+            {
+                return std::u8string_view{ s };
+            }
+            else if constexpr (std::is_convertible_v<TString const&, std::u16string_view>)
+            {
+                return std::u16string_view{ s };
+            }
+            else if constexpr (std::is_convertible_v<TString const&, std::u32string_view>)
+            {
+                return std::u32string_view{ s };
+            }
+            else
+            {
+                return std::wstring_view{ s };
+            }
+        }
+
+        void const* data_;
+        size_t size_;
+        uint32_t unitSize_;
+    };
+
+    // Code point by code point, as std::lexicographical_compare_three_way over the decoded text.
+    std::strong_ordering compare(text_view a, text_view b);
+    bool equal(text_view a, text_view b);
+
+    uint64_t hash(text_view s);
+
+    // Transparent hash and comparisons for containers keyed on text in more than one encoding.
+    struct text_hash
+    {
+        using is_transparent = void;
+
+        size_t operator()(text_view s) const
+        {
+            return static_cast<size_t>(hash(s));
+        }
+    };
+
+    struct text_equal
+    {
+        using is_transparent = void;
+
+        bool operator()(text_view a, text_view b) const
+        {
+            return equal(a, b);
+        }
+    };
+
+    struct text_less
+    {
+        using is_transparent = void;
+
+        bool operator()(text_view a, text_view b) const
+        {
+            return compare(a, b) < 0;
+        }
+    };
+}
@@ -0,0 +1,784 @@
+#include "utf_transcode.h"
+
+#include <array>
+#include <bit>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define UTF_X64_KERNELS 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang compile each kernel for its own instruction set so the rest of the build keeps the baseline
+// target; MSVC allows the intrinsics anywhere. Steps shared between kernels are forced inline so the AVX kernels
+// get them VEX-encoded: an out-of-line SSE step called from AVX code pays a state transition on every call.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define UTF_TARGET(isa)
+#define UTF_FORCE_INLINE __forceinline
+#else
+#define UTF_TARGET(isa) __attribute__((target(isa)))
+#define UTF_FORCE_INLINE inline __attribute__((always_inline))
+#endif
+
+namespace utf
+{
+    namespace
+    {
+        constexpr char16_t replacement = 0xFFFD;
+
+        // Writes the UTF-8 form of a scalar value, or of U+FFFD for a surrogate or anything past U+10FFFF.
+        inline char* write_code_point(uint32_t c, char* out)
+        {
+            if (c < 0x80)
+            {
+                *out++ = static_cast<char>(c);
+                return out;
+            }
+
+            if (c < 0x800)
+            {
+                *out++ = static_cast<char>(0xC0 | (c >> 6));
+                *out++ = static_cast<char>(0x80 | (c & 0x3F));
+                return out;
+            }
+
+            if (((c & 0xFFFFF800) == 0xD800) || (c > 0x10FFFF))
+            {
+                c = replacement;
+            }
+
+            if (c < 0x10000)
+            {
+                *out++ = static_cast<char>(0xE0 | (c >> 12));
+                *out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+                *out++ = static_cast<char>(0x80 | (c & 0x3F));
+                return out;
+            }
+
+            *out++ = static_cast<char>(0xF0 | (c >> 18));
+            *out++ = static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+            *out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            *out++ = static_cast<char>(0x80 | (c & 0x3F));
+            return out;
+        }
+
+        // Encodes the code point starting at input[i], advancing i past it.
+        inline char* encode_one(char16_t const* input, size_t count, size_t& i, char* out)
+        {
+            uint32_t c = input[i++];
+            if (((c & 0xFC00) == 0xD800) && (i < count) && ((input[i] & 0xFC00) == 0xDC00))
+            {
+                c = 0x10000 + ((c - 0xD800) << 10) + (input[i++] - 0xDC00);
+            }
+            return write_code_point(c, out);
+        }
+
+        // Encodes units [i, end) plus, when end splits a surrogate pair, the unit that completes it.
+        inline char* encode_scalar(char16_t const* input, size_t count, size_t& i, size_t end, char* out)
+        {
+            while (i < end)
+            {
+                out = encode_one(input, count, i, out);
+            }
+            return out;
+        }
+
+        size_t utf16_to_utf8_scalar(char16_t const* input, size_t count, char* output)
+        {
+            size_t i = 0;
+            return static_cast<size_t>(encode_scalar(input, count, i, count, output) - output);
+        }
+
+        inline char* encode_scalar(char32_t const* input, size_t& i, size_t end, char* out)
+        {
+            for (; i < end; i++)
+            {
+                out = write_code_point(input[i], out);
+            }
+            return out;
+        }
+
+        size_t utf32_to_utf8_scalar(char32_t const* input, size_t count, char* output)
+        {
+            size_t i = 0;
+            return static_cast<size_t>(encode_scalar(input, i, count, output) - output);
+        }
+
+        // The byte counts of encode_one and write_code_point, without the writes.
+        inline size_t length_scalar(char16_t const* input, size_t count, size_t& i, size_t end)
+        {
+            size_t length = 0;
+            while (i < end)
+            {
+                uint32_t c = input[i++];
+                if (c < 0x80)
+                {
+                    length += 1;
+                }
+                else if (c < 0x800)
+                {
+                    length += 2;
+                }
+                else if (((c & 0xFC00) == 0xD800) && (i < count) && ((input[i] & 0xFC00) == 0xDC00))
+                {
+                    ++i;
+                    length += 4;
+                }
+                else
+                {
+                    length += 3;
+                }
+            }
+            return length;
+        }
+
+        inline size_t length_scalar(char32_t const* input, size_t& i, size_t end)
+        {
+            size_t length = 0;
+            for (; i < end; i++)
+            {
+                uint32_t c = input[i];
+                length += (c < 0x80) ? 1 : (c < 0x800) ? 2 : ((c < 0x10000) || (c > 0x10FFFF)) ? 3 : 4;
+            }
+            return length;
+        }
+
+        size_t utf8_length_scalar(char16_t const* input, size_t count)
+        {
+            size_t i = 0;
+            return length_scalar(input, count, i, count);
+        }
+
+        size_t utf8_length_scalar(char32_t const* input, size_t count)
+        {
+            size_t i = 0;
+            return length_scalar(input, i, count);
+        }
+
+#if defined(UTF_X64_KERNELS)
+        struct cpu_features
+        {
+            bool sse41 = false;
+            bool avx2 = false;
+            bool avx512bw = false;
+        };
+
+        cpu_features detect_cpu_features()
+        {
+            cpu_features features;
+#if defined(_MSC_VER) && !defined(__clang__)
+            int info[4];
+            __cpuid(info, 1);
+            features.sse41 = (info[2] & (1 << 19)) != 0;
+            auto osxsave = (info[2] & (1 << 27)) != 0;
+            auto xcr0 = osxsave ? _xgetbv(0) : 0;
+            __cpuidex(info, 7, 0);
+            features.avx2 = ((xcr0 & 6) == 6) && ((info[1] & (1 << 5)) != 0);
+            features.avx512bw = ((xcr0 & 0xE6) == 0xE6) && ((info[1] & (1 << 16)) != 0) && ((info[1] & (1 << 30)) != 0);
+#else
+            __builtin_cpu_init();
+            features.sse41 = __builtin_cpu_supports("sse4.1");
+            features.avx2 = __builtin_cpu_supports("avx2");
+            features.avx512bw = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+            return features;
+        }
+
+        cpu_features const& cpu()
+        {
+            static cpu_features const features = detect_cpu_features();
+            return features;
+        }
+
+        // For each 8-bit mask of ASCII lanes, the shuffle that keeps byte 0 of every lane and byte 1 of every
+        // non-ASCII lane, in order, and the number of bytes kept.
+        struct compaction
+        {
+            alignas(16) std::array<std::array<uint8_t, 16>, 256> shuffle;
+            std::array<uint8_t, 256> length;
+        };
+
+        constexpr compaction make_compaction()
+        {
+            compaction table{};
+            for (unsigned mask = 0; mask < 256; mask++)
+            {
+                uint8_t n = 0;
+                for (unsigned lane = 0; lane < 8; lane++)
+                {
+                    table.shuffle[mask][n++] = static_cast<uint8_t>(2 * lane);
+                    if ((mask & (1u << lane)) == 0)
+                    {
+                        table.shuffle[mask][n++] = static_cast<uint8_t>(2 * lane + 1);
+                    }
+                }
+                table.length[mask] = n;
+                for (uint8_t k = n; k < 16; k++)
+                {
+                    table.shuffle[mask][k] = 0x80;
+                }
+            }
+            return table;
+        }
+
+        constexpr compaction two_byte_compaction = make_compaction();
+
+        // One step over at least 16 remaining units: 16 ASCII units, or 8 units below 0x800, or 8 units
+        // through the scalar encoder. The caller guarantees 16 readable units and 48 writable bytes.
+        UTF_TARGET("sse4.1") UTF_FORCE_INLINE char* step_sse41(char16_t const* input, size_t count, size_t& i, char* out)
+        {
+            auto v0 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(input + i));
+            auto v1 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(input + i + 8));
+            if (_mm_testz_si128(_mm_or_si128(v0, v1), _mm_set1_epi16(static_cast<short>(0xFF80))))
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(v0, v1));
+                i += 16;
+                return out + 16;
+            }
+
+            if (_mm_testz_si128(v0, _mm_set1_epi16(static_cast<short>(0xF800))))
+            {
+                // Two-byte form of every lane, lead byte first: 0xC0 | c >> 6, then 0x80 | c & 0x3F.
+                auto lead = _mm_or_si128(_mm_srli_epi16(v0, 6), _mm_set1_epi16(0xC0));
+                auto trail = _mm_or_si128(_mm_and_si128(v0, _mm_set1_epi16(0x3F)), _mm_set1_epi16(0x80));
+                auto twoByte = _mm_or_si128(lead, _mm_slli_epi16(trail, 8));
+
+                // ASCII lanes keep the unit itself in byte 0 and drop byte 1.
+                auto ascii = _mm_cmplt_epi16(v0, _mm_set1_epi16(0x80));
+                auto encoded = _mm_blendv_epi8(twoByte, v0, ascii);
+                auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_packs_epi16(ascii, ascii))) & 0xFF;
+
+                auto shuffle = _mm_load_si128(reinterpret_cast<__m128i const*>(two_byte_compaction.shuffle[mask].data()));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_shuffle_epi8(encoded, shuffle));
+                i += 8;
+                return out + two_byte_compaction.length[mask];
+            }
+
+            return encode_scalar(input, count, i, i + 8, out);
+        }
+
+        UTF_TARGET("sse4.1") size_t utf16_to_utf8_sse41(char16_t const* input, size_t count, char* output)
+        {
+            size_t i = 0;
+            auto out = output;
+            while (i + 16 <= count)
+            {
+                out = step_sse41(input, count, i, out);
+            }
+            return static_cast<size_t>(encode_scalar(input, count, i, count, out) - output);
+        }
+
+        UTF_TARGET("avx2") size_t utf16_to_utf8_avx2(char16_t const* input, size_t count, char* output)
+        {
+            size_t i = 0;
+            auto out = output;
+            auto nonAscii = _mm256_set1_epi16(static_cast<short>(0xFF80));
+            while (i + 32 <= count)
+            {
+                auto v0 = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(input + i));
+                auto v1 = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(input + i + 16));
+                if (_mm256_testz_si256(_mm256_or_si256(v0, v1), nonAscii))
+                {
+                    // packus interleaves the 128-bit lanes; put the quarters back in order.
+                    auto packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(v0, v1), 0xD8);
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), packed);
+                    i += 32;
+                    out += 32;
+                }
+                else
+                {
+                    // Finish the block a step at a time rather than retest it every 8 units.
+                    for (auto blockEnd = i + 32; i + 16 <= blockEnd;)
+                    {
+                        out = step_sse41(input, count, i, out);
+                    }
+                }
+            }
+
+            while (i + 16 <= count)
+            {
+                out = step_sse41(input, count, i, out);
+            }
+            return static_cast<size_t>(encode_scalar(input, count, i, count, out) - output);
+        }
+
+        UTF_TARGET("avx512f,avx512bw,avx2,sse4.1") size_t utf16_to_utf8_avx512(char16_t const* input, size_t count, char* output)
+        {
+            size_t i = 0;
+            auto out = output;
+            auto nonAscii = _mm512_set1_epi16(static_cast<short>(0xFF80));
+            while (i + 64 <= count)
+            {
+                auto v0 = _mm512_loadu_si512(input + i);
+                auto v1 = _mm512_loadu_si512(input + i + 32);
+                if (_mm512_test_epi16_mask(_mm512_or_si512(v0, v1), nonAscii) == 0)
+                {
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm512_maskz_cvtepi16_epi8(~0u, v0));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 32), _mm512_maskz_cvtepi16_epi8(~0u, v1));
+                    i += 64;
+                    out += 64;
+                }
+                else
+                {
+                    for (auto blockEnd = i + 64; i + 16 <= blockEnd;)
+                    {
+                        out = step_sse41(input, count, i, out);
+                    }
+                }
+            }
+
+            while (i + 16 <= count)
+            {
+                out = step_sse41(input, count, i, out);
+            }
+            return static_cast<size_t>(encode_scalar(input, count, i, count, out) - output);
+        }
+
+        // UTF-32 input is wide enough that only the ASCII blocks are worth vectorizing; a block holding
+        // anything else is encoded a unit at a time.
+        UTF_TARGET("sse4.1") size_t utf32_to_utf8_sse41(char32_t const* input, size_t count, char* output)
+        {
+            size_t i = 0;
+            auto out = output;
+            auto nonAscii = _mm_set1_epi32(static_cast<int>(0xFFFFFF80));
+            while (i + 16 <= count)
+            {
+                auto p = reinterpret_cast<__m128i const*>(input + i);
+                auto v0 = _mm_loadu_si128(p);
+                auto v1 = _mm_loadu_si128(p + 1);
+                auto v2 = _mm_loadu_si128(p + 2);
+                auto v3 = _mm_loadu_si128(p + 3);
+                if (_mm_testz_si128(_mm_or_si128(_mm_or_si128(v0, v1), _mm_or_si128(v2, v3)), nonAscii))
+                {
+                    auto packed = _mm_packus_epi16(_mm_packus_epi32(v0, v1), _mm_packus_epi32(v2, v3));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), packed);
+                    i += 16;
+                    out += 16;
+                }
+                else
+                {
+                    out = encode_scalar(input, i, i + 16, out);
+                }
+            }
+            return static_cast<size_t>(encode_scalar(input, i, count, out) - output);
+        }
+
+        UTF_TARGET("avx2") size_t utf32_to_utf8_avx2(char32_t const* input, size_t count, char* output)
+        {
+            size_t i = 0;
+            auto out = output;
+            auto nonAscii = _mm256_set1_epi32(static_cast<int>(0xFFFFFF80));
+            // The packs work within 128-bit lanes, leaving dwords in the order a0 b0 c0 d0 a1 b1 c1 d1.
+            auto order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+            while (i + 32 <= count)
+            {
+                auto p = reinterpret_cast<__m256i const*>(input + i);
+                auto v0 = _mm256_loadu_si256(p);
+                auto v1 = _mm256_loadu_si256(p + 1);
+                auto v2 = _mm256_loadu_si256(p + 2);
+                auto v3 = _mm256_loadu_si256(p + 3);
+                if (_mm256_testz_si256(_mm256_or_si256(_mm256_or_si256(v0, v1), _mm256_or_si256(v2, v3)), nonAscii))
+                {
+                    auto packed = _mm256_packus_epi16(_mm256_packus_epi32(v0, v1), _mm256_packus_epi32(v2, v3));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_permutevar8x32_epi32(packed, order));
+                    i += 32;
+                    out += 32;
+                }
+                else
+                {
+                    out = encode_scalar(input, i, i + 32, out);
+                }
+            }
+            return static_cast<size_t>(encode_scalar(input, i, count, out) - output);
+        }
+
+        UTF_TARGET("avx512f,avx2,sse4.1") size_t utf32_to_utf8_avx512(char32_t const* input, size_t count, char* output)
+        {
+            size_t i = 0;
+            auto out = output;
+            auto nonAscii = _mm512_set1_epi32(static_cast<int>(0xFFFFFF80));
+            while (i + 64 <= count)
+            {
+                auto v0 = _mm512_loadu_si512(input + i);
+                auto v1 = _mm512_loadu_si512(input + i + 16);
+                auto v2 = _mm512_loadu_si512(input + i + 32);
+                auto v3 = _mm512_loadu_si512(input + i + 48);
+                auto all = _mm512_or_si512(_mm512_or_si512(v0, v1), _mm512_or_si512(v2, v3));
+                if (_mm512_test_epi32_mask(all, nonAscii) == 0)
+                {
+                    auto o = reinterpret_cast<__m128i*>(out);
+                    _mm_storeu_si128(o, _mm512_maskz_cvtepi32_epi8(0xFFFF, v0));
+                    _mm_storeu_si128(o + 1, _mm512_maskz_cvtepi32_epi8(0xFFFF, v1));
+                    _mm_storeu_si128(o + 2, _mm512_maskz_cvtepi32_epi8(0xFFFF, v2));
+                    _mm_storeu_si128(o + 3, _mm512_maskz_cvtepi32_epi8(0xFFFF, v3));
+                    i += 64;
+                    out += 64;
+                }
+                else
+                {
+                    out = encode_scalar(input, i, i + 64, out);
+                }
+            }
+            return static_cast<size_t>(encode_scalar(input, i, count, out) - output);
+        }
+
+        // Length counting assumes three bytes per unit and subtracts one for every unit below 0x80 and another for
+        // every unit below 0x800, which the compares produce directly as -1 lanes. A surrogate is three bytes (as
+        // U+FFFD) unless it is half of a pair, where each half is two. A high surrogate pairs when the unit after it
+        // is a low one, and a low one when the unit before it is high, so pairs are found from the lane masks and
+        // the units on either side of the block.
+        inline size_t paired_surrogates(char16_t const* input, size_t count, size_t i, size_t width, uint64_t highs, uint64_t lows)
+        {
+            uint64_t nextLow = ((i + width < count) && ((input[i + width] & 0xFC00) == 0xDC00)) ? 1 : 0;
+            uint64_t previousHigh = ((i > 0) && ((input[i - 1] & 0xFC00) == 0xD800)) ? 1 : 0;
+            return static_cast<size_t>(std::popcount(highs & ((lows >> 1) | (nextLow << (width - 1))))
+                + std::popcount(lows & ((highs << 1) | previousHigh)));
+        }
+
+        // Counts the units after the last block, whose first may be the low half of a pair the block counted.
+        inline size_t length_tail(char16_t const* input, size_t count, size_t i)
+        {
+            size_t length = 0;
+            if ((i > 0) && (i < count) && ((input[i - 1] & 0xFC00) == 0xD800) && ((input[i] & 0xFC00) == 0xDC00))
+            {
+                length = 2;
+                ++i;
+            }
+            return length + length_scalar(input, count, i, count);
+        }
+
+        // The SSE and AVX2 counts build up in 32-bit lanes, which are added into a size_t after at most this many
+        // blocks; no lane moves by more than 4 a block, so none can overflow even on inputs of many gigabytes.
+        constexpr size_t lane_flush_blocks = size_t{ 1 } << 24;
+
+        UTF_TARGET("sse4.1") UTF_FORCE_INLINE int64_t sum_lanes(__m128i v)
+        {
+            auto wide = _mm_add_epi64(_mm_cvtepi32_epi64(v), _mm_cvtepi32_epi64(_mm_srli_si128(v, 8)));
+            return _mm_cvtsi128_si64(wide) + _mm_extract_epi64(wide, 1);
+        }
+
+        UTF_TARGET("avx2") UTF_FORCE_INLINE int64_t sum_lanes(__m256i v)
+        {
+            return sum_lanes(_mm256_castsi256_si128(v)) + sum_lanes(_mm256_extracti128_si256(v, 1));
+        }
+
+        UTF_TARGET("sse4.1") size_t utf8_length_sse41(char16_t const* input, size_t count)
+        {
+            size_t i = 0;
+            size_t paired = 0;
+            size_t saved = 0;
+            auto ones = _mm_set1_epi16(1);
+            auto savings = _mm_setzero_si128();
+            size_t flush = i + 8 * lane_flush_blocks;
+            while (i + 8 <= count)
+            {
+                if (i == flush)
+                {
+                    saved += static_cast<size_t>(-sum_lanes(savings));
+                    savings = _mm_setzero_si128();
+                    flush += 8 * lane_flush_blocks;
+                }
+
+                auto v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(input + i));
+                auto high = _mm_and_si128(v, _mm_set1_epi16(static_cast<short>(0xF800)));
+                auto ascii = _mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16(static_cast<short>(0xFF80))), _mm_setzero_si128());
+                auto small = _mm_cmpeq_epi16(high, _mm_setzero_si128());
+                savings = _mm_add_epi32(savings, _mm_madd_epi16(_mm_add_epi16(ascii, small), ones));
+
+                if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_set1_epi16(static_cast<short>(0xD800)))) != 0)
+                {
+                    auto kind = _mm_and_si128(v, _mm_set1_epi16(static_cast<short>(0xFC00)));
+                    auto highs = _mm_cmpeq_epi16(kind, _mm_set1_epi16(static_cast<short>(0xD800)));
+                    auto lows = _mm_cmpeq_epi16(kind, _mm_set1_epi16(static_cast<short>(0xDC00)));
+                    auto masks = static_cast<uint32_t>(_mm_movemask_epi8(_mm_packs_epi16(highs, lows)));
+                    paired += paired_surrogates(input, count, i, 8, masks & 0xFF, masks >> 8);
+                }
+                i += 8;
+            }
+
+            saved += static_cast<size_t>(-sum_lanes(savings));
+            return 3 * i - paired - saved + length_tail(input, count, i);
+        }
+
+        UTF_TARGET("avx2,popcnt") size_t utf8_length_avx2(char16_t const* input, size_t count)
+        {
+            size_t i = 0;
+            size_t paired = 0;
+            size_t saved = 0;
+            auto ones = _mm256_set1_epi16(1);
+            auto savings = _mm256_setzero_si256();
+            size_t flush = i + 16 * lane_flush_blocks;
+            while (i + 16 <= count)
+            {
+                if (i == flush)
+                {
+                    saved += static_cast<size_t>(-sum_lanes(savings));
+                    savings = _mm256_setzero_si256();
+                    flush += 16 * lane_flush_blocks;
+                }
+
+                auto v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(input + i));
+                auto high = _mm256_and_si256(v, _mm256_set1_epi16(static_cast<short>(0xF800)));
+                auto ascii = _mm256_cmpeq_epi16(_mm256_and_si256(v, _mm256_set1_epi16(static_cast<short>(0xFF80))), _mm256_setzero_si256());
+                auto small = _mm256_cmpeq_epi16(high, _mm256_setzero_si256());
+                savings = _mm256_add_epi32(savings, _mm256_madd_epi16(_mm256_add_epi16(ascii, small), ones));
+
+                if (_mm256_movemask_epi8(_mm256_cmpeq_epi16(high, _mm256_set1_epi16(static_cast<short>(0xD800)))) != 0)
+                {
+                    // Narrow the 16-bit lane masks to bytes across both halves so the bits come out in order.
+                    auto kind = _mm256_and_si256(v, _mm256_set1_epi16(static_cast<short>(0xFC00)));
+                    auto highs = _mm256_cmpeq_epi16(kind, _mm256_set1_epi16(static_cast<short>(0xD800)));
+                    auto lows = _mm256_cmpeq_epi16(kind, _mm256_set1_epi16(static_cast<short>(0xDC00)));
+                    auto highMask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_packs_epi16(_mm256_castsi256_si128(highs), _mm256_extracti128_si256(highs, 1))));
+                    auto lowMask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_packs_epi16(_mm256_castsi256_si128(lows), _mm256_extracti128_si256(lows, 1))));
+                    paired += paired_surrogates(input, count, i, 16, highMask, lowMask);
+                }
+                i += 16;
+            }
+
+            saved += static_cast<size_t>(-sum_lanes(savings));
+            return 3 * i - paired - saved + length_tail(input, count, i);
+        }
+
+        UTF_TARGET("avx512f,avx512bw,popcnt") size_t utf8_length_avx512(char16_t const* input, size_t count)
+        {
+            size_t i = 0;
+            size_t length = 0;
+            while (i + 32 <= count)
+            {
+                auto v = _mm512_loadu_si512(input + i);
+                auto nonAscii = _mm512_test_epi16_mask(v, _mm512_set1_epi16(static_cast<short>(0xFF80)));
+                auto large = _mm512_test_epi16_mask(v, _mm512_set1_epi16(static_cast<short>(0xF800)));
+                length += 32 + _mm_popcnt_u32(nonAscii) + _mm_popcnt_u32(large);
+
+                auto kind = _mm512_and_si512(v, _mm512_set1_epi16(static_cast<short>(0xFC00)));
+                auto highs = _mm512_cmpeq_epi16_mask(kind, _mm512_set1_epi16(static_cast<short>(0xD800)));
+                auto lows = _mm512_cmpeq_epi16_mask(kind, _mm512_set1_epi16(static_cast<short>(0xDC00)));
+                if ((highs | lows) != 0)
+                {
+                    length -= paired_surrogates(input, count, i, 32, highs, lows);
+                }
+                i += 32;
+            }
+            return length + length_tail(input, count, i);
+        }
+
+        // UTF-32 adds a fourth byte at 0x10000. Surrogates and values past U+10FFFF encode as three-byte U+FFFD,
+        // so only blocks holding one of those need the scalar count. at_least gives -1 in lanes >= bound.
+        UTF_TARGET("sse4.1") UTF_FORCE_INLINE __m128i at_least(__m128i v, uint32_t bound)
+        {
+            return _mm_cmpeq_epi32(_mm_max_epu32(v, _mm_set1_epi32(static_cast<int>(bound))), v);
+        }
+
+        UTF_TARGET("avx2") UTF_FORCE_INLINE __m256i at_least(__m256i v, uint32_t bound)
+        {
+            return _mm256_cmpeq_epi32(_mm256_max_epu32(v, _mm256_set1_epi32(static_cast<int>(bound))), v);
+        }
+
+        UTF_TARGET("sse4.1") size_t utf8_length_sse41(char32_t const* input, size_t count)
+        {
+            size_t i = 0;
+            size_t length = 0;
+            auto total = _mm_setzero_si128();
+            size_t flush = i + 4 * lane_flush_blocks;
+            while (i + 4 <= count)
+            {
+                if (i == flush)
+                {
+                    length += static_cast<size_t>(sum_lanes(total));
+                    total = _mm_setzero_si128();
+                    flush += 4 * lane_flush_blocks;
+                }
+
+                auto v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(input + i));
+                auto surrogate = _mm_cmpeq_epi32(_mm_and_si128(v, _mm_set1_epi32(static_cast<int>(0xFFFFF800))), _mm_set1_epi32(0xD800));
+                auto invalid = _mm_or_si128(surrogate, at_least(v, 0x110000));
+                if (!_mm_testz_si128(invalid, invalid))
+                {
+                    length += length_scalar(input, i, i + 4);
+                    continue;
+                }
+
+                // Each lane counts 1 plus one per bound it reaches; the compares give -1, so subtract.
+                auto extra = _mm_add_epi32(_mm_add_epi32(at_least(v, 0x80), at_least(v, 0x800)), at_least(v, 0x10000));
+                total = _mm_sub_epi32(_mm_sub_epi32(total, extra), _mm_set1_epi32(-1));
+                i += 4;
+            }
+
+            length += static_cast<size_t>(sum_lanes(total));
+            return length + length_scalar(input, i, count);
+        }
+
+        UTF_TARGET("avx2") size_t utf8_length_avx2(char32_t const* input, size_t count)
+        {
+            size_t i = 0;
+            size_t length = 0;
+            auto total = _mm256_setzero_si256();
+            size_t flush = i + 8 * lane_flush_blocks;
+            while (i + 8 <= count)
+            {
+                if (i == flush)
+                {
+                    length += static_cast<size_t>(sum_lanes(total));
+                    total = _mm256_setzero_si256();
+                    flush += 8 * lane_flush_blocks;
+                }
+
+                auto v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(input + i));
+                auto surrogate = _mm256_cmpeq_epi32(_mm256_and_si256(v, _mm256_set1_epi32(static_cast<int>(0xFFFFF800))), _mm256_set1_epi32(0xD800));
+                auto invalid = _mm256_or_si256(surrogate, at_least(v, 0x110000));
+                if (!_mm256_testz_si256(invalid, invalid))
+                {
+                    length += length_scalar(input, i, i + 8);
+                    continue;
+                }
+
+                auto extra = _mm256_add_epi32(_mm256_add_epi32(at_least(v, 0x80), at_least(v, 0x800)), at_least(v, 0x10000));
+                total = _mm256_sub_epi32(_mm256_sub_epi32(total, extra), _mm256_set1_epi32(-1));
+                i += 8;
+            }
+
+            length += static_cast<size_t>(sum_lanes(total));
+            return length + length_scalar(input, i, count);
+        }
+
+        UTF_TARGET("avx512f,popcnt") size_t utf8_length_avx512(char32_t const* input, size_t count)
+        {
+            size_t i = 0;
+            size_t length = 0;
+            while (i + 16 <= count)
+            {
+                auto v = _mm512_loadu_si512(input + i);
+                auto surrogate = _mm512_cmpeq_epi32_mask(_mm512_and_si512(v, _mm512_set1_epi32(static_cast<int>(0xFFFFF800))), _mm512_set1_epi32(0xD800));
+                if ((surrogate | _mm512_cmpge_epu32_mask(v, _mm512_set1_epi32(0x110000))) != 0)
+                {
+                    length += length_scalar(input, i, i + 16);
+                    continue;
+                }
+
+                length += 16 + _mm_popcnt_u32(_mm512_cmpge_epu32_mask(v, _mm512_set1_epi32(0x80)))
+                    + _mm_popcnt_u32(_mm512_cmpge_epu32_mask(v, _mm512_set1_epi32(0x800)))
+                    + _mm_popcnt_u32(_mm512_cmpge_epu32_mask(v, _mm512_set1_epi32(0x10000)));
+                i += 16;
+            }
+            return length + length_scalar(input, i, count);
+        }
+#endif
+    }
+
+    std::string_view simd_level_name(simd_level level)
+    {
+        switch (level)
+        {
+        case simd_level::sse41: return "sse4.1";
+        case simd_level::avx2: return "avx2";
+        case simd_level::avx512: return "avx512";
+        default: return "scalar";
+        }
+    }
+
+    bool simd_level_supported(simd_level level)
+    {
+#if defined(UTF_X64_KERNELS)
+        switch (level)
+        {
+        case simd_level::sse41: return cpu().sse41;
+        case simd_level::avx2: return cpu().avx2 && cpu().sse41;
+        case simd_level::avx512: return cpu().avx512bw && cpu().avx2 && cpu().sse41;
+        default: return true;
+        }
+#else
+        return level == simd_level::scalar;
+#endif
+    }
+
+    simd_level detected_simd_level()
+    {
+        static simd_level const level = [] {
+            for (auto candidate : { simd_level::avx512, simd_level::avx2, simd_level::sse41 })
+            {
+                if (simd_level_supported(candidate))
+                {
+                    return candidate;
+                }
+            }
+            return simd_level::scalar;
+        }();
+        return level;
+    }
+
+    size_t utf16_to_utf8(char16_t const* input, size_t count, char* output, simd_level level)
+    {
+        switch (level)
+        {
+#if defined(UTF_X64_KERNELS)
+        case simd_level::sse41: return utf16_to_utf8_sse41(input, count, output);
+        case simd_level::avx2: return utf16_to_utf8_avx2(input, count, output);
+        case simd_level::avx512: return utf16_to_utf8_avx512(input, count, output);
+#endif
+        default: return utf16_to_utf8_scalar(input, count, output);
+        }
+    }
+
+    size_t utf16_to_utf8(char16_t const* input, size_t count, char* output)
+    {
+        return utf16_to_utf8(input, count, output, detected_simd_level());
+    }
+
+    size_t utf32_to_utf8(char32_t const* input, size_t count, char* output, simd_level level)
+    {
+        switch (level)
+        {
+#if defined(UTF_X64_KERNELS)
+        case simd_level::sse41: return utf32_to_utf8_sse41(input, count, output);
+        case simd_level::avx2: return utf32_to_utf8_avx2(input, count, output);
+        case simd_level::avx512: return utf32_to_utf8_avx512(input, count, output);
+#endif
+        default: return utf32_to_utf8_scalar(input, count, output);
+        }
+    }
+
+    size_t utf32_to_utf8(char32_t const* input, size_t count, char* output)
+    {
+        return utf32_to_utf8(input, count, output, detected_simd_level());
+    }
+
+    size_t utf8_length(char16_t const* input, size_t count, simd_level level)
+    {
+        switch (level)
+        {
+#if defined(UTF_X64_KERNELS)
+        case simd_level::sse41: return utf8_length_sse41(input, count);
+        case simd_level::avx2: return utf8_length_avx2(input, count);
+        case simd_level::avx512: return utf8_length_avx512(input, count);
+#endif
+        default: return utf8_length_scalar(input, count);
+        }
+    }
+
+    size_t utf8_length(char16_t const* input, size_t count)
+    {
+        return utf8_length(input, count, detected_simd_level());
+    }
+
+    size_t utf8_length(char32_t const* input, size_t count, simd_level level)
+    {
+        switch (level)
+        {
+#if defined(UTF_X64_KERNELS)
+        case simd_level::sse41: return utf8_length_sse41(input, count);
+        case simd_level::avx2: return utf8_length_avx2(input, count);
+        case simd_level::avx512: return utf8_length_avx512(input, count);
+#endif
+        default: return utf8_length_scalar(input, count);
+        }
+    }
+
+    size_t utf8_length(char32_t const* input, size_t count)
+    {
+        return utf8_length(input, count, detected_simd_level());
+    }
+}
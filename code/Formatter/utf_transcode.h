@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+/*
+    UTF-16 and UTF-32 to UTF-8 transcoding, vectorized in the style of simdutf. This is the Formatter's built-in
+    codec: it needs nothing beyond the compiler, so it is always available where ICU and codecvt may not be.
+
+    The common case in logs is ASCII, so every kernel first checks a whole block for code units below 0x80 and,
+    when they all are, narrows the block straight to bytes: 16 units per iteration with SSE4.1, 32 with AVX2 and
+    64 with AVX-512BW. A block of 8 units below 0x800 (Latin, Greek, Cyrillic, Hebrew, Arabic...) is encoded as
+    one or two bytes per unit in registers and compacted with a shuffle looked up from the ASCII mask. Anything
+    else (three-byte characters and surrogate pairs) goes through the scalar encoder a block at a time. UTF-32
+    input gets the same ASCII blocks; other blocks are encoded a unit at a time.
+
+    The kernel is chosen once, at first use, from what the CPU supports; utf16_to_utf8 with an explicit level
+    is for benchmarks and tests. Unpaired surrogates, and UTF-32 values that are not scalar values, are encoded as
+    U+FFFD. Kernels other than the scalar one exist only on x64.
+*/
+namespace utf
+{
+    enum class simd_level
+    {
+        scalar,
+        sse41,
+        avx2,
+        avx512,
+    };
+
+    std::string_view simd_level_name(simd_level level);
+
+    // The best level this CPU runs, and whether it can run a given one.
+    simd_level detected_simd_level();
+    bool simd_level_supported(simd_level level);
+
+    // The most bytes utf16_to_utf8 writes for count code units.
+    constexpr size_t utf8_capacity_for_utf16(size_t count)
+    {
+        return count * 3;
+    }
+
+    // Transcodes count units into output and returns the number of bytes written. The kernels never store past
+    // the last byte they produce, so output needs only utf8_length(input, count) bytes; utf8_capacity_for_utf16
+    // bounds that without a pass over the input.
+    size_t utf16_to_utf8(char16_t const* input, size_t count, char* output);
+    size_t utf16_to_utf8(char16_t const* input, size_t count, char* output, simd_level level);
+
+    constexpr size_t utf8_capacity_for_utf32(size_t count)
+    {
+        return count * 4;
+    }
+
+    size_t utf32_to_utf8(char32_t const* input, size_t count, char* output);
+    size_t utf32_to_utf8(char32_t const* input, size_t count, char* output, simd_level level);
+
+    // The exact number of bytes the transcoders write for the input, counted without writing them.
+    size_t utf8_length(char16_t const* input, size_t count);
+    size_t utf8_length(char16_t const* input, size_t count, simd_level level);
+    size_t utf8_length(char32_t const* input, size_t count);
+    size_t utf8_length(char32_t const* input, size_t count, simd_level level);
+}
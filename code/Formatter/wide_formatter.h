@@ -0,0 +1,225 @@
+#pragma once
+
+#include <format>
+#include <locale>
+#include <array>
+#include <type_traits>
+
+#if defined(FORMATTER_HAS_ICU)
+#if defined(_WIN32)
+#include <icu.h>
+#else
+#include <unicode/utf8.h>
+#include <unicode/utf16.h>
+#endif
+#endif
+
+#include "utf8_output.h"
+
+/*
+    std::format support for wide strings - char16_t, char32_t and wchar_t - into a narrow (UTF-8) output.
+
+    The format spec picks the conversion backend:
+        {}      the default: the built-in codec, which behaves the same everywhere
+        {:c}    std::codecvt; for wchar_t this is the locale's facet, as the standard library would use, which
+                in libstdc++'s "C" locale rejects anything outside ASCII
+        {:u}    ICU's U16_NEXT / U8_APPEND, a code point at a time
+        {:v}    the built-in codec, utf::utf16_to_utf8 / utf32_to_utf8, vectorized for the CPU it runs on
+
+    {:v} measures the string first when the output iterator lets it write in place (a pointer, or a
+    back_insert_iterator over a string or vector), so the destination grows once. The standard library's own
+    format contexts hide the destination behind a type-erased iterator, so std::format output gets the chunked
+    path; utf::to_utf8, append_utf8 and format_to_n in utf8_output.h give the single-allocation path directly.
+
+    ICU and codecvt are optional (FORMATTER_HAS_ICU, FORMATTER_HAS_CODECVT); asking for one that is not built in
+    is a format error. {:v} and {:u} write unpaired surrogates and values past U+10FFFF as U+FFFD; {:c} throws on
+    them, as it does on anything its facet cannot convert. wchar_t is treated as UTF-16 where it is two bytes
+    (Windows) and UTF-32 where it is four.
+*/
+namespace utf
+{
+    enum class backend
+    {
+        codecvt,
+        icu,
+        builtin,
+    };
+
+    constexpr bool backend_available(backend b)
+    {
+        switch (b)
+        {
+#if defined(FORMATTER_HAS_CODECVT)
+        case backend::codecvt: return true;
+#endif
+#if defined(FORMATTER_HAS_ICU)
+        case backend::icu: return true;
+#endif
+        case backend::builtin: return true;
+        default: return false;
+        }
+    }
+
+    constexpr backend default_backend = backend::builtin;
+}
+
+template<utf::wide_char TChar, typename TTraits> struct std::formatter<std::basic_string_view<TChar, TTraits>, char>
+{
+    using view_type = std::basic_string_view<TChar, TTraits>;
+    using unit_type = utf::unit_t<TChar>;
+
+    // codecvt<wchar_t, char> is the locale's narrow encoding; the char8_t facets are always UTF-8.
+    using facet_type = std::conditional_t<std::is_same_v<TChar, wchar_t>,
+        std::codecvt<wchar_t, char, std::mbstate_t>,
+        std::codecvt<TChar, char8_t, std::mbstate_t>>;
+
+    struct convert_t : facet_type
+    {
+        template<typename... Args> convert_t(Args&&... args) : facet_type(std::forward<Args>(args)...) {}
+    };
+
+    template<typename ParseContext>
+    constexpr auto parse(ParseContext& ctx)
+    {
+        auto it = ctx.begin();
+        while (it != ctx.end() && *it != '}')
+        {
+            if (*it == 'c')
+            {
+                method = utf::backend::codecvt;
+            }
+            else if (*it == 'u')
+            {
+                method = utf::backend::icu;
+            }
+            else if (*it == 'v')
+            {
+                method = utf::backend::builtin;
+            }
+            ++it;
+        }
+
+        if (!utf::backend_available(method))
+        {
+            throw std::format_error("conversion backend not built in");
+        }
+        return it;
+    }
+
+    template<class OutputContext>
+    auto format(view_type s, OutputContext& ctx) const
+    {
+        switch (method)
+        {
+#if defined(FORMATTER_HAS_ICU)
+        case utf::backend::icu:
+            return format_icu(s, ctx);
+#endif
+#if defined(FORMATTER_HAS_CODECVT)
+        case utf::backend::codecvt:
+            return format_ccvt(s, ctx);
+#endif
+        default:
+            return format_builtin(s, ctx);
+        }
+    }
+
+#if defined(FORMATTER_HAS_ICU)
+    template<class OutputContext>
+    auto format_icu(view_type input, OutputContext& ctx) const
+    {
+        using icu_unit = std::conditional_t<sizeof(unit_type) == 2, UChar, UChar32>;
+
+        auto outIter = ctx.out();
+        const icu_unit* inputPtr = reinterpret_cast<const icu_unit*>(input.data());
+        auto inputLength = static_cast<int32_t>(input.size());
+        int32_t inputRead = 0;
+        const size_t minCapacity = 4;
+        std::array<uint8_t, 256 + minCapacity> utf8Data;
+        size_t utf8WriteIndex = 0;
+
+        // U8_APPEND's capacity is the buffer length, checked against the write index, not the space left.
+        const auto capacity = static_cast<int32_t>(utf8Data.size());
+        while (inputRead < inputLength)
+        {
+            if (utf8Data.size() - utf8WriteIndex < minCapacity)
+            {
+                outIter = std::copy_n(utf8Data.begin(), utf8WriteIndex, outIter);
+                utf8WriteIndex = 0;
+            }
+
+            UChar32 c;
+            bool encodeError = false;
+            if constexpr (sizeof(unit_type) == 2)
+            {
+                U16_NEXT(inputPtr, inputRead, inputLength, c);
+            }
+            else
+            {
+                c = inputPtr[inputRead++];
+            }
+
+            // U8_APPEND skips what it cannot encode; write U+FFFD for it, as the other backends do.
+            if (((c & 0xFFFFF800) == 0xD800) || (static_cast<uint32_t>(c) > 0x10FFFF))
+            {
+                c = 0xFFFD;
+            }
+            U8_APPEND(utf8Data.data(), utf8WriteIndex, capacity, c, encodeError);
+        }
+
+        if (utf8WriteIndex != 0)
+        {
+            outIter = std::copy_n(utf8Data.begin(), utf8WriteIndex, outIter);
+        }
+
+        return outIter;
+    }
+#endif
+
+    template<class OutputContext>
+    auto format_builtin(view_type input, OutputContext& ctx) const
+    {
+        return utf::put_utf8(input, ctx.out());
+    }
+
+#if defined(FORMATTER_HAS_CODECVT)
+    template<class OutputContext>
+    auto format_ccvt(view_type s, OutputContext& ctx) const
+    {
+        using extern_type = typename facet_type::extern_type;
+
+        static convert_t instance;
+        auto state = std::mbstate_t{};
+        TChar const* srcNext = s.data();
+        TChar const* srcEnd = s.data() + s.size();
+        auto ctxOutIt = ctx.out();
+        while (srcNext < srcEnd)
+        {
+            extern_type tempBuffer[256];
+            extern_type* destBegin = tempBuffer;
+            extern_type* destEnd = tempBuffer + std::size(tempBuffer);
+            extern_type* destNext = destBegin;
+            auto srcStart = srcNext;
+            auto result = instance.out(state, srcNext, srcEnd, srcNext, destBegin, destEnd, destNext);
+
+            // A facet left holding an incomplete character (an unpaired high surrogate at the end) reports
+            // partial or ok without consuming anything; calling it again would never finish.
+            if ((result == convert_t::error) || ((srcNext == srcStart) && (destNext == destBegin)))
+            {
+                throw std::runtime_error("Conversion error");
+            }
+
+            ctxOutIt = std::copy(destBegin, destNext, ctxOutIt);
+        }
+
+        return ctxOutIt;
+    }
+#endif
+
+    utf::backend method = utf::default_backend;
+};
+
+template<utf::wide_char TChar, std::size_t N> struct std::formatter<TChar[N], char> : std::formatter<std::basic_string_view<TChar>, char> {};
+template<utf::wide_char TChar> struct std::formatter<TChar const*, char> : std::formatter<std::basic_string_view<TChar>, char> {};
+template<utf::wide_char TChar> struct std::formatter<TChar*, char> : std::formatter<std::basic_string_view<TChar>, char> {};
+template<utf::wide_char TChar, typename traits, typename allocator> struct std::formatter<std::basic_string<TChar, traits, allocator>, char> : std::formatter<std::basic_string_view<TChar>, char> {};
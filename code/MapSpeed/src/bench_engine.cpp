@@ -0,0 +1,35 @@
+#include "bench_engine.h"
+
+namespace map_speed
+{
+    std::vector<run_result> run_benchmarks(bench_options const& options)
+    {
+        if (options.seeded)
+        {
+            seedRandom(options.seed);
+        }
+
+        std::vector<run_result> results;
+        auto append = [&](std::vector<run_result>&& more) {
+            results.insert(results.end(), std::make_move_iterator(more.begin()), std::make_move_iterator(more.end()));
+        };
+
+        if (options.wants_key_type("string"))
+        {
+            for (auto const& spec : options.sizes)
+            {
+                append(generateMaps<std::string>(options, spec));
+            }
+        }
+
+        if (options.wants_key_type("uint32"))
+        {
+            for (auto const& spec : options.sizes)
+            {
+                append(generateMaps<uint32_t>(options, spec));
+            }
+        }
+
+        return results;
+    }
+}
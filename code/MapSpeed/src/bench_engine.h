@@ -0,0 +1,454 @@
+#pragma once
+
+#include "bench_options.h"
+#include "bench_report.h"
+#include "concurrent_hash_map.h"
+#include "containers.h"
+#include "mapped_table.h"
+#include "content.h"
+#include "measurement.h"
+#include "memory_accounting.h"
+#include "thread_scaling.h"
+#include "workload.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace map_speed
+{
+    template<typename T> constexpr std::string_view key_type_name();
+    template<> constexpr std::string_view key_type_name<std::string>() { return "string"; }
+    template<> constexpr std::string_view key_type_name<uint32_t>() { return "uint32"; }
+
+    inline constexpr std::string_view mapped_suffix = "mapped";
+
+    struct lookup_totals
+    {
+        uint64_t sum = 0;
+        uint64_t missed = 0;
+
+        lookup_totals& operator+=(lookup_totals const& other)
+        {
+            sum += other.sum;
+            missed += other.missed;
+            return *this;
+        }
+    };
+
+    // Searches for every key in searchContent, cycleCount times. The sum of the found values is kept so the
+    // optimizer cannot discard the lookups.
+    template<typename TContainer, typename T> lookup_totals run_lookups(TContainer const& container, std::span<const T> searchContent, uint64_t cycleCount)
+    {
+        lookup_totals totals;
+        for (uint64_t i = 0; i < cycleCount; i++)
+        {
+            for (auto const& j : searchContent)
+            {
+                if (auto found = container.find(j))
+                {
+                    totals.sum += *found;
+                }
+                else
+                {
+                    totals.missed++;
+                }
+            }
+        }
+        return totals;
+    }
+
+    // As run_lookups, but hands the container batchSize keys at a time through find_batch.
+    template<typename TContainer, typename T> lookup_totals run_batch_lookups(TContainer const& container, std::span<const T> searchContent, uint64_t cycleCount, size_t batchSize)
+    {
+        lookup_totals totals;
+        std::vector<size_t const*> found(batchSize);
+        for (uint64_t i = 0; i < cycleCount; i++)
+        {
+            for (size_t base = 0; base < searchContent.size(); base += batchSize)
+            {
+                auto count = std::min(batchSize, searchContent.size() - base);
+                container.find_batch(searchContent.subspan(base, count), std::span<size_t const*>(found.data(), count));
+                for (size_t j = 0; j < count; j++)
+                {
+                    if (found[j])
+                    {
+                        totals.sum += *found[j];
+                    }
+                    else
+                    {
+                        totals.missed++;
+                    }
+                }
+            }
+        }
+        return totals;
+    }
+
+    // One thread's share of a read/write mix: walks searchContent cycleCount times, and every operation whose
+    // running index falls in the first writePercent of each hundred is a write instead of a read. Writes alternate
+    // between insert_or_assign and erase so the map stays roughly the size it was built at.
+    template<typename TMap, typename T> lookup_totals run_mixed(TMap& map, std::span<const T> searchContent, uint64_t cycleCount, uint32_t writePercent)
+    {
+        lookup_totals totals;
+        uint64_t operation = 0;
+        uint64_t writes = 0;
+        size_t value = 0;
+        for (uint64_t i = 0; i < cycleCount; i++)
+        {
+            for (auto const& j : searchContent)
+            {
+                if ((operation++ % 100) < writePercent)
+                {
+                    if (writes++ % 2 == 0)
+                    {
+                        map.insert_or_assign(j, static_cast<size_t>(operation));
+                    }
+                    else
+                    {
+                        map.erase(j);
+                    }
+                }
+                else if (map.find(j, value))
+                {
+                    totals.sum += value;
+                }
+                else
+                {
+                    totals.missed++;
+                }
+            }
+        }
+        return totals;
+    }
+
+    // Runs every --mix on every requested concurrent map at each thread count (one thread if --threads was not
+    // given). Every repetition starts from a freshly built map, since the previous one was changed by its writes.
+    // point carries the size point's description shared by every row.
+    template<typename T> void generateMixed(bench_options const& options, run_result const& point, std::span<const T> collectionContent,
+        std::vector<std::vector<T>> const& threadContent, std::vector<run_result>& results)
+    {
+        auto threadCounts = options.threadCounts.empty() ? std::vector<uint32_t>{ 1 } : options.threadCounts;
+        auto searchCount = threadContent.front().size();
+
+        auto runOne = [&]<typename TMap>() {
+            if (!options.wants_container(TMap::name))
+            {
+                return;
+            }
+
+            for (auto writePercent : options.writePercents)
+            {
+                for (auto threadCount : threadCounts)
+                {
+                    run_result mixed = point;
+                    std::vector<double> threadSeconds;
+                    auto totals = measure(options.measure, mixed.timing, [&] {
+                        TMap map(collectionContent.size());
+                        for (size_t i = 0; i < collectionContent.size(); i++)
+                        {
+                            map.insert_or_assign(collectionContent[i], i);
+                        }
+
+                        auto run = run_threaded<lookup_totals>(threadCount, [&](uint32_t t) {
+                            return run_mixed(map, std::span<const T>(threadContent[t]), point.cycleCount, writePercent);
+                        });
+                        threadSeconds = std::move(run.threadSeconds);
+                        return self_timed<lookup_totals>{ run.combined, run.wallSeconds };
+                    });
+
+                    mixed.timing.backend = counter_backend::none;
+                    mixed.timing.counters.clear();
+                    mixed.container = TMap::name;
+                    mixed.operations = point.cycleCount * searchCount * threadCount;
+                    mixed.missed = totals.missed;
+                    mixed.sum = totals.sum;
+                    mixed.threads = threadCount;
+                    mixed.writePercent = writePercent;
+                    mixed.threadSeconds = std::move(threadSeconds);
+                    results.push_back(std::move(mixed));
+                }
+            }
+        };
+
+        [&]<size_t... I>(std::index_sequence<I...>) {
+            (runOne.template operator()<std::tuple_element_t<I, mixed_map_list<T>>>(), ...);
+        }(std::make_index_sequence<std::tuple_size_v<mixed_map_list<T>>>{});
+        epoch_domain::global().try_reclaim();
+    }
+
+    // Time to first lookup for a process starting from nothing: rebuilding sorted_vector or perfect_hash from the
+    // content, against mapping the same table saved earlier (mapped_table.h). Before each mapped repetition the
+    // file's cached pages are dropped where the OS allows, so the lookup also pays for reading in what it
+    // touches. Each row's sum and missed come from full passes over its last table, as a check on it.
+    template<typename T> void generateColdStart(bench_options const& options, run_result const& point, std::span<const T> collectionContent,
+        std::span<const T> searchContent, std::vector<run_result>& results)
+    {
+        if (searchContent.empty())
+        {
+            return;
+        }
+
+        auto const& firstKey = searchContent.front();
+        std::vector<std::pair<T, uint64_t>> items;
+        for (size_t i = 0; i < collectionContent.size(); i++)
+        {
+            items.push_back({ collectionContent[i], i });
+        }
+
+        auto first_lookup = [&](auto const& table) {
+            auto found = table.find(firstKey);
+            return found ? lookup_totals{ *found, 0 } : lookup_totals{ 0, 1 };
+        };
+
+        auto runOne = [&]<typename TContender, typename TMapped>(auto const& write) {
+            if (!options.wants_container(TContender::name))
+            {
+                return;
+            }
+
+            auto finish = [&](run_result& r, std::string_view name, auto const& table, int64_t bytes) {
+                auto totals = run_lookups(table, searchContent, point.cycleCount);
+                r.container = name;
+                r.coldStart = true;
+                r.operations = 1;
+                r.missed = totals.missed;
+                r.sum = totals.sum;
+                r.heapBytes = bytes;
+                results.push_back(std::move(r));
+            };
+
+            std::optional<TContender> built;
+            run_result rebuilt = point;
+            measure(options.measure, rebuilt.timing, [&] {
+                built.reset();
+                timer coldTimer;
+                built.emplace();
+                built->build(collectionContent);
+                auto totals = first_lookup(*built);
+                coldTimer.stop();
+                return self_timed<lookup_totals>{ totals, coldTimer.duration() };
+            });
+            finish(rebuilt, TContender::name, *built, 0);
+            built.reset();
+
+            auto path = std::filesystem::temp_directory_path() /
+                ("map-speeds-" + std::to_string(g_random()) + "-" + std::string(point.keyType) + "-" + std::string(TContender::name) + ".tbl");
+            write(path);
+
+            std::optional<TMapped> mapped;
+            run_result fromFile = point;
+            measure(options.measure, fromFile.timing, [&] {
+                mapped.reset();
+                evict_file_cache(path);
+                timer coldTimer;
+                mapped.emplace(path);
+                auto totals = first_lookup(*mapped);
+                coldTimer.stop();
+                return self_timed<lookup_totals>{ totals, coldTimer.duration() };
+            });
+            finish(fromFile, joined_name<TContender::name, mapped_suffix>::value, *mapped, static_cast<int64_t>(mapped->file_bytes()));
+            mapped.reset();
+
+            std::error_code ignored;
+            std::filesystem::remove(path, ignored);
+        };
+
+        runOne.template operator()<sorted_vector_contender<T>, mapped_sorted_table<T>>([&](std::filesystem::path const& path) {
+            write_sorted_table<T>(path, items);
+        });
+        runOne.template operator()<perfect_hash_contender<T, table_hash<T>>, mapped_perfect_hash_table<T>>([&](std::filesystem::path const& path) {
+            write_perfect_hash_table<T>(path, perfect_hash_map<T, uint64_t, table_hash<T>>(items));
+        });
+    }
+
+    // Kernel variants run only when their kernel was asked for, bulk-load variants only with --bulk-load,
+    // huge-page variants only with --huge-pages, and then whenever their base contender is wanted.
+    template<typename TContender> bool wants_contender(bench_options const& options)
+    {
+        if constexpr (requires { TContender::kernel; })
+        {
+            return options.wants_kernel(TContender::kernel) &&
+                (options.wants_container(TContender::base_name) || options.wants_container(TContender::name));
+        }
+        else if constexpr (requires { TContender::bulk; })
+        {
+            return options.bulkLoad && (options.wants_container(TContender::base_name) || options.wants_container(TContender::name));
+        }
+        else if constexpr (requires { TContender::huge_pages; })
+        {
+            return options.hugePages && (options.wants_container(TContender::base_name) || options.wants_container(TContender::name));
+        }
+        else
+        {
+            return options.wants_container(TContender::name);
+        }
+    }
+
+    template<typename T> key_distribution key_distribution_for(bench_options const& options)
+    {
+        return std::is_same_v<T, std::string> ? options.stringKeys : options.uint32Keys;
+    }
+
+    // Given a size point, generates unique content from the requested key distribution, builds each requested
+    // contender from the first possibleSpace items, then measures searching the whole key set (including the
+    // unFoundCount items that were never inserted) in the requested access pattern. A trace replaces both: its
+    // distinct keys are the content and the trace itself is the search stream.
+    template<typename T> std::vector<run_result> generateMaps(bench_options const& options, size_spec const& spec)
+    {
+        auto const& access = options.access;
+        std::vector<T> allContent;
+        std::vector<T> trace;
+        if (access.kind == access_kind::trace)
+        {
+            trace = read_trace<T>(access.tracePath);
+            allContent = distinct_keys(trace);
+        }
+        else
+        {
+            allContent = generateContent<T>(key_distribution_for<T>(options), spec.possibleSpace + spec.unFoundCount);
+        }
+
+        // Split into possible & unfound chunks.
+        auto possibleSpace = std::min<size_t>(spec.possibleSpace, allContent.size());
+        auto collectionContent = std::vector(allContent.begin(), allContent.begin() + possibleSpace);
+
+        // Then lay out the searches: a fresh stream in the access pattern, or the trace as recorded.
+        auto nextStream = [&] { return (access.kind == access_kind::trace) ? trace : make_access_stream(access, allContent); };
+        auto searchContent = nextStream();
+
+        // Threaded runs give every thread its own independently drawn stream; a trace is replayed by each.
+        std::vector<std::vector<T>> threadContent;
+        if (!options.threadCounts.empty() || !options.writePercents.empty())
+        {
+            auto maxThreads = options.threadCounts.empty() ? 1u : *std::max_element(options.threadCounts.begin(), options.threadCounts.end());
+            for (uint32_t t = 0; t < maxThreads; t++)
+            {
+                threadContent.push_back(nextStream());
+            }
+        }
+
+        run_result point;
+        point.keyType = key_type_name<T>();
+        point.keyDistribution = (access.kind == access_kind::trace) ? "trace" : key_distribution_name(key_distribution_for<T>(options));
+        point.accessPattern = access_pattern_name(access);
+        point.possibleSpace = collectionContent.size();
+        point.unFoundCount = allContent.size() - collectionContent.size();
+        point.cycleCount = spec.cycleCount;
+
+        std::vector<run_result> results;
+        for_each_contender<T>([&]<typename TContender>() {
+            if (!wants_contender<TContender>(options))
+            {
+                return;
+            }
+
+            // Extra builds are timed and thrown away; the last one is the container that gets measured.
+            std::vector<double> buildSeconds;
+            for (uint32_t i = 1; i < options.buildRepetitions; i++)
+            {
+                TContender discarded;
+                timer buildTimer;
+                discarded.build(collectionContent);
+                buildTimer.stop();
+                buildSeconds.push_back(buildTimer.duration());
+            }
+
+            TContender contender;
+            allocation_stats memory;
+            auto mappedBefore = huge_page_totals();
+            timer buildTimer;
+            {
+                allocation_scope scope;
+                contender.build(collectionContent);
+                memory = scope.stats();
+            }
+            buildTimer.stop();
+            auto pageBacking = page_backing_name(mappedBefore, huge_page_totals());
+            buildSeconds.push_back(buildTimer.duration());
+            auto peakRss = peak_rss_bytes();
+
+            auto describe = [&](run_result& r, lookup_totals const& totals) {
+                r.container = TContender::name;
+                r.operations = spec.cycleCount * searchContent.size();
+                r.missed = totals.missed;
+                r.sum = totals.sum;
+                r.heapBytes = memory.liveBytes + static_cast<int64_t>(sizeof(TContender));
+                r.heapAllocations = memory.allocations;
+                r.buildPeakBytes = memory.peakBytes;
+                r.peakRss = peakRss;
+                r.buildSeconds = percentile(buildSeconds, 0.5);
+                r.buildSecondsMin = *std::min_element(buildSeconds.begin(), buildSeconds.end());
+                if constexpr (requires { TContender::huge_pages; })
+                {
+                    r.pageBacking = pageBacking;
+                }
+            };
+
+            run_result scalar = point;
+            auto totals = measure(options.measure, scalar.timing, [&] {
+                return run_lookups(contender, std::span<const T>(searchContent), spec.cycleCount);
+            });
+            describe(scalar, totals);
+            auto scalarSeconds = scalar.timing.median_seconds();
+            results.push_back(std::move(scalar));
+
+            if constexpr (batch_contender<TContender, T>)
+            {
+                if (options.batchSize > 0)
+                {
+                    run_result batched = point;
+                    auto batchTotals = measure(options.measure, batched.timing, [&] {
+                        return run_batch_lookups(contender, std::span<const T>(searchContent), spec.cycleCount, options.batchSize);
+                    });
+                    describe(batched, batchTotals);
+                    batched.batchSize = options.batchSize;
+                    batched.speedup = scalarSeconds / batched.timing.median_seconds();
+                    results.push_back(std::move(batched));
+                }
+            }
+
+            // Read scaling: the one built container is shared by every thread, each searching its own stream.
+            for (auto threadCount : options.threadCounts)
+            {
+                run_result threaded = point;
+                std::vector<double> threadSeconds;
+                auto threadTotals = measure(options.measure, threaded.timing, [&] {
+                    auto run = run_threaded<lookup_totals>(threadCount, [&](uint32_t t) {
+                        return run_lookups(contender, std::span<const T>(threadContent[t]), spec.cycleCount);
+                    });
+                    threadSeconds = std::move(run.threadSeconds);
+                    return self_timed<lookup_totals>{ run.combined, run.wallSeconds };
+                });
+
+                // Hardware counters only see the launching thread, so they say nothing about the workers.
+                threaded.timing.backend = counter_backend::none;
+                threaded.timing.counters.clear();
+                describe(threaded, threadTotals);
+                threaded.threads = threadCount;
+                threaded.operations *= threadCount;
+                threaded.threadSeconds = std::move(threadSeconds);
+                results.push_back(std::move(threaded));
+            }
+        });
+
+        if (!options.writePercents.empty())
+        {
+            generateMixed<T>(options, point, collectionContent, threadContent, results);
+        }
+
+        if (options.coldStart)
+        {
+            generateColdStart<T>(options, point, collectionContent, searchContent, results);
+        }
+
+        return results;
+    }
+
+    // Runs every requested key type at every requested size point.
+    std::vector<run_result> run_benchmarks(bench_options const& options);
+}
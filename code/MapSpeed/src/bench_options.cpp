@@ -0,0 +1,409 @@
+#include "bench_options.h"
+#include "concurrent_hash_map.h"
+#include "string_kernels.h"
+#include "containers.h"
+#include "thread_scaling.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+
+namespace map_speed
+{
+    namespace
+    {
+        std::vector<std::string> split(std::string_view value, char separator)
+        {
+            std::vector<std::string> parts;
+            while (!value.empty())
+            {
+                auto next = value.find(separator);
+                parts.emplace_back(value.substr(0, next));
+                value = (next == std::string_view::npos) ? std::string_view{} : value.substr(next + 1);
+            }
+            return parts;
+        }
+
+        template<typename T> T parse_number(std::string_view option, std::string_view value)
+        {
+            T result{};
+            auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+            if ((ec != std::errc{}) || (ptr != value.data() + value.size()))
+            {
+                throw std::invalid_argument(std::string(option) + ": not a number: " + std::string(value));
+            }
+            return result;
+        }
+
+        double parse_ratio(std::string_view option, std::string_view value)
+        {
+            double result = std::stod(std::string(value));
+            if (!(result >= 0.0) || !(result < 1.0))
+            {
+                throw std::invalid_argument(std::string(option) + ": must be in [0, 1): " + std::string(value));
+            }
+            return result;
+        }
+
+        // A size is either "N" (miss count and cycles come from --miss-ratio and --cycles) or "N:misses:cycles".
+        size_spec parse_size(bench_options const& options, std::string_view value)
+        {
+            auto parts = split(value, ':');
+            if (parts.size() == 1)
+            {
+                auto possibleSpace = parse_number<uint64_t>("--sizes", parts[0]);
+                auto unFound = static_cast<uint64_t>(std::llround(possibleSpace * options.missRatio / (1.0 - options.missRatio)));
+                return { possibleSpace, unFound, options.cycleCount };
+            }
+            else if (parts.size() == 3)
+            {
+                return {
+                    parse_number<uint64_t>("--sizes", parts[0]),
+                    parse_number<uint64_t>("--sizes", parts[1]),
+                    parse_number<uint64_t>("--sizes", parts[2]) };
+            }
+
+            throw std::invalid_argument("--sizes: expected N or N:misses:cycles, got " + std::string(value));
+        }
+
+        // A mix is "reads/writes" in percent, e.g. "99/1"; the two must add up to 100. Returns the write percentage.
+        uint32_t parse_mix(std::string_view value)
+        {
+            auto parts = split(value, '/');
+            if (parts.size() == 2)
+            {
+                auto reads = parse_number<uint32_t>("--mix", parts[0]);
+                auto writes = parse_number<uint32_t>("--mix", parts[1]);
+                if (reads + writes == 100)
+                {
+                    return writes;
+                }
+            }
+
+            throw std::invalid_argument("--mix: expected reads/writes adding up to 100, got " + std::string(value));
+        }
+
+        key_distribution parse_distribution(std::string_view option, std::string_view value, bool stringKeys)
+        {
+            if (value == "random") return key_distribution::random;
+            if (value == "sequential") return key_distribution::sequential;
+            if (stringKeys && (value == "paths")) return key_distribution::paths;
+            if (stringKeys && (value == "guids")) return key_distribution::guids;
+            throw std::invalid_argument(std::string(option) + (stringKeys ? ": expected random, paths, guids or sequential" : ": expected random or sequential"));
+        }
+
+        // uniform, zipf[:S], hot[:F:P], sorted or trace:PATH.
+        access_pattern parse_access(std::string_view value)
+        {
+            access_pattern pattern;
+            if (value.starts_with("trace:") && (value.size() > 6))
+            {
+                pattern.kind = access_kind::trace;
+                pattern.tracePath = value.substr(6);
+                return pattern;
+            }
+
+            auto parts = split(value, ':');
+            if (parts.empty())
+            {
+                throw std::invalid_argument("--access: missing pattern");
+            }
+
+            if ((parts[0] == "uniform") && (parts.size() == 1))
+            {
+                return pattern;
+            }
+            if ((parts[0] == "sorted") && (parts.size() == 1))
+            {
+                pattern.kind = access_kind::sorted;
+                return pattern;
+            }
+            if ((parts[0] == "zipf") && (parts.size() <= 2))
+            {
+                pattern.kind = access_kind::zipf;
+                if (parts.size() == 2)
+                {
+                    pattern.zipfExponent = std::stod(parts[1]);
+                    if (!(pattern.zipfExponent > 0.0))
+                    {
+                        throw std::invalid_argument("--access: the zipf exponent must be positive");
+                    }
+                }
+                return pattern;
+            }
+            if ((parts[0] == "hot") && ((parts.size() == 1) || (parts.size() == 3)))
+            {
+                pattern.kind = access_kind::hot_set;
+                if (parts.size() == 3)
+                {
+                    pattern.hotFraction = std::stod(parts[1]);
+                    pattern.hotProbability = std::stod(parts[2]);
+                    if (!(pattern.hotFraction > 0.0) || !(pattern.hotFraction <= 1.0) || !(pattern.hotProbability >= 0.0) || !(pattern.hotProbability <= 1.0))
+                    {
+                        throw std::invalid_argument("--access: hot fractions must be in (0, 1] and [0, 1]");
+                    }
+                }
+                return pattern;
+            }
+
+            throw std::invalid_argument("--access: expected uniform, zipf[:S], hot[:F:P], sorted or trace:PATH, got " + std::string(value));
+        }
+
+        std::vector<size_spec> legacy_sizes()
+        {
+            return { { 5, 2, 15 }, { 50, 5, 8 }, { 500, 50, 3 }, { 5000, 500, 3 }, { 500000, 1000, 3 } };
+        }
+    }
+
+    bool bench_options::wants_container(std::string_view name) const
+    {
+        return containers.empty() || (std::find(containers.begin(), containers.end(), name) != containers.end());
+    }
+
+    bool bench_options::wants_key_type(std::string_view name) const
+    {
+        return std::find(keyTypes.begin(), keyTypes.end(), name) != keyTypes.end();
+    }
+
+    bool bench_options::wants_kernel(std::string_view name) const
+    {
+        return std::find(kernels.begin(), kernels.end(), name) != kernels.end();
+    }
+
+    bench_options parse_options(int argc, char const* const* argv)
+    {
+        bench_options options;
+        std::vector<std::string> rawSizes;
+
+        if (argc <= 1)
+        {
+            options.sizes = legacy_sizes();
+            options.compileTime = true;
+            return options;
+        }
+
+        for (int i = 1; i < argc; i++)
+        {
+            std::string_view arg = argv[i];
+            auto next = [&]() -> std::string_view {
+                if (i + 1 >= argc)
+                {
+                    throw std::invalid_argument(std::string(arg) + ": missing value");
+                }
+                return argv[++i];
+            };
+
+            if ((arg == "--help") || (arg == "-h") || (arg == "/?"))
+            {
+                options.help = true;
+            }
+            else if (arg == "--keys")
+            {
+                options.keyTypes = split(next(), ',');
+                for (auto const& k : options.keyTypes)
+                {
+                    if ((k != "string") && (k != "uint32"))
+                    {
+                        throw std::invalid_argument("--keys: unknown key type " + k);
+                    }
+                }
+            }
+            else if (arg == "--containers")
+            {
+                options.containers = split(next(), ',');
+                auto known = contender_names();
+                known.insert(known.end(), std::begin(mixed_map_names), std::end(mixed_map_names));
+                for (auto const& c : options.containers)
+                {
+                    if (std::find(known.begin(), known.end(), c) == known.end())
+                    {
+                        throw std::invalid_argument("--containers: unknown container " + c);
+                    }
+                }
+            }
+            else if (arg == "--sizes")
+            {
+                rawSizes = split(next(), ',');
+            }
+            else if (arg == "--miss-ratio")
+            {
+                options.missRatio = parse_ratio(arg, next());
+            }
+            else if (arg == "--cycles")
+            {
+                options.cycleCount = parse_number<uint64_t>(arg, next());
+            }
+            else if (arg == "--threads")
+            {
+                auto counts = split(next(), ',');
+                options.threadCounts.clear();
+                for (auto const& c : counts)
+                {
+                    auto count = parse_number<uint32_t>(arg, c);
+                    if (count == 0)
+                    {
+                        throw std::invalid_argument("--threads: thread counts must be at least 1");
+                    }
+                    options.threadCounts.push_back(count);
+                }
+
+                if (options.threadCounts.size() == 1)
+                {
+                    options.threadCounts = expand_thread_counts(options.threadCounts.front());
+                }
+            }
+            else if (arg == "--batch")
+            {
+                options.batchSize = parse_number<size_t>(arg, next());
+            }
+            else if (arg == "--mix")
+            {
+                options.writePercents.clear();
+                for (auto const& m : split(next(), ','))
+                {
+                    options.writePercents.push_back(parse_mix(m));
+                }
+            }
+            else if (arg == "--kernels")
+            {
+                options.kernels = split(next(), ',');
+                for (auto const& k : options.kernels)
+                {
+                    bool supported;
+                    if (k == "wyhash") supported = kernel_supported(hash_kernel::wyhash);
+                    else if (k == "crc32") supported = kernel_supported(hash_kernel::crc32);
+                    else if (k == "aes") supported = kernel_supported(hash_kernel::aes);
+                    else if (k == "simd") supported = kernel_supported(compare_kernel::simd);
+                    else throw std::invalid_argument("--kernels: unknown kernel " + k);
+
+                    if (!supported)
+                    {
+                        throw std::invalid_argument("--kernels: " + k + " is not supported on this CPU");
+                    }
+                }
+            }
+            else if (arg == "--string-keys")
+            {
+                options.stringKeys = parse_distribution(arg, next(), true);
+            }
+            else if (arg == "--uint32-keys")
+            {
+                options.uint32Keys = parse_distribution(arg, next(), false);
+            }
+            else if (arg == "--access")
+            {
+                options.access = parse_access(next());
+            }
+            else if (arg == "--bulk-load")
+            {
+                options.bulkLoad = true;
+            }
+            else if (arg == "--huge-pages")
+            {
+                options.hugePages = true;
+            }
+            else if (arg == "--cold-start")
+            {
+                options.coldStart = true;
+            }
+            else if (arg == "--build-repetitions")
+            {
+                options.buildRepetitions = parse_number<uint32_t>(arg, next());
+                if (options.buildRepetitions == 0)
+                {
+                    throw std::invalid_argument("--build-repetitions: must be at least 1");
+                }
+            }
+            else if (arg == "--warmup")
+            {
+                options.measure.warmup = parse_number<uint32_t>(arg, next());
+            }
+            else if (arg == "--repetitions")
+            {
+                options.measure.repetitions = parse_number<uint32_t>(arg, next());
+                if (options.measure.repetitions == 0)
+                {
+                    throw std::invalid_argument("--repetitions: must be at least 1");
+                }
+            }
+            else if (arg == "--counters")
+            {
+                auto counters = next();
+                if (counters == "none") options.measure.counters = counter_backend::none;
+                else if (counters == "rdtsc") options.measure.counters = counter_backend::rdtsc;
+                else if (counters == "perf") options.measure.counters = counter_backend::perf;
+                else throw std::invalid_argument("--counters: expected none, rdtsc or perf");
+            }
+            else if (arg == "--format")
+            {
+                auto format = next();
+                if (format == "text") options.format = output_format::text;
+                else if (format == "json") options.format = output_format::json;
+                else if (format == "csv") options.format = output_format::csv;
+                else throw std::invalid_argument("--format: expected text, json or csv");
+            }
+            else if ((arg == "--output") || (arg == "-o"))
+            {
+                options.outputPath = next();
+            }
+            else if (arg == "--seed")
+            {
+                options.seed = parse_number<uint32_t>(arg, next());
+                options.seeded = true;
+            }
+            else if (arg == "--compile-time")
+            {
+                options.compileTime = true;
+            }
+            else
+            {
+                throw std::invalid_argument("unknown option " + std::string(arg));
+            }
+        }
+
+        // Sizes are resolved last so --miss-ratio and --cycles apply regardless of argument order.
+        for (auto const& s : rawSizes)
+        {
+            options.sizes.push_back(parse_size(options, s));
+        }
+
+        if (rawSizes.empty())
+        {
+            options.sizes = legacy_sizes();
+        }
+
+        return options;
+    }
+
+    std::string_view usage()
+    {
+        return
+            "usage: map-speeds [options]\n"
+            "  --keys string,uint32          key types to benchmark (default: both)\n"
+            "  --containers a,b,...          containers to benchmark (default: all)\n"
+            "  --sizes N[:misses:cycles],... container sizes (default: 5,50,500,5000,500000)\n"
+            "  --miss-ratio R                fraction of searches that miss, for plain N sizes (default: 0.1)\n"
+            "  --cycles C                    passes over the search set, for plain N sizes (default: 3)\n"
+            "  --threads N|a,b,...           also share each container across 1,2,4..N (or the listed) reader threads\n"
+            "  --batch B                     also time find_batch over spans of B keys where supported\n"
+            "  --mix R/W,...                 also run concurrent read/write mixes (e.g. 99/1,90/10) on the concurrent maps\n"
+            "  --kernels k,...               also run string containers with these kernels: wyhash, crc32, aes (hash), simd (compare)\n"
+            "  --string-keys K               string key shape: random, paths, guids or sequential (default: random)\n"
+            "  --uint32-keys K               integer key shape: random or sequential (default: random)\n"
+            "  --access P                    search pattern: uniform, zipf[:S], hot[:F:P], sorted or trace:PATH (default: uniform)\n"
+            "  --bulk-load                   also build map, unordered_map and sorted_vector in bulk (sorted hint, reserve, parallel sort)\n"
+            "  --huge-pages                  also run sorted_vector and the flat hash maps on huge-page backed storage\n"
+            "  --build-repetitions N         timed builds per container; min and median are reported (default: 1)\n"
+            "  --cold-start                  also time the first lookup after rebuilding vs mapping a saved sorted_vector/perfect_hash\n"
+            "  --warmup W                    untimed passes before measuring each container (default: 1)\n"
+            "  --repetitions N               timed repetitions; min/median/p99 are reported (default: 5)\n"
+            "  --counters none|rdtsc|perf    cycle counter backend; perf adds instructions and branch, cache and\n"
+            "                                dTLB misses (Linux only)\n"
+            "  --format text|json|csv        report format (default: text)\n"
+            "  --output PATH                 write the report to PATH instead of stdout\n"
+            "  --seed S                      seed the key generator for reproducible runs\n"
+            "  --compile-time                also run the frozen compile-time datasets\n"
+            "With no options at all, the historical plan is run including the compile-time datasets.\n";
+    }
+}
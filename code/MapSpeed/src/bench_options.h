@@ -0,0 +1,66 @@
+#pragma once
+
+#include "measurement.h"
+#include "workload.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace map_speed
+{
+    // One benchmark point: how many keys go into the containers, how many extra keys are searched for but never
+    // inserted, and how many passes are made over the full search set.
+    struct size_spec
+    {
+        uint64_t possibleSpace;
+        uint64_t unFoundCount;
+        uint64_t cycleCount;
+    };
+
+    enum class output_format
+    {
+        text,
+        json,
+        csv,
+    };
+
+    struct bench_options
+    {
+        std::vector<std::string> keyTypes{ "string", "uint32" };
+        std::vector<std::string> containers;    // empty means "all registered contenders"
+        std::vector<size_spec> sizes;
+        double missRatio = 0.1;
+        uint64_t cycleCount = 3;
+        measure_options measure;
+        std::vector<uint32_t> threadCounts;     // also run each container shared across this many reader threads
+        size_t batchSize = 0;                   // also time find_batch in spans of this many keys; 0 disables
+        std::vector<uint32_t> writePercents;    // --mix: percentage of operations that write, one run per entry
+        std::vector<std::string> kernels;       // string hash/compare kernels whose contender variants also run
+        key_distribution stringKeys = key_distribution::random;
+        key_distribution uint32Keys = key_distribution::random;
+        access_pattern access;                  // order and frequency of searches; uniform shuffle by default
+        uint32_t buildRepetitions = 1;          // timed builds per container; the last one is kept and searched
+        bool bulkLoad = false;                  // also run the bulk-load variants of map, unordered_map and sorted_vector
+        bool hugePages = false;                 // also run the huge-page variants of sorted_vector and the flat hash maps
+        bool coldStart = false;                 // also time first lookups from rebuilt vs memory-mapped tables
+        output_format format = output_format::text;
+        std::string outputPath;                 // empty means stdout
+        uint32_t seed = 0;
+        bool seeded = false;
+        bool compileTime = false;
+        bool help = false;
+
+        bool wants_container(std::string_view name) const;
+        bool wants_key_type(std::string_view name) const;
+        bool wants_kernel(std::string_view name) const;
+    };
+
+    // Parses the command line. With no arguments at all the historical plan is used: both key types, every
+    // container, the original five size points and the compile-time datasets. Throws std::invalid_argument on
+    // malformed input.
+    bench_options parse_options(int argc, char const* const* argv);
+
+    std::string_view usage();
+}
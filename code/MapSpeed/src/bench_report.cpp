@@ -0,0 +1,280 @@
+#include "bench_report.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+
+namespace map_speed
+{
+    namespace
+    {
+        std::string json_escape(std::string_view s)
+        {
+            std::string escaped;
+            for (char c : s)
+            {
+                switch (c)
+                {
+                case '"': escaped += "\\\""; break;
+                case '\\': escaped += "\\\\"; break;
+                case '\n': escaped += "\\n"; break;
+                case '\t': escaped += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20)
+                    {
+                        char buffer[8];
+                        std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                        escaped += buffer;
+                    }
+                    else
+                    {
+                        escaped += c;
+                    }
+                }
+            }
+            return escaped;
+        }
+
+        // The perf events after cycles, in report order.
+        struct event_column
+        {
+            perf_event_flags event;
+            char const* name;   // JSON and CSV column
+            char const* label;  // text report
+            double (run_result::* per_lookup)() const;
+        };
+
+        constexpr event_column event_columns[] = {
+            { perf_event_flags::instructions, "instructions_per_lookup", "instructions", &run_result::instructions_per_lookup },
+            { perf_event_flags::branch_misses, "branch_misses_per_lookup", "branch misses", &run_result::branch_misses_per_lookup },
+            { perf_event_flags::cache_misses, "cache_misses_per_lookup", "cache misses", &run_result::cache_misses_per_lookup },
+            { perf_event_flags::dtlb_misses, "dtlb_misses_per_lookup", "dTLB misses", &run_result::dtlb_misses_per_lookup },
+        };
+
+        bool same_point(run_result const& a, run_result const& b)
+        {
+            return (a.keyType == b.keyType) && (a.keyDistribution == b.keyDistribution) && (a.accessPattern == b.accessPattern) &&
+                (a.possibleSpace == b.possibleSpace) && (a.unFoundCount == b.unFoundCount) && (a.cycleCount == b.cycleCount);
+        }
+
+        double thread_rate(run_result const& r, bool fastest)
+        {
+            if (r.threadSeconds.empty())
+            {
+                return 0;
+            }
+
+            auto seconds = fastest ? *std::min_element(r.threadSeconds.begin(), r.threadSeconds.end())
+                : *std::max_element(r.threadSeconds.begin(), r.threadSeconds.end());
+            auto perThreadOperations = static_cast<double>(r.operations) / r.threads;
+            return (seconds > 0) ? (perThreadOperations / seconds) : 0.0;
+        }
+    }
+
+    double run_result::min_thread_lookups_per_second() const
+    {
+        return thread_rate(*this, false);
+    }
+
+    double run_result::max_thread_lookups_per_second() const
+    {
+        return thread_rate(*this, true);
+    }
+
+    void write_text(std::ostream& out, std::span<const run_result> results)
+    {
+        auto flags = out.flags();
+        auto precision = out.precision();
+        out.precision(5);
+        out << std::fixed;
+        out << "In cycles per second, more is better; in time, less is better.\n";
+
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            auto const& r = results[i];
+            if ((i == 0) || !same_point(results[i - 1], r))
+            {
+                out << "\nTesting " << r.keyType;
+                if (!r.keyDistribution.empty() && ((r.keyDistribution != "random") || (r.accessPattern != "uniform")))
+                {
+                    out << " (" << r.keyDistribution << " keys, " << r.accessPattern << " access)";
+                }
+                out << "...\n";
+                out << std::setw(30) << "Search Count: " << r.operations << ", Total space: " << r.possibleSpace + r.unFoundCount
+                    << ", Unfound items: " << r.unFoundCount << ", Cycle count: " << r.cycleCount << "\n";
+            }
+
+            auto label = r.container;
+            if (r.batchSize != 0)
+            {
+                label += " (batch " + std::to_string(r.batchSize) + ")";
+            }
+            else if (r.coldStart)
+            {
+                label += " (cold start)";
+            }
+            else if (r.writePercent != 0)
+            {
+                label += " (" + std::to_string(r.threads) + " threads, " + std::to_string(100 - r.writePercent) + "/" + std::to_string(r.writePercent) + ")";
+            }
+            else if (r.threads != 0)
+            {
+                label += " (" + std::to_string(r.threads) + " threads)";
+            }
+            out << std::setw(30) << (label + " time: ") << r.timing.median_seconds() << "s (min " << r.timing.min_seconds()
+                << ", p99 " << r.timing.p99_seconds() << ", n=" << r.timing.repetitions() << "), " << std::setw(20)
+                << r.lookups_per_second() << " cycles per second";
+            if (r.timing.backend != counter_backend::none)
+            {
+                out << ", " << std::setprecision(2) << r.cycles_per_lookup() << " " << counter_backend_name(r.timing.backend) << " cycles/lookup";
+                for (auto const& column : event_columns)
+                {
+                    if (r.counted(column.event))
+                    {
+                        out << ", " << (r.*column.per_lookup)() << " " << column.label << "/lookup";
+                    }
+                }
+                out << std::setprecision(5);
+            }
+            if (r.coldStart)
+            {
+                if (r.heapBytes != 0)
+                {
+                    out << ", " << std::setprecision(1) << r.bytes_per_entry() << " file bytes/entry" << std::setprecision(5);
+                }
+            }
+            else if (r.heapBytes != 0)
+            {
+                out << ", " << std::setprecision(1) << r.bytes_per_entry() << " bytes/entry in " << r.heapAllocations << " allocs"
+                    << std::setprecision(5) << ", built in " << r.buildSeconds << "s (" << std::setprecision(0)
+                    << r.build_lookup_equivalent() << " lookups)" << std::setprecision(5);
+            }
+            if (!r.pageBacking.empty())
+            {
+                out << ", " << r.pageBacking << " pages";
+            }
+            if (r.batchSize != 0)
+            {
+                out << ", " << std::setprecision(2) << r.speedup << "x vs scalar" << std::setprecision(5);
+            }
+            if (r.threads != 0)
+            {
+                out << ", per thread " << std::setprecision(0) << r.min_thread_lookups_per_second() << ".."
+                    << r.max_thread_lookups_per_second() << std::setprecision(5);
+            }
+            out << " (sum " << r.sum << ", missed " << r.missed << ")\n";
+        }
+
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+    void write_json(std::ostream& out, std::span<const run_result> results)
+    {
+        auto precision = out.precision();
+        out.precision(9);
+        out << "[\n";
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            auto const& r = results[i];
+            out << "  {"
+                << "\"container\": \"" << json_escape(r.container) << "\", "
+                << "\"key_type\": \"" << json_escape(r.keyType) << "\", "
+                << "\"key_distribution\": \"" << json_escape(r.keyDistribution) << "\", "
+                << "\"access_pattern\": \"" << json_escape(r.accessPattern) << "\", "
+                << "\"size\": " << r.possibleSpace << ", "
+                << "\"miss_count\": " << r.unFoundCount << ", "
+                << "\"cycles\": " << r.cycleCount << ", "
+                << "\"operations\": " << r.operations << ", "
+                << "\"missed\": " << r.missed << ", "
+                << "\"sum\": " << r.sum << ", "
+                << "\"batch\": " << r.batchSize << ", "
+                << "\"speedup_vs_scalar\": " << r.speedup << ", "
+                << "\"threads\": " << r.threads << ", "
+                << "\"thread_lookups_per_second_min\": " << r.min_thread_lookups_per_second() << ", "
+                << "\"thread_lookups_per_second_max\": " << r.max_thread_lookups_per_second() << ", "
+                << "\"write_percent\": " << r.writePercent << ", "
+                << "\"cold_start\": " << (r.coldStart ? "true" : "false") << ", "
+                << "\"heap_bytes\": " << r.heapBytes << ", "
+                << "\"bytes_per_entry\": " << r.bytes_per_entry() << ", "
+                << "\"allocations\": " << r.heapAllocations << ", "
+                << "\"build_peak_bytes\": " << r.buildPeakBytes << ", "
+                << "\"peak_rss\": " << r.peakRss << ", "
+                << "\"build_seconds\": " << r.buildSeconds << ", "
+                << "\"build_seconds_min\": " << r.buildSecondsMin << ", "
+                << "\"build_ns_per_key\": " << r.build_ns_per_key() << ", "
+                << "\"build_lookup_equivalent\": " << r.build_lookup_equivalent() << ", "
+                << "\"page_backing\": \"" << json_escape(r.pageBacking) << "\", "
+                << "\"warmup\": " << r.timing.warmup << ", "
+                << "\"repetitions\": " << r.timing.repetitions() << ", "
+                << "\"seconds\": " << r.timing.median_seconds() << ", "
+                << "\"seconds_min\": " << r.timing.min_seconds() << ", "
+                << "\"seconds_p99\": " << r.timing.p99_seconds() << ", "
+                << "\"lookups_per_second\": " << r.lookups_per_second() << ", "
+                << "\"counters\": \"" << counter_backend_name(r.timing.backend) << "\", "
+                << "\"cycles_per_lookup\": " << r.cycles_per_lookup();
+            for (auto const& column : event_columns)
+            {
+                out << ", \"" << column.name << "\": ";
+                if (r.counted(column.event))
+                {
+                    out << (r.*column.per_lookup)();
+                }
+                else
+                {
+                    out << "null";
+                }
+            }
+            out << "}" << ((i + 1 < results.size()) ? ",\n" : "\n");
+        }
+        out << "]\n";
+        out.precision(precision);
+    }
+
+    void write_csv(std::ostream& out, std::span<const run_result> results)
+    {
+        auto precision = out.precision();
+        out.precision(9);
+        out << "container,key_type,key_distribution,access_pattern,size,miss_count,cycles,operations,missed,sum,batch,speedup_vs_scalar,threads,"
+            "thread_lookups_per_second_min,thread_lookups_per_second_max,write_percent,cold_start,heap_bytes,bytes_per_entry,allocations,build_peak_bytes,peak_rss,build_seconds,build_seconds_min,build_ns_per_key,build_lookup_equivalent,page_backing,warmup,repetitions,seconds,seconds_min,seconds_p99,"
+            "lookups_per_second,counters,cycles_per_lookup";
+        for (auto const& column : event_columns)
+        {
+            out << ',' << column.name;
+        }
+        out << '\n';
+
+        for (auto const& r : results)
+        {
+            out << r.container << ',' << r.keyType << ',' << r.keyDistribution << ',' << r.accessPattern << ',' << r.possibleSpace << ',' << r.unFoundCount << ','
+                << r.cycleCount << ',' << r.operations << ',' << r.missed << ',' << r.sum << ','
+                << r.batchSize << ',' << r.speedup << ',' << r.threads << ','
+                << r.min_thread_lookups_per_second() << ',' << r.max_thread_lookups_per_second() << ',' << r.writePercent << ',' << (r.coldStart ? 1 : 0) << ','
+                << r.heapBytes << ',' << r.bytes_per_entry() << ',' << r.heapAllocations << ',' << r.buildPeakBytes << ',' << r.peakRss << ','
+                << r.buildSeconds << ',' << r.buildSecondsMin << ',' << r.build_ns_per_key() << ',' << r.build_lookup_equivalent() << ',' << r.pageBacking << ','
+                << r.timing.warmup << ',' << r.timing.repetitions() << ',' << r.timing.median_seconds() << ','
+                << r.timing.min_seconds() << ',' << r.timing.p99_seconds() << ',' << r.lookups_per_second() << ','
+                << counter_backend_name(r.timing.backend) << ',' << r.cycles_per_lookup();
+            for (auto const& column : event_columns)
+            {
+                out << ',';
+                if (r.counted(column.event))
+                {
+                    out << (r.*column.per_lookup)();
+                }
+            }
+            out << '\n';
+        }
+        out.precision(precision);
+    }
+
+    void write_report(std::ostream& out, output_format format, std::span<const run_result> results)
+    {
+        switch (format)
+        {
+        case output_format::json: write_json(out, results); break;
+        case output_format::csv: write_csv(out, results); break;
+        default: write_text(out, results); break;
+        }
+    }
+}
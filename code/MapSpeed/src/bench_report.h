@@ -0,0 +1,108 @@
+#pragma once
+
+#include "bench_options.h"
+#include "measurement.h"
+
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace map_speed
+{
+    // One measured lookup loop over one container. operations counts the lookups in a single repetition. Every
+    // writer emits every field so CI can diff runs column by column.
+    struct run_result
+    {
+        std::string container;
+        std::string keyType;
+        std::string keyDistribution;    // --string-keys/--uint32-keys; empty for the compile-time datasets
+        std::string accessPattern;      // --access
+        uint64_t possibleSpace = 0;
+        uint64_t unFoundCount = 0;
+        uint64_t cycleCount = 0;
+        uint64_t operations = 0;
+        uint64_t missed = 0;
+        uint64_t sum = 0;
+        uint64_t batchSize = 0;     // 0 for one-at-a-time find, otherwise the find_batch span length
+        double speedup = 0;         // batched rows: scalar median time / batched median time
+        uint32_t threads = 0;       // 0 for the single-threaded loops; otherwise operations is the sum over threads
+        std::vector<double> threadSeconds;  // threaded rows: each thread's time in the last repetition
+        uint32_t writePercent = 0;  // --mix rows: percentage of the operations that were writes rather than lookups
+        bool coldStart = false;     // --cold-start rows: timing is from nothing to the first lookup's answer
+        int64_t heapBytes = 0;          // the built container: heap bytes it holds, plus its own size
+        uint64_t heapAllocations = 0;   // allocations made while building it
+        int64_t buildPeakBytes = 0;     // the most heap in use at any point of the build, temporaries included
+        uint64_t peakRss = 0;           // the process's peak resident set size once it was built
+        double buildSeconds = 0;        // median time to build the container from the generated content
+        double buildSecondsMin = 0;     // fastest of the --build-repetitions builds
+        std::string pageBacking;        // --huge-pages rows: the backing the mapped storage got (huge_pages.h)
+        measurement timing;
+
+        // Throughput of the median repetition.
+        double lookups_per_second() const
+        {
+            auto seconds = timing.median_seconds();
+            return (seconds > 0) ? (static_cast<double>(operations) / seconds) : 0.0;
+        }
+
+        // Threaded rows: the slowest and fastest single thread's own lookup rate.
+        double min_thread_lookups_per_second() const;
+        double max_thread_lookups_per_second() const;
+
+        double bytes_per_entry() const
+        {
+            return (possibleSpace > 0) ? (static_cast<double>(heapBytes) / possibleSpace) : 0.0;
+        }
+
+        double build_ns_per_key() const
+        {
+            return (possibleSpace > 0) ? (buildSeconds * 1e9 / possibleSpace) : 0.0;
+        }
+
+        // How many of this row's lookups take as long as building the container once: below this many lookups
+        // over its lifetime, a process is paying mostly for the build.
+        double build_lookup_equivalent() const
+        {
+            auto seconds = timing.median_seconds();
+            return (seconds > 0) ? (buildSeconds * static_cast<double>(operations) / seconds) : 0.0;
+        }
+
+        double cycles_per_lookup() const
+        {
+            return (operations > 0) ? (timing.median_cycles() / operations) : 0.0;
+        }
+
+        double instructions_per_lookup() const
+        {
+            return (operations > 0) ? (timing.median_instructions() / operations) : 0.0;
+        }
+
+        double branch_misses_per_lookup() const
+        {
+            return (operations > 0) ? (timing.median_branch_misses() / operations) : 0.0;
+        }
+
+        double cache_misses_per_lookup() const
+        {
+            return (operations > 0) ? (timing.median_cache_misses() / operations) : 0.0;
+        }
+
+        double dtlb_misses_per_lookup() const
+        {
+            return (operations > 0) ? (timing.median_dtlb_misses() / operations) : 0.0;
+        }
+
+        // Whether the perf backend counted this event for the row; reports leave uncounted events blank.
+        bool counted(perf_event_flags event) const
+        {
+            return (timing.backend == counter_backend::perf) && has_event(timing.events, event);
+        }
+    };
+
+    void write_text(std::ostream& out, std::span<const run_result> results);
+    void write_json(std::ostream& out, std::span<const run_result> results);
+    void write_csv(std::ostream& out, std::span<const run_result> results);
+    void write_report(std::ostream& out, output_format format, std::span<const run_result> results);
+}
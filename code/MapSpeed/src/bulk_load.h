@@ -0,0 +1,209 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+/*
+    Helpers for building containers and content in bulk rather than one item at a time.
+
+    parallel_sort splits the range into one run per thread, sorts the runs concurrently and then merges neighbouring
+    runs in rounds, each round's merges again in parallel. parallel_radix_sort is an LSD radix sort of 32-bit
+    keys, one byte per pass, with each pass's histogram and scatter split across threads. parallel_unique removes
+    adjacent duplicates from a sorted vector, compacting each thread's share in place before closing the gaps.
+
+    All of them fall back to the plain serial algorithm for small inputs, where starting threads would cost more
+    than it saves, and produce exactly what the serial algorithm would.
+*/
+namespace map_speed
+{
+    inline unsigned default_sort_threads()
+    {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Items below which splitting work across threads is not worth it.
+    inline constexpr size_t min_parallel_run = 16384;
+
+    // Calls fn(i) for i in [0, count), each on its own thread; index 0 runs on the calling thread.
+    template<typename Fn> void run_parallel(size_t count, Fn const& fn)
+    {
+        std::vector<std::thread> threads;
+        threads.reserve(count);
+        for (size_t i = 1; i < count; i++)
+        {
+            threads.emplace_back(fn, i);
+        }
+        fn(size_t{ 0 });
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+    }
+
+    // How many pieces to split n items into for threadCount threads.
+    inline size_t parallel_runs(size_t n, unsigned threadCount)
+    {
+        return std::max<size_t>(1, std::min<size_t>(threadCount, n / min_parallel_run));
+    }
+
+    template<typename It, typename Less> void parallel_sort(It first, It last, Less less, unsigned threadCount = default_sort_threads())
+    {
+        auto n = static_cast<size_t>(last - first);
+        auto runs = parallel_runs(n, threadCount);
+        if (runs <= 1)
+        {
+            std::sort(first, last, less);
+            return;
+        }
+
+        std::vector<It> bounds;
+        for (size_t i = 0; i <= runs; i++)
+        {
+            bounds.push_back(first + static_cast<std::ptrdiff_t>(n * i / runs));
+        }
+
+        run_parallel(runs, [&](size_t i) { std::sort(bounds[i], bounds[i + 1], less); });
+
+        // Each round merges runs pairwise, halving their number; an odd run out waits for the next round.
+        while (bounds.size() > 2)
+        {
+            auto pairs = (bounds.size() - 1) / 2;
+            run_parallel(pairs, [&](size_t i) { std::inplace_merge(bounds[2 * i], bounds[2 * i + 1], bounds[2 * i + 2], less); });
+
+            std::vector<It> merged;
+            for (size_t i = 0; i < bounds.size(); i += 2)
+            {
+                merged.push_back(bounds[i]);
+            }
+            if (merged.back() != bounds.back())
+            {
+                merged.push_back(bounds.back());
+            }
+            bounds = std::move(merged);
+        }
+    }
+
+    inline void parallel_radix_sort(std::vector<uint32_t>& keys, unsigned threadCount = default_sort_threads())
+    {
+        // Four linear passes beat a comparison sort once there are enough keys, even on one thread.
+        auto n = keys.size();
+        if (n < min_parallel_run)
+        {
+            std::sort(keys.begin(), keys.end());
+            return;
+        }
+
+        auto runs = parallel_runs(n, threadCount);
+        std::vector<uint32_t> buffer(n);
+        auto* source = &keys;
+        auto* target = &buffer;
+        std::vector<std::array<size_t, 256>> offsets(runs);
+        auto begin = [&](size_t run) { return n * run / runs; };
+
+        for (int shift = 0; shift < 32; shift += 8)
+        {
+            run_parallel(runs, [&](size_t run) {
+                auto& count = offsets[run];
+                count.fill(0);
+                for (auto i = begin(run); i < begin(run + 1); i++)
+                {
+                    count[((*source)[i] >> shift) & 0xFF]++;
+                }
+            });
+
+            // Bucket by bucket, each run's share lands after the earlier runs' share, which keeps the sort stable.
+            // A pass where every key has the same byte would move nothing, so it is skipped.
+            size_t next = 0;
+            bool skip = false;
+            for (size_t digit = 0; digit < 256; digit++)
+            {
+                size_t total = 0;
+                for (auto& count : offsets)
+                {
+                    auto c = count[digit];
+                    count[digit] = next;
+                    next += c;
+                    total += c;
+                }
+                skip = skip || (total == n);
+            }
+            if (skip)
+            {
+                continue;
+            }
+
+            run_parallel(runs, [&](size_t run) {
+                auto& offset = offsets[run];
+                for (auto i = begin(run); i < begin(run + 1); i++)
+                {
+                    auto key = (*source)[i];
+                    (*target)[offset[(key >> shift) & 0xFF]++] = key;
+                }
+            });
+            std::swap(source, target);
+        }
+
+        if (source != &keys)
+        {
+            keys.swap(buffer);
+        }
+    }
+
+    // std::unique followed by erase, over a sorted vector.
+    template<typename T> void parallel_unique(std::vector<T>& items, unsigned threadCount = default_sort_threads())
+    {
+        auto n = items.size();
+        auto runs = parallel_runs(n, threadCount);
+        if (runs <= 1)
+        {
+            items.erase(std::unique(items.begin(), items.end()), items.end());
+            return;
+        }
+
+        std::vector<size_t> bounds;
+        for (size_t i = 0; i <= runs; i++)
+        {
+            bounds.push_back(n * i / runs);
+        }
+
+        // Each run drops its leading items equal to the previous run's last one, so that item is copied before any
+        // run starts compacting (and overwriting) its own range.
+        std::vector<T> previous;
+        for (size_t run = 1; run < runs; run++)
+        {
+            previous.push_back(items[bounds[run] - 1]);
+        }
+
+        std::vector<size_t> kept(runs);
+        run_parallel(runs, [&](size_t run) {
+            auto first = items.begin() + static_cast<std::ptrdiff_t>(bounds[run]);
+            auto last = items.begin() + static_cast<std::ptrdiff_t>(bounds[run + 1]);
+            if (run > 0)
+            {
+                auto const& before = previous[run - 1];
+                auto start = std::find_if(first, last, [&](T const& item) { return !(item == before); });
+                if (start != first)
+                {
+                    last = std::move(start, last, first);
+                }
+            }
+            kept[run] = static_cast<size_t>(std::unique(first, last) - first);
+        });
+
+        size_t end = kept[0];
+        for (size_t run = 1; run < runs; run++)
+        {
+            auto first = items.begin() + static_cast<std::ptrdiff_t>(bounds[run]);
+            if (bounds[run] != end)
+            {
+                std::move(first, first + static_cast<std::ptrdiff_t>(kept[run]), items.begin() + static_cast<std::ptrdiff_t>(end));
+            }
+            end += kept[run];
+        }
+        items.erase(items.begin() + static_cast<std::ptrdiff_t>(end), items.end());
+    }
+}
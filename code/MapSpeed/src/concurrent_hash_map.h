@@ -0,0 +1,227 @@
+#pragma once
+
+#include "epoch_reclamation.h"
+#include "flat_hash_map.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+
+/*
+    Read-mostly concurrent hash maps for the mixed read/write benchmark.
+
+    concurrent_hash_map - chained buckets of immutable nodes. Readers take no lock: they pin an epoch and walk
+        the chain with acquire loads. Writers serialize on one mutex and never modify a node a reader might be
+        looking at; an update links in a replacement node and an erase unlinks, and either way the old node is
+        retired to the epoch domain. Growing the table copies every node into a new bucket array, publishes it
+        with one store, and retires the old array with its nodes, so a reader that is still walking the old table
+        sees a consistent (if slightly stale) snapshot.
+
+    shared_mutex_map - the conventional baseline: std::unordered_map behind a std::shared_mutex.
+
+    Both copy the value out rather than returning a pointer, since nothing keeps a node alive after find returns.
+*/
+namespace map_speed
+{
+    template<typename K, typename V, typename Hash = flat_hash<K>> class concurrent_hash_map
+    {
+    public:
+        static constexpr std::string_view name = "concurrent_hash_map";
+
+    private:
+        struct node
+        {
+            K key;
+            V value;
+            uint64_t hash;
+            std::atomic<node*> next;
+        };
+
+        struct table
+        {
+            size_t mask;
+            std::unique_ptr<std::atomic<node*>[]> buckets;
+
+            explicit table(size_t bucketCount) : mask(bucketCount - 1), buckets(new std::atomic<node*>[bucketCount])
+            {
+                for (size_t i = 0; i < bucketCount; i++)
+                {
+                    buckets[i].store(nullptr, std::memory_order_relaxed);
+                }
+            }
+
+            ~table()
+            {
+                for (size_t i = 0; i <= mask; i++)
+                {
+                    for (auto n = buckets[i].load(std::memory_order_relaxed); n != nullptr; )
+                    {
+                        auto next = n->next.load(std::memory_order_relaxed);
+                        delete n;
+                        n = next;
+                    }
+                }
+            }
+        };
+
+    public:
+        explicit concurrent_hash_map(size_t expectedSize = 16) : m_table(new table(std::bit_ceil(std::max<size_t>(expectedSize, 16))))
+        {
+        }
+
+        ~concurrent_hash_map()
+        {
+            delete m_table.load(std::memory_order_relaxed);
+        }
+
+        concurrent_hash_map(concurrent_hash_map const&) = delete;
+        concurrent_hash_map& operator=(concurrent_hash_map const&) = delete;
+
+        size_t size() const
+        {
+            return m_size.load(std::memory_order_relaxed);
+        }
+
+        // Lock-free. Copies the value into out and returns true when key is present.
+        template<typename TKey> bool find(TKey const& key, V& out) const
+        {
+            auto pinned = m_domain.pin();
+            auto h = static_cast<uint64_t>(m_hash(key));
+            auto t = m_table.load(std::memory_order_acquire);
+            for (auto n = t->buckets[h & t->mask].load(std::memory_order_acquire); n != nullptr; n = n->next.load(std::memory_order_acquire))
+            {
+                if ((n->hash == h) && (n->key == key))
+                {
+                    out = n->value;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void insert_or_assign(K const& key, V value)
+        {
+            std::lock_guard lock(m_writeLock);
+            auto h = static_cast<uint64_t>(m_hash(key));
+            auto t = m_table.load(std::memory_order_relaxed);
+            auto link = &t->buckets[h & t->mask];
+            for (auto n = link->load(std::memory_order_relaxed); n != nullptr; link = &n->next, n = n->next.load(std::memory_order_relaxed))
+            {
+                if ((n->hash == h) && (n->key == key))
+                {
+                    // Readers may be on n, so it stays intact: its replacement takes over the same successor.
+                    auto replacement = new node{ key, std::move(value), h, n->next.load(std::memory_order_relaxed) };
+                    link->store(replacement, std::memory_order_release);
+                    m_domain.retire(n);
+                    return;
+                }
+            }
+
+            auto head = &t->buckets[h & t->mask];
+            head->store(new node{ key, std::move(value), h, head->load(std::memory_order_relaxed) }, std::memory_order_release);
+            if (m_size.fetch_add(1, std::memory_order_relaxed) + 1 > t->mask + 1)
+            {
+                grow(t);
+            }
+        }
+
+        bool erase(K const& key)
+        {
+            std::lock_guard lock(m_writeLock);
+            auto h = static_cast<uint64_t>(m_hash(key));
+            auto t = m_table.load(std::memory_order_relaxed);
+            auto link = &t->buckets[h & t->mask];
+            for (auto n = link->load(std::memory_order_relaxed); n != nullptr; link = &n->next, n = n->next.load(std::memory_order_relaxed))
+            {
+                if ((n->hash == h) && (n->key == key))
+                {
+                    link->store(n->next.load(std::memory_order_relaxed), std::memory_order_release);
+                    m_size.fetch_sub(1, std::memory_order_relaxed);
+                    m_domain.retire(n);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        // Called with the write lock held.
+        void grow(table* old)
+        {
+            auto bigger = new table((old->mask + 1) * 2);
+            for (size_t i = 0; i <= old->mask; i++)
+            {
+                for (auto n = old->buckets[i].load(std::memory_order_relaxed); n != nullptr; n = n->next.load(std::memory_order_relaxed))
+                {
+                    auto& head = bigger->buckets[n->hash & bigger->mask];
+                    head.store(new node{ n->key, n->value, n->hash, head.load(std::memory_order_relaxed) }, std::memory_order_relaxed);
+                }
+            }
+
+            m_table.store(bigger, std::memory_order_release);
+            m_domain.retire(old);
+        }
+
+        std::atomic<table*> m_table;
+        std::atomic<size_t> m_size{ 0 };
+        std::mutex m_writeLock;
+        epoch_domain& m_domain = epoch_domain::global();
+        Hash m_hash;
+    };
+
+    template<typename K, typename V, typename Hash = flat_hash<K>> class shared_mutex_map
+    {
+    public:
+        static constexpr std::string_view name = "shared_mutex_map";
+
+        explicit shared_mutex_map(size_t expectedSize = 16)
+        {
+            m_map.reserve(expectedSize);
+        }
+
+        size_t size() const
+        {
+            std::shared_lock lock(m_lock);
+            return m_map.size();
+        }
+
+        template<typename TKey> bool find(TKey const& key, V& out) const
+        {
+            std::shared_lock lock(m_lock);
+            auto it = m_map.find(key);
+            if (it == m_map.end())
+            {
+                return false;
+            }
+            out = it->second;
+            return true;
+        }
+
+        void insert_or_assign(K const& key, V value)
+        {
+            std::unique_lock lock(m_lock);
+            m_map.insert_or_assign(key, std::move(value));
+        }
+
+        bool erase(K const& key)
+        {
+            std::unique_lock lock(m_lock);
+            return m_map.erase(key) != 0;
+        }
+
+    private:
+        mutable std::shared_mutex m_lock;
+        std::unordered_map<K, V, Hash> m_map;
+    };
+
+    // The maps run by --mix; --containers accepts these names as well as the read-only contenders.
+    template<typename T> using mixed_map_list = std::tuple<concurrent_hash_map<T, size_t>, shared_mutex_map<T, size_t>>;
+
+    inline constexpr std::string_view mixed_map_names[] = { concurrent_hash_map<uint32_t, size_t>::name, shared_mutex_map<uint32_t, size_t>::name };
+}
@@ -0,0 +1,472 @@
+#pragma once
+
+#include "bulk_load.h"
+#include "flat_hash_map.h"
+#include "huge_pages.h"
+#include "perfect_hash.h"
+#include "sorted_layouts.h"
+#include "string_arena.h"
+#include "string_kernels.h"
+
+#include <algorithm>
+#include <array>
+#include <map>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Each contender wraps one lookup structure behind the same tiny interface so the benchmark engine can
+// build and time them all on identical content:
+//
+//     static constexpr std::string_view name;          // stable identifier used on the command line & in reports
+//     void build(std::span<const T> content);          // content[i] maps to the value i
+//     size_t const* find(T const& key) const;          // nullptr when the key is absent
+//
+// Contenders over flat storage may also provide
+//
+//     void find_batch(std::span<const T> keys, std::span<size_t const*> results) const;
+//
+// which the engine times separately (--batch) against the one-at-a-time find.
+//
+// Adding a container to the benchmark is a matter of writing a contender and listing it in contender_list.
+// Variants of a contender (kernel_variant, bulk_variant, huge_page_variant) also name the contender they vary as
+// base_name.
+namespace map_speed
+{
+    template<typename T, typename Less = std::less<T>> struct map_contender
+    {
+        static constexpr std::string_view name = "map";
+        std::map<T, size_t, Less> map;
+
+        void build(std::span<const T> content)
+        {
+            for (size_t i = 0; i < content.size(); i++)
+            {
+                map[content[i]] = i;
+            }
+        }
+
+        size_t const* find(T const& key) const
+        {
+            auto it = map.find(key);
+            return (it != map.end()) ? &it->second : nullptr;
+        }
+    };
+
+    template<typename T, typename Hash = std::hash<T>> struct unordered_map_contender
+    {
+        static constexpr std::string_view name = "unordered_map";
+        std::unordered_map<T, size_t, Hash> unorderedMap;
+
+        void build(std::span<const T> content)
+        {
+            for (size_t i = 0; i < content.size(); i++)
+            {
+                unorderedMap[content[i]] = i;
+            }
+        }
+
+        size_t const* find(T const& key) const
+        {
+            auto it = unorderedMap.find(key);
+            return (it != unorderedMap.end()) ? &it->second : nullptr;
+        }
+    };
+
+    template<typename T, typename Less = std::less<T>, typename Allocator = std::allocator<std::pair<T, size_t>>> struct sorted_vector_contender
+    {
+        static constexpr std::string_view name = "sorted_vector";
+        std::vector<std::pair<T, size_t>, Allocator> sortedVector;
+
+        void build(std::span<const T> content)
+        {
+            for (size_t i = 0; i < content.size(); i++)
+            {
+                sortedVector.push_back({ content[i], i });
+            }
+
+            std::sort(sortedVector.begin(), sortedVector.end(), [](const auto& a, const auto& b) {
+                return Less{}(a.first, b.first);
+            });
+        }
+
+        size_t const* find(T const& key) const
+        {
+            auto it = std::lower_bound(sortedVector.begin(), sortedVector.end(), key, [](auto& pair, auto& value) {
+                return Less{}(pair.first, value);
+            });
+            return ((it != sortedVector.end()) && (it->first == key)) ? &it->second : nullptr;
+        }
+    };
+
+    template<typename T, typename Hash = flat_hash<T>, typename Allocator = std::allocator<std::pair<T, size_t>>> struct flat_hash_map_contender
+    {
+        static constexpr std::string_view name = "flat_hash_map";
+        flat_hash_map<T, size_t, Hash, std::equal_to<>, Allocator> flatMap;
+
+        void build(std::span<const T> content)
+        {
+            flatMap.reserve(content.size());
+            for (size_t i = 0; i < content.size(); i++)
+            {
+                flatMap.insert(content[i], i);
+            }
+        }
+
+        size_t const* find(T const& key) const
+        {
+            return flatMap.find(key);
+        }
+
+        void find_batch(std::span<const T> keys, std::span<size_t const*> results) const
+        {
+            flatMap.find_batch(keys, results);
+        }
+    };
+
+    template<typename T> std::vector<std::pair<T, size_t>> indexed_pairs(std::span<const T> content)
+    {
+        std::vector<std::pair<T, size_t>> pairs;
+        pairs.reserve(content.size());
+        for (size_t i = 0; i < content.size(); i++)
+        {
+            pairs.push_back({ content[i], i });
+        }
+        return pairs;
+    }
+
+    template<typename T> struct eytzinger_contender
+    {
+        static constexpr std::string_view name = "eytzinger";
+        eytzinger_map<T, size_t> eytzinger;
+
+        void build(std::span<const T> content)
+        {
+            eytzinger = eytzinger_map<T, size_t>(indexed_pairs(content));
+        }
+
+        size_t const* find(T const& key) const
+        {
+            return eytzinger.find(key);
+        }
+
+        void find_batch(std::span<const T> keys, std::span<size_t const*> results) const
+        {
+            eytzinger.find_batch(keys, results);
+        }
+    };
+
+    template<typename T> struct s_tree_contender
+    {
+        static constexpr std::string_view name = "s_tree";
+        s_tree_map<T, size_t> sTree;
+
+        void build(std::span<const T> content)
+        {
+            sTree = s_tree_map<T, size_t>(indexed_pairs(content));
+        }
+
+        size_t const* find(T const& key) const
+        {
+            return sTree.find(key);
+        }
+
+        void find_batch(std::span<const T> keys, std::span<size_t const*> results) const
+        {
+            sTree.find_batch(keys, results);
+        }
+    };
+
+    template<typename T, typename Hash = flat_hash<T>> struct perfect_hash_contender
+    {
+        static constexpr std::string_view name = "perfect_hash";
+        perfect_hash_map<T, size_t, Hash> perfectHash;
+
+        void build(std::span<const T> content)
+        {
+            perfectHash = perfect_hash_map<T, size_t, Hash>(indexed_pairs(content));
+        }
+
+        size_t const* find(T const& key) const
+        {
+            return perfectHash.find(key);
+        }
+    };
+
+    // String keys copied once into a string_arena, with the containers keyed on 32-bit handles into it and
+    // probed with string views. The containers' functors point at the arena, so these cannot be copied.
+    template<typename TArena = string_arena> struct arena_contender_base
+    {
+        TArena arena;
+
+        arena_contender_base() = default;
+        arena_contender_base(arena_contender_base const&) = delete;
+        arena_contender_base& operator=(arena_contender_base const&) = delete;
+
+        // Sizes the arena for content up front; each contender then appends the strings itself.
+        void reserve_arena(std::span<const std::string> content)
+        {
+            size_t characters = 0;
+            for (auto const& s : content)
+            {
+                characters += s.size();
+            }
+            arena.reserve(content.size(), characters);
+        }
+    };
+
+    struct arena_map_contender : arena_contender_base<>
+    {
+        static constexpr std::string_view name = "arena_map";
+        std::map<string_handle, size_t, arena_less> map{ arena_less{ &arena } };
+
+        void build(std::span<const std::string> content)
+        {
+            reserve_arena(content);
+            for (size_t i = 0; i < content.size(); i++)
+            {
+                map.emplace(arena.append(content[i]), i);
+            }
+        }
+
+        size_t const* find(std::string const& key) const
+        {
+            auto it = map.find(std::string_view(key));
+            return (it != map.end()) ? &it->second : nullptr;
+        }
+    };
+
+    struct arena_unordered_map_contender : arena_contender_base<>
+    {
+        static constexpr std::string_view name = "arena_unordered_map";
+        std::unordered_map<string_handle, size_t, arena_hash, arena_equal> unorderedMap{ 0, arena_hash{ &arena }, arena_equal{ &arena } };
+
+        void build(std::span<const std::string> content)
+        {
+            reserve_arena(content);
+            for (size_t i = 0; i < content.size(); i++)
+            {
+                unorderedMap.emplace(arena.append(content[i]), i);
+            }
+        }
+
+        size_t const* find(std::string const& key) const
+        {
+            auto it = unorderedMap.find(std::string_view(key));
+            return (it != unorderedMap.end()) ? &it->second : nullptr;
+        }
+    };
+
+    struct arena_sorted_vector_contender : arena_contender_base<>
+    {
+        static constexpr std::string_view name = "arena_sorted_vector";
+        std::vector<std::pair<string_handle, size_t>> sortedVector;
+
+        void build(std::span<const std::string> content)
+        {
+            reserve_arena(content);
+            for (size_t i = 0; i < content.size(); i++)
+            {
+                sortedVector.push_back({ arena.append(content[i]), i });
+            }
+
+            arena_less less{ &arena };
+            std::sort(sortedVector.begin(), sortedVector.end(), [&](auto const& a, auto const& b) {
+                return less(a.first, b.first);
+            });
+        }
+
+        size_t const* find(std::string const& key) const
+        {
+            std::string_view probe(key);
+            arena_less less{ &arena };
+            auto it = std::lower_bound(sortedVector.begin(), sortedVector.end(), probe, [&](auto const& pair, std::string_view value) {
+                return less(pair.first, value);
+            });
+            return ((it != sortedVector.end()) && (arena.view(it->first) == probe)) ? &it->second : nullptr;
+        }
+    };
+
+    // Allocator serves both the arena's characters and the map's slots.
+    template<typename Allocator = std::allocator<char>> struct arena_flat_hash_map_contender : arena_contender_base<basic_string_arena<Allocator>>
+    {
+        using arena_type = basic_string_arena<Allocator>;
+        using slot_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<std::pair<string_handle, size_t>>;
+
+        static constexpr std::string_view name = "arena_flat_hash_map";
+        flat_hash_map<string_handle, size_t, basic_arena_hash<arena_type>, basic_arena_equal<arena_type>, slot_allocator> flatMap{
+            basic_arena_hash<arena_type>{ &this->arena }, basic_arena_equal<arena_type>{ &this->arena } };
+
+        void build(std::span<const std::string> content)
+        {
+            this->reserve_arena(content);
+            flatMap.reserve(content.size());
+            for (size_t i = 0; i < content.size(); i++)
+            {
+                flatMap.insert(this->arena.append(content[i]), i);
+            }
+        }
+
+        size_t const* find(std::string const& key) const
+        {
+            return flatMap.find(std::string_view(key));
+        }
+    };
+
+    // Joins two names as "a/b" at compile time.
+    template<std::string_view const& A, std::string_view const& B> struct joined_name
+    {
+        static constexpr auto storage = [] {
+            std::array<char, A.size() + 1 + B.size()> joined{};
+            std::copy(A.begin(), A.end(), joined.begin());
+            joined[A.size()] = '/';
+            std::copy(B.begin(), B.end(), joined.begin() + A.size() + 1);
+            return joined;
+        }();
+        static constexpr std::string_view value{ storage.data(), storage.size() };
+    };
+
+    // A contender rebuilt around one of the string kernels in string_kernels.h, named "<contender>/<kernel>". It
+    // runs when its kernel is listed in --kernels and the contender itself is wanted.
+    template<typename TContender, typename TKernel> struct kernel_variant : TContender
+    {
+        static constexpr std::string_view base_name = TContender::name;
+        static constexpr std::string_view kernel = TKernel::name;
+        static constexpr std::string_view name = joined_name<TContender::name, TKernel::name>::value;
+    };
+
+    template<hash_kernel Kernel> using hash_kernel_variants = std::tuple<
+        kernel_variant<unordered_map_contender<std::string, kernel_hash<Kernel>>, kernel_hash<Kernel>>,
+        kernel_variant<flat_hash_map_contender<std::string, kernel_hash<Kernel>>, kernel_hash<Kernel>>,
+        kernel_variant<perfect_hash_contender<std::string, kernel_hash<Kernel>>, kernel_hash<Kernel>>>;
+
+    template<compare_kernel Kernel> using compare_kernel_variants = std::tuple<
+        kernel_variant<map_contender<std::string, kernel_less<Kernel>>, kernel_less<Kernel>>,
+        kernel_variant<sorted_vector_contender<std::string, kernel_less<Kernel>>, kernel_less<Kernel>>>;
+
+    // A contender built in bulk rather than one insert at a time, named "<contender>/<strategy>". It runs when
+    // --bulk-load is given and the contender itself is wanted; TBulk derives from the contender and replaces build.
+    template<typename TContender, typename TBulk> struct bulk_variant : TBulk
+    {
+        static constexpr std::string_view base_name = TContender::name;
+        static constexpr std::string_view bulk = TBulk::strategy;
+        static constexpr std::string_view name = joined_name<TContender::name, TBulk::strategy>::value;
+    };
+
+    // Sorts the pairs first, then appends each one at end() so every insert is an amortized constant-time hint.
+    template<typename T> struct map_sorted_bulk : map_contender<T>
+    {
+        static constexpr std::string_view strategy = "sorted_bulk";
+
+        void build(std::span<const T> content)
+        {
+            auto pairs = indexed_pairs(content);
+            parallel_sort(pairs.begin(), pairs.end(), [](auto const& a, auto const& b) { return a.first < b.first; });
+            for (auto& pair : pairs)
+            {
+                this->map.emplace_hint(this->map.end(), std::move(pair.first), pair.second);
+            }
+        }
+    };
+
+    // Sizes the bucket array once instead of rehashing as it grows.
+    template<typename T> struct unordered_map_reserved : unordered_map_contender<T>
+    {
+        static constexpr std::string_view strategy = "reserved";
+
+        void build(std::span<const T> content)
+        {
+            this->unorderedMap.reserve(content.size());
+            for (size_t i = 0; i < content.size(); i++)
+            {
+                this->unorderedMap.emplace(content[i], i);
+            }
+        }
+    };
+
+    // Fills a pre-sized vector and sorts it on every hardware thread.
+    template<typename T> struct sorted_vector_parallel_sort : sorted_vector_contender<T>
+    {
+        static constexpr std::string_view strategy = "parallel_sort";
+
+        void build(std::span<const T> content)
+        {
+            this->sortedVector = indexed_pairs(content);
+            parallel_sort(this->sortedVector.begin(), this->sortedVector.end(), [](auto const& a, auto const& b) { return a.first < b.first; });
+        }
+    };
+
+    template<typename T> using bulk_variants = std::tuple<
+        bulk_variant<map_contender<T>, map_sorted_bulk<T>>,
+        bulk_variant<unordered_map_contender<T>, unordered_map_reserved<T>>,
+        bulk_variant<sorted_vector_contender<T>, sorted_vector_parallel_sort<T>>>;
+
+    inline constexpr std::string_view huge_pages_suffix = "huge_pages";
+
+    // A contender whose storage comes from huge_page_allocator, named "<contender>/huge_pages". It runs when
+    // --huge-pages is given and the contender itself is wanted; THuge is the contender with the allocator swapped.
+    template<typename TContender, typename THuge> struct huge_page_variant : THuge
+    {
+        static constexpr std::string_view base_name = TContender::name;
+        static constexpr std::string_view huge_pages = huge_pages_suffix;
+        static constexpr std::string_view name = joined_name<TContender::name, huge_pages_suffix>::value;
+    };
+
+    template<typename T> using huge_page_pair_allocator = huge_page_allocator<std::pair<T, size_t>>;
+
+    template<typename T> using huge_page_variants = std::tuple<
+        huge_page_variant<sorted_vector_contender<T>, sorted_vector_contender<T, std::less<T>, huge_page_pair_allocator<T>>>,
+        huge_page_variant<flat_hash_map_contender<T>, flat_hash_map_contender<T, flat_hash<T>, huge_page_pair_allocator<T>>>>;
+
+    // Contenders that only apply to one key type.
+    template<typename T> struct key_specific_contenders
+    {
+        using type = std::tuple<>;
+    };
+
+    template<> struct key_specific_contenders<std::string>
+    {
+        using type = decltype(std::tuple_cat(
+            std::declval<std::tuple<arena_map_contender, arena_unordered_map_contender, arena_sorted_vector_contender, arena_flat_hash_map_contender<>>>(),
+            std::declval<std::tuple<huge_page_variant<arena_flat_hash_map_contender<>, arena_flat_hash_map_contender<huge_page_allocator<char>>>>>(),
+            std::declval<hash_kernel_variants<hash_kernel::wyhash>>(),
+            std::declval<hash_kernel_variants<hash_kernel::crc32>>(),
+            std::declval<hash_kernel_variants<hash_kernel::aes>>(),
+            std::declval<compare_kernel_variants<compare_kernel::simd>>()));
+    };
+
+    template<typename T> using contender_list = decltype(std::tuple_cat(std::declval<std::tuple<
+        map_contender<T>,
+        unordered_map_contender<T>,
+        sorted_vector_contender<T>,
+        flat_hash_map_contender<T>,
+        eytzinger_contender<T>,
+        s_tree_contender<T>,
+        perfect_hash_contender<T>>>(), std::declval<bulk_variants<T>>(), std::declval<huge_page_variants<T>>(),
+        std::declval<typename key_specific_contenders<T>::type>()));
+
+    template<typename TContender, typename T> concept batch_contender = requires(TContender const& c, std::span<const T> keys, std::span<size_t const*> results)
+    {
+        c.find_batch(keys, results);
+    };
+
+    // Invokes fn.template operator()<Contender>() for every contender registered for T, in list order.
+    template<typename T, typename Fn> void for_each_contender(Fn&& fn)
+    {
+        [&]<size_t... I>(std::index_sequence<I...>) {
+            (fn.template operator()<std::tuple_element_t<I, contender_list<T>>>(), ...);
+        }(std::make_index_sequence<std::tuple_size_v<contender_list<T>>>{});
+    }
+
+    // The names of all the registered contenders. The string list is a superset of the uint32 one.
+    inline auto contender_names()
+    {
+        std::vector<std::string_view> names;
+        for_each_contender<std::string>([&]<typename TContender>() { names.push_back(TContender::name); });
+        return names;
+    }
+}
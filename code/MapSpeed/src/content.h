@@ -0,0 +1,110 @@
+#pragma once
+
+#include "bulk_load.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace map_speed
+{
+    inline std::random_device g_randomDevice;
+    inline std::mt19937 g_random(g_randomDevice());
+
+    // Reseeds the shared generator so a run can be reproduced exactly.
+    inline void seedRandom(uint32_t seed)
+    {
+        g_random.seed(seed);
+    }
+
+    template<typename T, typename Rng>
+    T generateRandom(Rng& rng);
+
+    // Generates a random string of length between 5 and 20
+    template<> inline std::string generateRandom<std::string>(std::mt19937& rng)
+    {
+        std::string randomString;
+        int length = rng() % 15 + 5;
+        for (int i = 0; i < length; i++)
+        {
+            randomString += static_cast<char>(rng() % 26 + 65);
+        }
+        return randomString;
+    }
+
+    // Generates a random integer
+    template<> inline uint32_t generateRandom<uint32_t>(std::mt19937& rng)
+    {
+        return static_cast<uint32_t>(rng());
+    }
+
+    template<typename T> auto generateRandom()
+    {
+        return generateRandom<T>(g_random);
+    }
+
+    // Sorts content and removes duplicates, on every hardware thread once it is large enough.
+    template<typename T> void sortUnique(std::vector<T>& content)
+    {
+        if constexpr (std::is_same_v<T, uint32_t>)
+        {
+            parallel_radix_sort(content);
+        }
+        else
+        {
+            parallel_sort(content.begin(), content.end(), std::less<T>{});
+        }
+        parallel_unique(content);
+    }
+
+    // Items drawn from each independently seeded generator when content is generated in parallel. Fixing the
+    // chunk (rather than the thread) a stream belongs to keeps --seed runs identical whatever the thread count.
+    inline constexpr uint64_t content_chunk_size = 65536;
+
+    // Generates a vector of unique random values, given an input length. Duplicates are removed, so the result
+    // may be slightly shorter than requested.
+    //
+    // Up to one chunk is drawn straight from g_random, as always. Larger content is drawn in chunks, each from
+    // its own generator seeded from g_random and the chunk index, with the chunks spread over every hardware
+    // thread; the sort and dedup that follow are parallel too.
+    template<typename T> std::vector<T> generateContent(uint64_t length)
+    {
+        std::vector<T> randomContent;
+        if (length <= content_chunk_size)
+        {
+            randomContent.reserve(length);
+            for (uint64_t i = 0; i < length; i++)
+            {
+                randomContent.push_back(generateRandom<T>());
+            }
+        }
+        else
+        {
+            randomContent.resize(length);
+            auto base = static_cast<uint32_t>(g_random());
+            auto chunks = (length + content_chunk_size - 1) / content_chunk_size;
+            auto threads = std::min<uint64_t>(default_sort_threads(), chunks);
+            run_parallel(threads, [&](size_t thread) {
+                for (auto chunk = thread; chunk < chunks; chunk += threads)
+                {
+                    std::seed_seq seed{ base, static_cast<uint32_t>(chunk), static_cast<uint32_t>(chunk >> 32) };
+                    std::mt19937 rng(seed);
+                    auto end = std::min(length, (chunk + 1) * content_chunk_size);
+                    for (auto i = chunk * content_chunk_size; i < end; i++)
+                    {
+                        randomContent[i] = generateRandom<T>(rng);
+                    }
+                }
+            });
+        }
+
+        // Sort the set, then remove duplicates.
+        sortUnique(randomContent);
+        std::shuffle(randomContent.begin(), randomContent.end(), g_random);
+
+        return randomContent;
+    }
+}
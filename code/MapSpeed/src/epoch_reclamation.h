@@ -0,0 +1,203 @@
+#pragma once
+
+#include "prefetch.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+/*
+    Epoch-based reclamation for structures with lock-free readers.
+
+    A reader pins the current global epoch for the duration of its traversal. A writer that unlinks an object
+    retires it, tagged with the epoch at the time of retirement, instead of freeing it. The global epoch only
+    advances once every pinned thread has observed the current epoch, so after two advances no reader that
+    could have seen a retired object is still running and it can be freed.
+
+    There is one process-wide domain; each thread claims one of max_threads cache-line-sized slots the first
+    time it pins, and gives it back when it exits.
+*/
+namespace map_speed
+{
+    class epoch_domain
+    {
+    public:
+        static constexpr size_t max_threads = 256;
+
+        static epoch_domain& global()
+        {
+            static epoch_domain domain;
+            return domain;
+        }
+
+        ~epoch_domain()
+        {
+            for (auto const& r : m_retired)
+            {
+                r.deleter(r.object);
+            }
+        }
+
+        // Keeps every object reachable when the guard was taken alive until it is destroyed. Guards nest.
+        class guard
+        {
+        public:
+            explicit guard(epoch_domain& domain) : m_domain(domain)
+            {
+                m_domain.enter();
+            }
+
+            ~guard()
+            {
+                m_domain.leave();
+            }
+
+            guard(guard const&) = delete;
+            guard& operator=(guard const&) = delete;
+
+        private:
+            epoch_domain& m_domain;
+        };
+
+        guard pin()
+        {
+            return guard(*this);
+        }
+
+        // Hands object to the domain; deleter(object) runs once no pinned reader can still reach it.
+        void retire(void* object, void (*deleter)(void*))
+        {
+            std::lock_guard lock(m_retireLock);
+            m_retired.push_back({ object, deleter, m_epoch.load(std::memory_order_seq_cst) });
+            if (m_retired.size() >= reclaim_threshold)
+            {
+                reclaim_locked();
+            }
+        }
+
+        template<typename T> void retire(T* object)
+        {
+            retire(object, [](void* p) { delete static_cast<T*>(p); });
+        }
+
+        void try_reclaim()
+        {
+            std::lock_guard lock(m_retireLock);
+            reclaim_locked();
+        }
+
+    private:
+        static constexpr size_t reclaim_threshold = 64;
+        static constexpr uint64_t quiescent = 0;
+
+        struct alignas(cache_line_size) slot
+        {
+            std::atomic<uint64_t> epoch{ quiescent };
+            std::atomic<bool> used{ false };
+        };
+
+        struct retired_object
+        {
+            void* object;
+            void (*deleter)(void*);
+            uint64_t epoch;
+        };
+
+        // Per-thread registration; releases the slot when the thread exits.
+        struct thread_state
+        {
+            slot* threadSlot = nullptr;
+            uint32_t depth = 0;
+
+            ~thread_state()
+            {
+                if (threadSlot)
+                {
+                    threadSlot->epoch.store(quiescent, std::memory_order_release);
+                    threadSlot->used.store(false, std::memory_order_release);
+                }
+            }
+        };
+
+        static thread_state& this_thread()
+        {
+            thread_local thread_state state;
+            return state;
+        }
+
+        slot& claim_slot()
+        {
+            for (auto& s : m_slots)
+            {
+                bool expected = false;
+                if (!s.used.load(std::memory_order_relaxed) && s.used.compare_exchange_strong(expected, true))
+                {
+                    return s;
+                }
+            }
+            throw std::runtime_error("epoch_domain: more than max_threads concurrent threads");
+        }
+
+        void enter()
+        {
+            auto& state = this_thread();
+            if (state.depth++ == 0)
+            {
+                if (!state.threadSlot)
+                {
+                    state.threadSlot = &claim_slot();
+                }
+
+                // seq_cst so the published epoch is visible before any pointer the reader then loads.
+                state.threadSlot->epoch.store(m_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+            }
+        }
+
+        void leave()
+        {
+            auto& state = this_thread();
+            if (--state.depth == 0)
+            {
+                state.threadSlot->epoch.store(quiescent, std::memory_order_release);
+            }
+        }
+
+        void reclaim_locked()
+        {
+            // Advance if every pinned thread has caught up with the current epoch.
+            auto current = m_epoch.load(std::memory_order_seq_cst);
+            bool canAdvance = true;
+            for (auto const& s : m_slots)
+            {
+                auto e = s.epoch.load(std::memory_order_seq_cst);
+                if ((e != quiescent) && (e != current))
+                {
+                    canAdvance = false;
+                    break;
+                }
+            }
+
+            if (canAdvance)
+            {
+                m_epoch.compare_exchange_strong(current, current + 1, std::memory_order_seq_cst);
+            }
+
+            auto now = m_epoch.load(std::memory_order_seq_cst);
+            std::erase_if(m_retired, [now](retired_object const& r) {
+                if (r.epoch + 2 <= now)
+                {
+                    r.deleter(r.object);
+                    return true;
+                }
+                return false;
+            });
+        }
+
+        std::atomic<uint64_t> m_epoch{ 1 };
+        slot m_slots[max_threads];
+        std::mutex m_retireLock;
+        std::vector<retired_object> m_retired;
+    };
+}
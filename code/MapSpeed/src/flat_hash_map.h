@@ -0,0 +1,328 @@
+#pragma once
+
+#include "prefetch.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MAP_SPEED_FLAT_GROUP_AVX2 1
+#elif defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define MAP_SPEED_FLAT_GROUP_SSE2 1
+#endif
+
+/*
+    An open-addressing hash map in the style of Abseil's Swiss tables.
+
+    Storage is two parallel arrays: one control byte per slot, and the slots themselves. A control byte is
+    either kEmpty (0x80, top bit set) or the low 7 bits of the key's hash ("H2"). The remaining hash bits ("H1")
+    pick the first group of slots to probe. A lookup loads a whole group of control bytes at once, compares all
+    of them against H2 in one SIMD instruction, and only touches the slots whose control byte matched. Probing
+    stops at the first group that contains an empty byte.
+
+    Group width is 32 with AVX2, 16 with SSE2 and 8 (SWAR on a uint64_t) everywhere else. Groups are aligned, so
+    no cloned control bytes are needed. The table never erases, so there are no tombstones; the benchmark
+    containers are built once and then only read.
+*/
+namespace map_speed
+{
+    // Hashers whose low 7 bits and high bits are both well mixed. std::hash is the identity for integers on the
+    // common standard libraries, which would put every small key in the same H2 bucket.
+    template<typename T> struct flat_hash;
+
+    inline uint64_t flat_hash_mix(uint64_t v)
+    {
+        // Fold the 128-bit product of the golden-ratio constant: the high half feeds H1, the low half H2.
+        constexpr uint64_t k = 0x9E3779B97F4A7C15ull;
+#if defined(__SIZEOF_INT128__)
+        auto product = static_cast<unsigned __int128>(v) * k;
+        return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+#else
+        v ^= v >> 33;
+        v *= k;
+        v ^= v >> 29;
+        return v;
+#endif
+    }
+
+    template<> struct flat_hash<uint32_t>
+    {
+        uint64_t operator()(uint32_t v) const
+        {
+            return flat_hash_mix(v);
+        }
+    };
+
+    template<> struct flat_hash<std::string>
+    {
+        using is_transparent = void;
+
+        uint64_t operator()(std::string_view s) const
+        {
+            return flat_hash_mix(std::hash<std::string_view>{}(s));
+        }
+    };
+
+    namespace flat_hash_detail
+    {
+        constexpr int8_t kEmpty = static_cast<int8_t>(0x80);
+
+#if defined(MAP_SPEED_FLAT_GROUP_AVX2)
+        struct group
+        {
+            static constexpr size_t width = 32;
+            static constexpr int shift = 0;     // bitmask bit i is slot i
+            __m256i ctrl;
+
+            explicit group(int8_t const* p) : ctrl(_mm256_load_si256(reinterpret_cast<__m256i const*>(p))) {}
+            uint32_t match(int8_t h2) const { return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_set1_epi8(h2), ctrl))); }
+            uint32_t match_empty() const { return static_cast<uint32_t>(_mm256_movemask_epi8(ctrl)); }
+        };
+#elif defined(MAP_SPEED_FLAT_GROUP_SSE2)
+        struct group
+        {
+            static constexpr size_t width = 16;
+            static constexpr int shift = 0;
+            __m128i ctrl;
+
+            explicit group(int8_t const* p) : ctrl(_mm_load_si128(reinterpret_cast<__m128i const*>(p))) {}
+            uint32_t match(int8_t h2) const { return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl))); }
+            uint32_t match_empty() const { return static_cast<uint32_t>(_mm_movemask_epi8(ctrl)); }
+        };
+#else
+        struct group
+        {
+            static constexpr size_t width = 8;
+            static constexpr int shift = 3;     // bitmask bit 8*i+7 is slot i
+            static constexpr uint64_t lsbs = 0x0101010101010101ull;
+            static constexpr uint64_t msbs = 0x8080808080808080ull;
+            uint64_t ctrl;
+
+            explicit group(int8_t const* p) { std::memcpy(&ctrl, p, sizeof(ctrl)); }
+
+            // The classic "has zero byte" trick. It can report a false positive in the byte above a true match;
+            // that only costs one extra key comparison.
+            uint64_t match(int8_t h2) const
+            {
+                auto x = ctrl ^ (lsbs * static_cast<uint8_t>(h2));
+                return (x - lsbs) & ~x & msbs;
+            }
+
+            uint64_t match_empty() const { return ctrl & msbs; }
+        };
+#endif
+    }
+
+    template<typename K, typename V, typename Hash = flat_hash<K>, typename KeyEqual = std::equal_to<>,
+        typename Allocator = std::allocator<std::pair<K, V>>>
+    class flat_hash_map
+    {
+        using group = flat_hash_detail::group;
+
+        // Control bytes are loaded a group at a time with aligned loads.
+        struct alignas(group::width) ctrl_block
+        {
+            int8_t bytes[group::width];
+        };
+        using block_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<ctrl_block>;
+
+    public:
+        using key_type = K;
+        using mapped_type = V;
+        using value_type = std::pair<K, V>;
+
+        flat_hash_map() = default;
+        explicit flat_hash_map(Allocator const& allocator) : m_ctrl(block_allocator(allocator)), m_slots(allocator) {}
+        flat_hash_map(Hash const& hash, KeyEqual const& equal, Allocator const& allocator = Allocator())
+            : m_ctrl(block_allocator(allocator)), m_slots(allocator), m_hash(hash), m_equal(equal) {}
+
+        size_t size() const { return m_size; }
+        size_t capacity() const { return m_slots.size(); }
+        bool empty() const { return m_size == 0; }
+
+        // Grows the table so count elements fit without exceeding the 7/8 maximum load factor.
+        void reserve(size_t count)
+        {
+            size_t wanted = group::width;
+            while (wanted - wanted / 8 < count)
+            {
+                wanted *= 2;
+            }
+
+            if (wanted > capacity())
+            {
+                rehash(wanted);
+            }
+        }
+
+        // Inserts (key, value) if key is not already present. Returns the mapped value and whether it was inserted.
+        std::pair<V*, bool> insert(K key, V value)
+        {
+            if (auto existing = find(key))
+            {
+                return { existing, false };
+            }
+
+            if (m_size + 1 > capacity() - capacity() / 8)
+            {
+                rehash((capacity() == 0) ? group::width : capacity() * 2);
+            }
+
+            auto slot = insert_unique(hash(key), std::move(key), std::move(value));
+            return { &m_slots[slot].second, true };
+        }
+
+        V& operator[](K const& key)
+        {
+            return *insert(key, V{}).first;
+        }
+
+        template<typename TKey> V const* find(TKey const& key) const
+        {
+            return const_cast<flat_hash_map*>(this)->find(key);
+        }
+
+        template<typename TKey> V* find(TKey const& key)
+        {
+            if (m_size == 0)
+            {
+                return nullptr;
+            }
+
+            return find_hashed(key, hash(key));
+        }
+
+        // Looks up keys[i] into results[i] (nullptr when absent). Keys are handled batch_width at a time: every
+        // key in a batch is hashed and its first control group and slots prefetched before any is probed, so the
+        // cache misses of independent lookups overlap instead of being paid one after another.
+        static constexpr size_t batch_width = 16;
+
+        template<typename TKey> void find_batch(std::span<const TKey> keys, std::span<V const*> results) const
+        {
+            if (m_size == 0)
+            {
+                std::ranges::fill(results, nullptr);
+                return;
+            }
+
+            uint64_t hashes[batch_width];
+            auto groupMask = group_count() - 1;
+            for (size_t base = 0; base < keys.size(); base += batch_width)
+            {
+                auto count = std::min(batch_width, keys.size() - base);
+                for (size_t i = 0; i < count; i++)
+                {
+                    hashes[i] = hash(keys[base + i]);
+                    auto g = static_cast<size_t>(hashes[i] >> 7) & groupMask;
+                    prefetch_read(m_ctrl[g].bytes);
+                    prefetch_read(&m_slots[g * group::width]);
+                }
+
+                for (size_t i = 0; i < count; i++)
+                {
+                    results[base + i] = const_cast<flat_hash_map*>(this)->find_hashed(keys[base + i], hashes[i]);
+                }
+            }
+        }
+
+    private:
+        template<typename TKey> V* find_hashed(TKey const& key, uint64_t h)
+        {
+            auto h2 = static_cast<int8_t>(h & 0x7F);
+            auto groupMask = group_count() - 1;
+            auto g = static_cast<size_t>(h >> 7) & groupMask;
+            for (size_t step = 1; ; step++)
+            {
+                group grp(m_ctrl[g].bytes);
+                for (auto bits = grp.match(h2); bits != 0; bits &= bits - 1)
+                {
+                    auto slot = g * group::width + (std::countr_zero(bits) >> group::shift);
+                    if (m_equal(m_slots[slot].first, key))
+                    {
+                        return &m_slots[slot].second;
+                    }
+                }
+
+                if (grp.match_empty() != 0)
+                {
+                    return nullptr;
+                }
+
+                // Triangular probing visits every group exactly once when the group count is a power of two.
+                g = (g + step) & groupMask;
+            }
+        }
+
+        template<typename TKey> uint64_t hash(TKey const& key) const
+        {
+            return static_cast<uint64_t>(m_hash(key));
+        }
+
+        size_t group_count() const
+        {
+            return m_ctrl.size();
+        }
+
+        size_t insert_unique(uint64_t h, K&& key, V&& value)
+        {
+            auto groupMask = group_count() - 1;
+            auto g = static_cast<size_t>(h >> 7) & groupMask;
+            for (size_t step = 1; ; step++)
+            {
+                if (auto empties = group(m_ctrl[g].bytes).match_empty())
+                {
+                    auto index = std::countr_zero(empties) >> group::shift;
+                    m_ctrl[g].bytes[index] = static_cast<int8_t>(h & 0x7F);
+                    auto slot = g * group::width + index;
+                    m_slots[slot].first = std::move(key);
+                    m_slots[slot].second = std::move(value);
+                    m_size++;
+                    return slot;
+                }
+
+                g = (g + step) & groupMask;
+            }
+        }
+
+        void rehash(size_t newCapacity)
+        {
+            auto oldCtrl = std::move(m_ctrl);
+            auto oldSlots = std::move(m_slots);
+
+            ctrl_block emptyBlock;
+            std::memset(emptyBlock.bytes, static_cast<uint8_t>(flat_hash_detail::kEmpty), sizeof(emptyBlock.bytes));
+            m_ctrl = std::vector<ctrl_block, block_allocator>(newCapacity / group::width, emptyBlock, oldCtrl.get_allocator());
+            m_slots = std::vector<value_type, Allocator>(newCapacity, oldSlots.get_allocator());
+            m_size = 0;
+
+            for (size_t g = 0; g < oldCtrl.size(); g++)
+            {
+                for (size_t i = 0; i < group::width; i++)
+                {
+                    if (oldCtrl[g].bytes[i] != flat_hash_detail::kEmpty)
+                    {
+                        auto& slot = oldSlots[g * group::width + i];
+                        insert_unique(hash(slot.first), std::move(slot.first), std::move(slot.second));
+                    }
+                }
+            }
+        }
+
+        std::vector<ctrl_block, block_allocator> m_ctrl;
+        std::vector<value_type, Allocator> m_slots;
+        size_t m_size = 0;
+        Hash m_hash;
+        KeyEqual m_equal;
+    };
+}
@@ -0,0 +1,174 @@
+#include "huge_pages.h"
+#include "memory_accounting.h"
+
+#include <atomic>
+#include <new>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fstream>
+#include <sstream>
+#endif
+
+namespace map_speed
+{
+    namespace
+    {
+        std::atomic<uint64_t> g_mappedBytes[3]{};
+
+        void tally(page_backing backing, size_t bytes)
+        {
+            g_mappedBytes[static_cast<int>(backing)].fetch_add(bytes, std::memory_order_relaxed);
+        }
+
+        // Every region is a whole number of huge pages, whichever backing it got, so freeing needs no record of
+        // which one that was.
+        size_t region_granularity()
+        {
+            static size_t const granularity = [] {
+#if defined(_WIN32)
+                auto large = GetLargePageMinimum();
+                return (large != 0) ? static_cast<size_t>(large) : size_t{ 2 } << 20;
+#else
+                // "Hugepagesize:       2048 kB" in /proc/meminfo is the size MAP_HUGETLB hands out.
+                size_t kilobytes = 2048;
+                std::ifstream meminfo("/proc/meminfo");
+                std::string line;
+                while (std::getline(meminfo, line))
+                {
+                    if (line.rfind("Hugepagesize:", 0) == 0)
+                    {
+                        std::istringstream(line.substr(13)) >> kilobytes;
+                        break;
+                    }
+                }
+                return kilobytes * 1024;
+#endif
+            }();
+            return granularity;
+        }
+
+        size_t region_length(size_t bytes)
+        {
+            auto granularity = region_granularity();
+            return (bytes + granularity - 1) / granularity * granularity;
+        }
+
+#if defined(_WIN32)
+        void* map_region(size_t length, page_backing& backing)
+        {
+            if (auto p = VirtualAlloc(nullptr, length, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE))
+            {
+                backing = page_backing::huge;
+                return p;
+            }
+
+            backing = page_backing::small;
+            return VirtualAlloc(nullptr, length, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        }
+
+        void unmap_region(void* p, size_t)
+        {
+            VirtualFree(p, 0, MEM_RELEASE);
+        }
+#else
+        void* map_region(size_t length, page_backing& backing)
+        {
+#if defined(MAP_HUGETLB)
+            auto p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED)
+            {
+                backing = page_backing::huge;
+                return p;
+            }
+#endif
+
+            // Over-allocate by one huge page and trim both ends so the region starts on a huge page boundary,
+            // which transparent huge pages need.
+            auto granularity = region_granularity();
+            auto raw = mmap(nullptr, length + granularity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (raw == MAP_FAILED)
+            {
+                return nullptr;
+            }
+
+            auto start = reinterpret_cast<uintptr_t>(raw);
+            auto aligned = (start + granularity - 1) / granularity * granularity;
+            if (aligned > start)
+            {
+                munmap(raw, aligned - start);
+            }
+            if (auto tail = (start + length + granularity) - (aligned + length))
+            {
+                munmap(reinterpret_cast<void*>(aligned + length), tail);
+            }
+
+            backing = page_backing::small;
+#if defined(MADV_HUGEPAGE)
+            if (madvise(reinterpret_cast<void*>(aligned), length, MADV_HUGEPAGE) == 0)
+            {
+                backing = page_backing::transparent;
+            }
+#endif
+            return reinterpret_cast<void*>(aligned);
+        }
+
+        void unmap_region(void* p, size_t length)
+        {
+            munmap(p, length);
+        }
+#endif
+    }
+
+    huge_page_usage huge_page_totals()
+    {
+        return {
+            g_mappedBytes[static_cast<int>(page_backing::small)].load(std::memory_order_relaxed),
+            g_mappedBytes[static_cast<int>(page_backing::transparent)].load(std::memory_order_relaxed),
+            g_mappedBytes[static_cast<int>(page_backing::huge)].load(std::memory_order_relaxed),
+        };
+    }
+
+    std::string page_backing_name(huge_page_usage const& before, huge_page_usage const& after)
+    {
+        std::string name;
+        auto add = [&](uint64_t was, uint64_t now, char const* backing) {
+            if (now != was)
+            {
+                name += (name.empty() ? "" : "+");
+                name += backing;
+            }
+        };
+        add(before.hugeBytes, after.hugeBytes, "huge");
+        add(before.transparentBytes, after.transparentBytes, "transparent");
+        add(before.smallBytes, after.smallBytes, "small");
+        return name.empty() ? "heap" : name;
+    }
+
+    void* huge_page_allocate(size_t bytes)
+    {
+        auto length = region_length(bytes);
+        page_backing backing;
+        auto p = map_region(length, backing);
+        if (!p)
+        {
+            throw std::bad_alloc();
+        }
+
+        tally(backing, length);
+        note_mapped_allocation(length);
+        return p;
+    }
+
+    void huge_page_free(void* p, size_t bytes)
+    {
+        if (p)
+        {
+            auto length = region_length(bytes);
+            note_mapped_free(length);
+            unmap_region(p, length);
+        }
+    }
+}
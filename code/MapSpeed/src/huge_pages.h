@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/*
+    Huge-page backed memory for large lookup tables.
+
+    At a few hundred thousand entries a table spans thousands of 4KB pages, more than the dTLB holds, so random
+    lookups pay a page walk on top of their cache miss. Backing the table with 2MB pages cuts the number of
+    translations by 512.
+
+    huge_page_allocate maps a region directly from the OS, trying in order:
+
+        Linux    MAP_HUGETLB from the reserved pool (vm.nr_hugepages), then an ordinary mapping aligned to 2MB
+                 with madvise(MADV_HUGEPAGE) so transparent huge pages can back it
+        Windows  VirtualAlloc with MEM_LARGE_PAGES (needs SeLockMemoryPrivilege), then ordinary pages
+        others   an ordinary anonymous mapping
+
+    The backing actually obtained is tallied, so a benchmark can say which one its table got. Regions count
+    towards the current allocation_scope (memory_accounting.h) like heap blocks do.
+
+    huge_page_allocator is a standard allocator over it for containers. Requests below huge_page_min_bytes are
+    not worth a whole huge page and go to the ordinary heap.
+*/
+namespace map_speed
+{
+    enum class page_backing
+    {
+        small,          // ordinary pages
+        transparent,    // ordinary mapping advised for transparent huge pages; the kernel may or may not comply
+        huge,           // explicit huge or large pages
+    };
+
+    // Bytes mapped so far through huge_page_allocate, by backing. The totals only grow, so the difference of two
+    // snapshots is what was mapped in between.
+    struct huge_page_usage
+    {
+        uint64_t smallBytes = 0;
+        uint64_t transparentBytes = 0;
+        uint64_t hugeBytes = 0;
+    };
+
+    huge_page_usage huge_page_totals();
+
+    // Names the backings mapped between two snapshots, such as "huge", "transparent" or "huge+small"; "heap" when
+    // nothing was mapped because every request was below huge_page_min_bytes.
+    std::string page_backing_name(huge_page_usage const& before, huge_page_usage const& after);
+
+    inline constexpr size_t huge_page_min_bytes = size_t{ 1 } << 20;
+
+    // Throws std::bad_alloc when no mapping can be made at all.
+    void* huge_page_allocate(size_t bytes);
+    void huge_page_free(void* p, size_t bytes);
+
+    template<typename T> struct huge_page_allocator
+    {
+        using value_type = T;
+
+        huge_page_allocator() = default;
+        template<typename U> huge_page_allocator(huge_page_allocator<U> const&) {}
+
+        T* allocate(size_t n)
+        {
+            auto bytes = n * sizeof(T);
+            if (bytes < huge_page_min_bytes)
+            {
+                return std::allocator<T>().allocate(n);
+            }
+            return static_cast<T*>(huge_page_allocate(bytes));
+        }
+
+        void deallocate(T* p, size_t n)
+        {
+            auto bytes = n * sizeof(T);
+            if (bytes < huge_page_min_bytes)
+            {
+                std::allocator<T>().deallocate(p, n);
+            }
+            else
+            {
+                huge_page_free(p, bytes);
+            }
+        }
+
+        template<typename U> bool operator==(huge_page_allocator<U> const&) const { return true; }
+    };
+}
@@ -1,221 +1,67 @@
-// ConsoleApplication1.cpp : This file contains the 'main' function. Program execution begins and ends there.
+// map_speeds.cpp : Command-line front end for the lookup benchmark engine, plus the frozen compile-time datasets.
 //
-#include <iostream>
-#include <map>
-#include <chrono>
-#include <unordered_map>
 #include <array>
-#include <string>
-#include <span>
-#include <functional>
-#include <algorithm>
-#include <vector>
-#include <random>
+#include <fstream>
+#include <iostream>
 #include <frozen/unordered_map.h>
 #include <frozen/random.h>
 #include <frozen/map.h>
 
-std::random_device g_randomDevice;
-std::mt19937 g_random(g_randomDevice());
-
-template<typename T>
-auto generateRandom();
-
+#include "bench_engine.h"
+#include "memory_accounting.h"
+#include "static_lookup.h"
+#include "static_tables.h"
 
-
-// Generates a random string of length between 5 and 20
-template<> auto generateRandom<std::string>()
+// Route the global allocator through the counters of memory_accounting.h, so allocation_scope sees every heap
+// block the containers make. The array, nothrow and sized forms all forward to these by default.
+void* operator new(size_t size)
 {
-    std::string randomString;
-    int length = g_random() % 15 + 5;
-    for (int i = 0; i < length; i++)
-    {
-        randomString += g_random() % 26 + 65;
-    }
-    return randomString;
+    return map_speed::counted_allocate(size);
 }
 
-// Generates a random integer
-template<> auto generateRandom<uint32_t>()
+void operator delete(void* p) noexcept
 {
-    return g_random();
+    map_speed::counted_free(p);
 }
 
-// Generates a vector of random strings, given an input length
-template<typename T> std::vector<T> generateContent(uint64_t length)
+void operator delete(void* p, size_t) noexcept
 {
-    std::vector<T> randomContent;
-    for (int i = 0; i < length; i++)
-    {
-        randomContent.push_back(generateRandom<T>());
-    }
-
-    // Sort the set, then remove duplicates.
-    std::sort(randomContent.begin(), randomContent.end());
-    randomContent.erase(std::unique(randomContent.begin(), randomContent.end()), randomContent.end());
-    std::shuffle(randomContent.begin(), randomContent.end(), g_random);
-
-    return randomContent;
+    map_speed::counted_free(p);
 }
 
-struct timer {
-    std::chrono::high_resolution_clock::time_point start;
-    std::chrono::high_resolution_clock::time_point end;
-
-    timer() : start(std::chrono::high_resolution_clock::now()) {}
-
-    void stop()
-    {
-        end = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double> elapsed = end - start;
-    }
-
-    double duration()
-    {
-        return std::chrono::duration_cast<std::chrono::duration<double>>(end - start).count();
-    }
-};
-
-// Given an input length, generates a vector of random strings. Creates a map, an unordered_map, and a sorted vector of
-// the strings.
-//
-// PossibleSpace is the maximum number of unique items that will be generated.
-// SearchCount is the number of items to search for in the map, unordered_map, and sorted vector.
-// CycleCount is the number of times to repeat the search operation of random items
-// unFoundCount is the set of unique items that will be excluded from the search operations, to simulate a "not found" condition.
-template<typename T> void generateMaps(uint64_t possibleSpace, uint64_t unFoundCount, uint64_t cycleCount)
+void* operator new(size_t size, std::align_val_t alignment)
 {
-    // Generate all the content, then split into possible & unfound chunks.
-    auto allContent = generateContent<T>(possibleSpace + unFoundCount);
-    auto collectionContent = std::vector(allContent.begin(), allContent.begin() + possibleSpace);
-    auto unFoundContent = std::vector(allContent.begin() + possibleSpace, allContent.end());
-    const auto totalOperations = cycleCount * allContent.size();
-    int sum = 0;
-    int missed = 0;
-
-    // Build the collections to search
-    std::map<T, int> map;
-    std::unordered_map<T, int> unorderedMap;
-    std::vector<std::pair<T, size_t>> sortedVector;
-    for (int i = 0; i < collectionContent.size(); i++)
-    {
-        sortedVector.push_back({ collectionContent[i], i });
-        map[collectionContent[i]] = i;
-        unorderedMap[collectionContent[i]] = i;
-    }
-
-    // Ensure the sorted vector is sorted
-    std::sort(sortedVector.begin(), sortedVector.end(), [](const auto& a, const auto& b) {
-        return a.first < b.first;
-    });
-
-    // And re-shuffle all the search content
-    std::shuffle(allContent.begin(), allContent.end(), g_random);
-
-    std::cout.precision(5);
-    std::cout << std::fixed;
-    std::cout << std::setw(25) << "Search Count: " << totalOperations << ", Total space: " << collectionContent.size() + unFoundContent.size() << ", Unfound items: " << unFoundCount << ", Cycle count: " << cycleCount << "\n";
-
-    // Start a precise timer. Look up the strings in the map, and determine the time difference.
-    auto map_timer = timer();
-    for (int i = 0; i < cycleCount; i++)
-    {
-        for (auto& j : allContent)
-        {
-            auto it = map.find(j);
-            if (it != map.end())
-            {
-                sum += it->second;
-            }
-            else
-            {
-                missed++;
-            }
-        }
-    }
-    map_timer.stop();
-    std::cout << "Sum: " << sum << "\n";
-
-    // Start a precise timer. Look up the strings in the unordered_map, and determine the time difference.
-    auto unordered_map_timer = timer();
-    for (int i = 0; i < cycleCount; i++)
-    {
-        for (auto& j : allContent)
-        {
-            auto it = unorderedMap.find(j);
-            if (it != unorderedMap.end())
-            {
-                sum += it->second;
-            }
-            else
-            {
-                missed++;
-            }
-        }
-    }
-    unordered_map_timer.stop();
+    return map_speed::counted_allocate_aligned(size, alignment);
+}
 
-    // Start a precise timer. Look up the strings in the sorted vector, and determine the time difference.
-    auto sorted_vector_timer = timer();
-    for (int i = 0; i < cycleCount; i++)
-    {
-        for (auto& j : allContent)
-        {
-            auto it = std::lower_bound(sortedVector.begin(), sortedVector.end(), j, [](auto& pair, auto& value) {
-                return pair.first < value;
-            });
-            if ((it != sortedVector.end()) && (it->first == j))
-            {
-                sum += it->second;
-            }
-            else
-            {
-                missed++;
-            }
-        }
-    }
-    sorted_vector_timer.stop();
-
-    // Output the time differences, and a "cycles per second" metric.
-    double map_time = map_timer.duration();
-    double unordered_map_time = unordered_map_timer.duration();
-    double sorted_vector_time = sorted_vector_timer.duration();
-
-    // Set the double-formatting output to be 15 characters long, with 2 decimal places.
-    std::cout << "Sum: " << sum << ", Missed: " << missed << "\n";
-    std::cout << std::setw(25) << "Map time: " << map_time << "s, " << std::setw(25) << ((double)totalOperations / map_time) << " cycles per second\n";
-    std::cout << std::setw(25) << "Sorted vector time: " << sorted_vector_time << "s, " << std::setw(25) << ((double)totalOperations / sorted_vector_time) << " cycles per second\n";
-    std::cout << std::setw(25) << "Unordered map time: " << unordered_map_time << "s, " << std::setw(25) << ((double)totalOperations / unordered_map_time) << " cycles per second\n";
-    std::cout << "\n";
+void operator delete(void* p, std::align_val_t alignment) noexcept
+{
+    map_speed::counted_free_aligned(p, alignment);
 }
 
-template<typename T> void driver(std::string_view subject)
+void operator delete(void* p, size_t, std::align_val_t alignment) noexcept
 {
-    std::cout << "Testing " << subject << "...\n";
-    generateMaps<T>(5, 2, 15);
-    generateMaps<T>(50, 5, 8);
-    generateMaps<T>(500, 50, 3);
-    generateMaps<T>(5000, 500, 3);
-    generateMaps<T>(500000, 1000, 3);
+    map_speed::counted_free_aligned(p, alignment);
 }
 
+using namespace map_speed;
 
 namespace compile_time
 {
-    template<size_t totalSize, size_t missCount> constexpr auto make_static_map_test()
+    template<size_t TotalSize, size_t MissCount> constexpr auto make_static_map_test()
     {
         frozen::default_prg_t rng;
         // Generate input random array
-        std::array<std::pair<uint32_t, uint32_t>, totalSize> random_array;
-        for (size_t i = 0; i < totalSize; ++i)
+        std::array<std::pair<uint32_t, uint32_t>, TotalSize> random_array;
+        for (size_t i = 0; i < TotalSize; ++i)
         {
             random_array[i].first = static_cast<uint32_t>(rng());
             random_array[i].second = i;
         }
 
         // Make a sorted array subset based on possibleSpace
-        std::array<std::pair<uint32_t, uint32_t>, totalSize - missCount> sorted_array;
-        std::copy_n(random_array.begin(), totalSize - missCount, sorted_array.begin());
+        std::array<std::pair<uint32_t, uint32_t>, TotalSize - MissCount> sorted_array;
+        std::copy_n(random_array.begin(), TotalSize - MissCount, sorted_array.begin());
         std::sort(sorted_array.begin(), sorted_array.end(), [](const auto& a, const auto& b) {
             return a.first < b.first;
             });
@@ -224,117 +70,221 @@ namespace compile_time
 
         struct map_test_data
         {
-            size_t totalSize = totalSize;
-            size_t missCount = missCount;
+            size_t totalSize;
+            size_t missCount;
             decltype(sorted_array) sortedArray;
             decltype(random_array) allContent;
             decltype(frozen::make_unordered_map(sorted_array)) unorderedMap;
             decltype(frozen::make_map(sorted_array)) map;
+            decltype(make_static_lookup(sorted_array)) staticLookup;
         };
 
         return map_test_data{
-            totalSize,
-            missCount,
+            TotalSize,
+            MissCount,
             sorted_array,
             random_array,
             frozen::make_unordered_map(sorted_array),
-            frozen::make_map(sorted_array)
+            frozen::make_map(sorted_array),
+            make_static_lookup(sorted_array)
         };
     };
 
-    template<typename T> void run_tests(T const& testData, uint32_t runs)
+    // find(key) returns a pointer to the value, or nullptr when the key is absent.
+    template<typename TFind, typename TContent> lookup_totals run_static_lookups(TFind const& find, TContent const& allContent, uint32_t runs)
     {
-        std::cout << "\nRunning (static) tests for totalSize = " << testData.totalSize << ", missCount = " << testData.missCount << ", runs = " << runs << "\n";
-
-        uint32_t totalLookups = runs * testData.allContent.size();
-        int sum = 0;
-        int missed = 0;
-
-        auto sorted_vector_timer = timer();
-        for (int i = 0; i < runs; i++)
+        lookup_totals totals;
+        for (uint32_t i = 0; i < runs; i++)
         {
-            for (const auto& j : testData.allContent)
+            for (const auto& j : allContent)
             {
-                auto it = std::lower_bound(testData.sortedArray.begin(), testData.sortedArray.end(), j.first, [](const auto& pair, const auto& value) {
-                    return pair.first < value;
-                });
-                if ((it != testData.sortedArray.end()) && (it->first == j.first))
+                if (auto found = find(j.first))
                 {
-                    sum += it->second;
+                    totals.sum += *found;
                 }
                 else
                 {
-                    missed++;
+                    totals.missed++;
                 }
             }
         }
-        sorted_vector_timer.stop();
+        return totals;
+    }
 
-        auto map_timer = timer();
-        for (int i = 0; i < runs; i++)
+    template<typename TContainer> auto find_value(TContainer const& container, uint32_t key)
+    {
+        auto it = container.find(key);
+        return (it != container.end()) ? &it->second : nullptr;
+    }
+
+    // The frozen containers (on datasets small enough for the compiler to build them) and static_lookup always run;
+    // the runtime layouts built from the same sorted array honor --containers.
+    template<typename T> std::vector<run_result> run_tests(T const& testData, uint32_t runs, bench_options const& options)
+    {
+        std::vector<run_result> results;
+
+        // Threaded runs give every thread its own shuffled copy of the search content.
+        std::vector<std::vector<std::pair<uint32_t, uint32_t>>> threadContent;
+        if (!options.threadCounts.empty())
         {
-            for (const auto& j : testData.allContent)
+            auto maxThreads = *std::max_element(options.threadCounts.begin(), options.threadCounts.end());
+            for (uint32_t t = 0; t < maxThreads; t++)
             {
-                auto it = testData.map.find(j.first);
-                if (it != testData.map.end())
-                {
-                    sum += it->second;
-                }
-                else
-                {
-                    missed++;
-                }
+                auto& stream = threadContent.emplace_back(testData.allContent.begin(), testData.allContent.end());
+                std::shuffle(stream.begin(), stream.end(), g_random);
             }
         }
-        map_timer.stop();
 
-        auto unordered_map_timer = timer();
-        for (int i = 0; i < runs; i++)
-        {
-            for (const auto& j : testData.allContent)
+        auto record = [&](std::string_view name, auto const& find) {
+            run_result r;
+            auto totals = measure(options.measure, r.timing, [&] {
+                return run_static_lookups(find, testData.allContent, runs);
+            });
+
+            r.container = name;
+            r.keyType = "uint32 (static)";
+            r.possibleSpace = testData.totalSize - testData.missCount;
+            r.unFoundCount = testData.missCount;
+            r.cycleCount = runs;
+            r.operations = static_cast<uint64_t>(runs) * testData.allContent.size();
+            r.missed = totals.missed;
+            r.sum = totals.sum;
+            results.push_back(std::move(r));
+
+            for (auto threadCount : options.threadCounts)
             {
-                auto it = testData.unorderedMap.find(j.first);
-                if (it != testData.unorderedMap.end())
-                {
-                    sum += it->second;
-                }
-                else
-                {
-                    missed++;
-                }
+                run_result threaded = results.back();
+                std::vector<double> threadSeconds;
+                auto threadTotals = measure(options.measure, threaded.timing, [&] {
+                    auto run = run_threaded<lookup_totals>(threadCount, [&](uint32_t t) {
+                        return run_static_lookups(find, threadContent[t], runs);
+                    });
+                    threadSeconds = std::move(run.threadSeconds);
+                    return self_timed<lookup_totals>{ run.combined, run.wallSeconds };
+                });
+
+                // Hardware counters only see the launching thread, so they say nothing about the workers.
+                threaded.timing.backend = counter_backend::none;
+                threaded.timing.counters.clear();
+                threaded.threads = threadCount;
+                threaded.operations *= threadCount;
+                threaded.missed = threadTotals.missed;
+                threaded.sum = threadTotals.sum;
+                threaded.threadSeconds = std::move(threadSeconds);
+                results.push_back(std::move(threaded));
             }
+        };
+
+        auto const& sortedArray = testData.sortedArray;
+        std::vector<std::pair<uint32_t, uint32_t>> sortedPairs(sortedArray.begin(), sortedArray.end());
+
+        if (options.wants_container("sorted_vector"))
+        {
+            record("sorted_vector", [&](uint32_t key) -> uint32_t const* {
+                auto it = std::lower_bound(sortedArray.begin(), sortedArray.end(), key, [](const auto& pair, const auto& value) {
+                    return pair.first < value;
+                });
+                return ((it != sortedArray.end()) && (it->first == key)) ? &it->second : nullptr;
+            });
+        }
+
+        if (options.wants_container("eytzinger"))
+        {
+            eytzinger_map<uint32_t, uint32_t> eytzinger(sortedPairs);
+            record("eytzinger", [&](uint32_t key) { return eytzinger.find(key); });
+        }
+
+        if (options.wants_container("s_tree"))
+        {
+            s_tree_map<uint32_t, uint32_t> sTree(sortedPairs);
+            record("s_tree", [&](uint32_t key) { return sTree.find(key); });
+        }
+
+        if (options.wants_container("perfect_hash"))
+        {
+            perfect_hash_map<uint32_t, uint32_t> perfectHash(sortedPairs);
+            record("perfect_hash", [&](uint32_t key) { return perfectHash.find(key); });
         }
-        unordered_map_timer.stop();
-
-        double map_time = map_timer.duration();
-        double unordered_map_time = unordered_map_timer.duration();
-        double sorted_vector_time = sorted_vector_timer.duration();
-        std::cout << "(Dump values: " << missed << ", " << sum << ")\n";
-        std::cout << std::setw(25) << "Map time: " << map_time << "s, " << std::setw(25) << ((double)totalLookups / map_time) << " cycles per second\n";
-        std::cout << std::setw(25) << "Sorted vector time: " << sorted_vector_time << "s, " << std::setw(25) << ((double)totalLookups / sorted_vector_time) << " cycles per second\n";
-        std::cout << std::setw(25) << "Unordered map time: " << unordered_map_time << "s, " << std::setw(25) << ((double)totalLookups / unordered_map_time) << " cycles per second\n";
-        std::cout << "\n";
+
+        if constexpr (requires { testData.map; })
+        {
+            record("frozen::map", [&](uint32_t key) { return find_value(testData.map, key); });
+            record("frozen::unordered_map", [&](uint32_t key) { return find_value(testData.unorderedMap, key); });
+        }
+
+        record("static_lookup/" + std::string(static_strategy_name(testData.staticLookup.strategy)),
+            [&](uint32_t key) { return testData.staticLookup.find(key); });
+        return results;
     }
 
     constexpr auto dataset_5_2 = make_static_map_test<5, 2>();
     constexpr auto dataset_50_5 = make_static_map_test<50, 5>();
     constexpr auto dataset_500_50 = make_static_map_test<500, 50>();
-    constexpr auto dataset_5000_500 = make_static_map_test<1000, 500>();
+    constexpr auto dataset_5000_500 = make_static_map_test<5000, 500>();
 
-    void driver()
+    // Larger datasets exceed the constexpr budget; static-table-gen generates them at build time (static_tables.h).
+    constexpr generated::table_10000_1000 dataset_10000_1000;
+    constexpr generated::table_100000_10000 dataset_100000_10000;
+
+    std::vector<run_result> driver(bench_options const& options)
     {
-        std::cout << "Running compile-time tests...\n";
-        run_tests(dataset_5_2, 3);
-        run_tests(dataset_50_5, 3);
-        run_tests(dataset_500_50, 3);
-        run_tests(dataset_5000_500, 3);
+        std::vector<run_result> results;
+        auto append = [&](std::vector<run_result> const& more) {
+            results.insert(results.end(), more.begin(), more.end());
+        };
+
+        append(run_tests(dataset_5_2, 3, options));
+        append(run_tests(dataset_50_5, 3, options));
+        append(run_tests(dataset_500_50, 3, options));
+        append(run_tests(dataset_5000_500, 3, options));
+        append(run_tests(dataset_10000_1000, 3, options));
+        append(run_tests(dataset_100000_10000, 3, options));
+        return results;
     }
 }
 
-int main()
+int main(int argc, char** argv)
 {
-    std::cout << "In cycles per second, more is better; in time, less is better.\n";
-    driver<std::string>("std::string");
-    driver<uint32_t>("uint32_t");
-    compile_time::driver();
+    try
+    {
+        auto options = parse_options(argc, argv);
+        if (options.help)
+        {
+            std::cout << usage();
+            return 0;
+        }
+
+        auto results = run_benchmarks(options);
+        if (options.compileTime)
+        {
+            auto staticResults = compile_time::driver(options);
+            results.insert(results.end(), staticResults.begin(), staticResults.end());
+        }
+
+        if (options.outputPath.empty())
+        {
+            write_report(std::cout, options.format, results);
+        }
+        else
+        {
+            std::ofstream out(options.outputPath);
+            if (!out)
+            {
+                throw std::runtime_error("cannot open " + options.outputPath);
+            }
+            write_report(out, options.format, results);
+        }
+    }
+    catch (std::invalid_argument const& e)
+    {
+        std::cerr << "map-speeds: " << e.what() << "\n" << usage();
+        return 1;
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << "map-speeds: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
 }
@@ -0,0 +1,233 @@
+#include "mapped_table.h"
+
+#include <fstream>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace map_speed
+{
+    namespace
+    {
+        constexpr char table_magic[8] = { 'M', 'S', 'P', 'D', 'T', 'B', 'L', '\0' };
+        constexpr uint32_t byte_order_mark = 0x01020304;
+
+        [[noreturn]] void fail(std::filesystem::path const& path, std::string const& what)
+        {
+            throw std::runtime_error(path.string() + ": " + what);
+        }
+
+        // True when count items of itemSize bytes starting at offset lie inside a file of fileBytes.
+        bool fits(uint64_t offset, uint64_t count, uint64_t itemSize, uint64_t fileBytes)
+        {
+            return (offset <= fileBytes) && (count <= (fileBytes - offset) / itemSize);
+        }
+    }
+
+    mapped_file::mapped_file(std::filesystem::path const& path)
+    {
+#if defined(_WIN32)
+        auto file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            fail(path, "cannot open");
+        }
+
+        LARGE_INTEGER size{};
+        GetFileSizeEx(file, &size);
+        m_size = static_cast<size_t>(size.QuadPart);
+        m_mapping = (m_size != 0) ? CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+        CloseHandle(file);
+        if (m_size == 0)
+        {
+            fail(path, "empty file");
+        }
+        if (!m_mapping)
+        {
+            fail(path, "cannot map");
+        }
+
+        m_data = static_cast<char const*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!m_data)
+        {
+            CloseHandle(m_mapping);
+            m_mapping = nullptr;
+            fail(path, "cannot map");
+        }
+#else
+        auto fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            fail(path, "cannot open");
+        }
+
+        struct stat info{};
+        if ((::fstat(fd, &info) != 0) || (info.st_size == 0))
+        {
+            ::close(fd);
+            fail(path, "empty file");
+        }
+
+        m_size = static_cast<size_t>(info.st_size);
+        auto data = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+        {
+            fail(path, "cannot map");
+        }
+        m_data = static_cast<char const*>(data);
+#endif
+    }
+
+    mapped_file::~mapped_file()
+    {
+        close();
+    }
+
+    mapped_file::mapped_file(mapped_file&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    mapped_file& mapped_file::operator=(mapped_file&& other) noexcept
+    {
+        if (this != &other)
+        {
+            close();
+            std::swap(m_data, other.m_data);
+            std::swap(m_size, other.m_size);
+#if defined(_WIN32)
+            std::swap(m_mapping, other.m_mapping);
+#endif
+        }
+        return *this;
+    }
+
+    void mapped_file::close()
+    {
+        if (m_data)
+        {
+#if defined(_WIN32)
+            UnmapViewOfFile(m_data);
+            CloseHandle(m_mapping);
+            m_mapping = nullptr;
+#else
+            ::munmap(const_cast<char*>(m_data), m_size);
+#endif
+        }
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    void evict_file_cache(std::filesystem::path const& path)
+    {
+#if defined(__linux__)
+        auto fd = ::open(path.c_str(), O_RDONLY);
+        if (fd >= 0)
+        {
+            ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            ::close(fd);
+        }
+#else
+        (void)path;
+#endif
+    }
+
+    namespace mapped_table_detail
+    {
+        table_header start_header(table_layout layout, uint32_t keyType, uint64_t count)
+        {
+            table_header header{};
+            std::memcpy(header.magic, table_magic, sizeof(table_magic));
+            header.byteOrder = byte_order_mark;
+            header.version = table_format_version;
+            header.layout = static_cast<uint32_t>(layout);
+            header.keyType = keyType;
+            header.count = count;
+            return header;
+        }
+
+        // Stamps the header into the start of the file image and writes it out. The data is flushed so a
+        // following evict_file_cache can drop the (then clean) pages.
+        void finish_file(std::filesystem::path const& path, std::string& file, table_header& header)
+        {
+            file.resize(align8(file.size()));
+            header.fileBytes = file.size();
+            std::memcpy(file.data(), &header, sizeof(header));
+
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write(file.data(), static_cast<std::streamsize>(file.size()));
+            out.close();
+            if (!out)
+            {
+                fail(path, "cannot write");
+            }
+
+#if !defined(_WIN32)
+            auto fd = ::open(path.c_str(), O_RDONLY);
+            if (fd >= 0)
+            {
+                ::fsync(fd);
+                ::close(fd);
+            }
+#endif
+        }
+
+        table_header const& validate(mapped_file const& file, table_layout layout, uint32_t keyType)
+        {
+            if (file.size() < sizeof(table_header))
+            {
+                throw std::runtime_error("mapped table: file too small for a header");
+            }
+
+            auto const& header = *reinterpret_cast<table_header const*>(file.data());
+            if (std::memcmp(header.magic, table_magic, sizeof(table_magic)) != 0)
+            {
+                throw std::runtime_error("mapped table: not a table file");
+            }
+            if (header.byteOrder != byte_order_mark)
+            {
+                throw std::runtime_error("mapped table: written with the other byte order");
+            }
+            if (header.version != table_format_version)
+            {
+                throw std::runtime_error("mapped table: format version " + std::to_string(header.version) + ", expected " + std::to_string(table_format_version));
+            }
+            if ((header.layout != static_cast<uint32_t>(layout)) || (header.keyType != keyType))
+            {
+                throw std::runtime_error("mapped table: wrong layout or key type for this reader");
+            }
+
+            auto n = header.count;
+            auto bytes = file.size();
+            auto isString = (keyType == table_key<std::string>::id);
+            bool ok = (header.fileBytes == bytes) && (n < bytes) &&
+                fits(header.keysOffset, isString ? n + 1 : n, sizeof(uint32_t), bytes) &&
+                fits(header.valuesOffset, n, sizeof(uint64_t), bytes) &&
+                (!isString || fits(header.stringsOffset, header.stringBytes, 1, bytes));
+            if (ok && (layout == table_layout::perfect_hash))
+            {
+                ok = ((n == 0) || ((header.bucketCount > 0) && (header.slotCount > n))) &&
+                    fits(header.pilotsOffset, header.bucketCount, sizeof(uint32_t), bytes) &&
+                    fits(header.remapOffset, header.slotCount - n, sizeof(uint32_t), bytes) &&
+                    fits(header.fingerprintsOffset, n, sizeof(uint16_t), bytes);
+            }
+            if (!ok)
+            {
+                throw std::runtime_error("mapped table: sections are truncated or inconsistent");
+            }
+            return header;
+        }
+
+        void corrupt_table()
+        {
+            throw std::runtime_error("mapped table: key offsets or remap entries are out of range");
+        }
+    }
+}
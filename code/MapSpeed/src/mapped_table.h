@@ -0,0 +1,330 @@
+#pragma once
+
+#include "perfect_hash.h"
+#include "string_kernels.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+    Immutable lookup tables in a file format that is used in place once mapped: opening one validates a fixed
+    header and sets a few pointers, with no parsing and no allocation, so the first lookup is served as soon as
+    the pages it touches are read in. The sections' contents are checked as lookups read them instead: a string
+    key's offsets must stay inside the arena and a remapped slot below the count, or the lookup throws.
+
+    File layout, in host byte order (the header records it), every section 8-byte aligned:
+
+        table_header
+        pilots          uint32_t[bucketCount]       perfect hash only
+        remap           uint32_t[slotCount - count] perfect hash only
+        fingerprints    uint16_t[count]             perfect hash only
+        keys            uint32_t[count]             uint32 keys; or, for string keys,
+                        uint32_t[count + 1]         offsets of each key in the string arena, then its end
+        strings         char[stringBytes]           string keys only, back to back
+        values          uint64_t[count]
+
+    A sorted table keeps its keys in ascending order for a binary search. A perfect-hash table is a
+    perfect_hash_map written out slot by slot, with the seed needed to repeat its hashing. Its hash is fixed by
+    the format (table_hash below), never std::hash, so a file stays readable by other builds.
+
+    Bumping table_format_version is required whenever the layout changes; readers reject other versions.
+*/
+namespace map_speed
+{
+    inline constexpr uint32_t table_format_version = 2;
+
+    enum class table_layout : uint32_t
+    {
+        sorted = 1,
+        perfect_hash = 2,
+    };
+
+    struct table_header
+    {
+        char magic[8];              // "MSPDTBL" and a NUL
+        uint32_t byteOrder;         // 0x01020304 as written
+        uint32_t version;           // table_format_version
+        uint32_t layout;            // table_layout
+        uint32_t keyType;           // table_key<K>::id
+        uint64_t count;
+        uint64_t seed;              // perfect hash only
+        uint64_t bucketCount;       // perfect hash only
+        uint64_t slotCount;         // perfect hash only
+        uint64_t pilotsOffset;
+        uint64_t remapOffset;
+        uint64_t fingerprintsOffset;
+        uint64_t keysOffset;
+        uint64_t stringsOffset;
+        uint64_t stringBytes;
+        uint64_t valuesOffset;
+        uint64_t fileBytes;
+    };
+
+    // The key types a table can hold, and the stable hash each is stored under.
+    template<typename K> struct table_key;
+
+    template<> struct table_key<uint32_t>
+    {
+        static constexpr uint32_t id = 1;
+        using hash = flat_hash<uint32_t>;
+    };
+
+    template<> struct table_key<std::string>
+    {
+        static constexpr uint32_t id = 2;
+        using hash = kernel_hash<hash_kernel::wyhash>;
+    };
+
+    template<typename K> using table_hash = typename table_key<K>::hash;
+
+    // A whole file mapped read-only. Throws std::runtime_error when it cannot be opened or mapped.
+    class mapped_file
+    {
+    public:
+        mapped_file() = default;
+        explicit mapped_file(std::filesystem::path const& path);
+        ~mapped_file();
+        mapped_file(mapped_file&& other) noexcept;
+        mapped_file& operator=(mapped_file&& other) noexcept;
+
+        char const* data() const { return m_data; }
+        size_t size() const { return m_size; }
+
+    private:
+        void close();
+
+        char const* m_data = nullptr;
+        size_t m_size = 0;
+#if defined(_WIN32)
+        void* m_mapping = nullptr;
+#endif
+    };
+
+    // Asks the OS to drop its cached pages of a file, so the next mapping reads from storage; best effort, and
+    // a no-op where there is no way to ask.
+    void evict_file_cache(std::filesystem::path const& path);
+
+    namespace mapped_table_detail
+    {
+        inline size_t align8(size_t n)
+        {
+            return (n + 7) & ~size_t{ 7 };
+        }
+
+        template<typename T> void append_section(std::string& file, uint64_t& offset, std::span<const T> items)
+        {
+            file.resize(align8(file.size()));
+            offset = file.size();
+            file.append(reinterpret_cast<char const*>(items.data()), items.size_bytes());
+        }
+
+        // Lays out keys (and, for strings, the arena) and values after a header the caller has started.
+        template<typename K> void append_keys(std::string& file, table_header& header, std::span<const K> keys)
+        {
+            if constexpr (std::is_same_v<K, std::string>)
+            {
+                std::vector<uint32_t> offsets;
+                std::string strings;
+                offsets.reserve(keys.size() + 1);
+                for (auto const& key : keys)
+                {
+                    offsets.push_back(static_cast<uint32_t>(strings.size()));
+                    strings += key;
+                }
+                if (strings.size() > UINT32_MAX)
+                {
+                    throw std::length_error("mapped table: more than 4GB of string keys");
+                }
+                offsets.push_back(static_cast<uint32_t>(strings.size()));
+                append_section(file, header.keysOffset, std::span<const uint32_t>(offsets));
+                append_section(file, header.stringsOffset, std::span<const char>(strings));
+                header.stringBytes = strings.size();
+            }
+            else
+            {
+                append_section(file, header.keysOffset, keys);
+            }
+        }
+
+        table_header start_header(table_layout layout, uint32_t keyType, uint64_t count);
+        void finish_file(std::filesystem::path const& path, std::string& file, table_header& header);
+
+        // Checks the header against the file and the expected layout and key type; throws std::runtime_error.
+        // Only the header and the section bounds are checked, never the sections' contents, so opening a table
+        // reads no page but the first.
+        table_header const& validate(mapped_file const& file, table_layout layout, uint32_t keyType);
+
+        // Thrown from a lookup that reads a key offset or remap entry pointing outside its section.
+        [[noreturn]] void corrupt_table();
+
+        template<typename T> T const* section(mapped_file const& file, uint64_t offset)
+        {
+            return reinterpret_cast<T const*>(file.data() + offset);
+        }
+    }
+
+    // Writes items, which must have unique keys, as a sorted table.
+    template<typename K> void write_sorted_table(std::filesystem::path const& path, std::vector<std::pair<K, uint64_t>> items)
+    {
+        using namespace mapped_table_detail;
+        std::sort(items.begin(), items.end(), [](auto const& a, auto const& b) { return a.first < b.first; });
+        std::vector<K> keys;
+        std::vector<uint64_t> values;
+        keys.reserve(items.size());
+        values.reserve(items.size());
+        for (auto& item : items)
+        {
+            keys.push_back(std::move(item.first));
+            values.push_back(item.second);
+        }
+
+        auto header = start_header(table_layout::sorted, table_key<K>::id, keys.size());
+        std::string file(sizeof(table_header), '\0');
+        append_keys(file, header, std::span<const K>(keys));
+        append_section(file, header.valuesOffset, std::span<const uint64_t>(values));
+        finish_file(path, file, header);
+    }
+
+    // Writes a built perfect-hash table; it must use the format's stable hash.
+    template<typename K> void write_perfect_hash_table(std::filesystem::path const& path, perfect_hash_map<K, uint64_t, table_hash<K>> const& table)
+    {
+        using namespace mapped_table_detail;
+        auto header = start_header(table_layout::perfect_hash, table_key<K>::id, table.size());
+        header.seed = table.seed();
+        header.bucketCount = table.pilots().size();
+        header.slotCount = table.slot_count();
+        std::string file(sizeof(table_header), '\0');
+        append_section(file, header.pilotsOffset, table.pilots());
+        append_section(file, header.remapOffset, table.remap());
+        append_section(file, header.fingerprintsOffset, table.fingerprints());
+        append_keys(file, header, table.keys());
+        append_section(file, header.valuesOffset, table.values());
+        finish_file(path, file, header);
+    }
+
+    // The parts common to both mapped layouts: the mapping, the validated header and key access.
+    template<typename K> class mapped_table_base
+    {
+    public:
+        size_t size() const { return m_count; }
+        size_t file_bytes() const { return m_file.size(); }
+
+    protected:
+        mapped_table_base(std::filesystem::path const& path, table_layout layout) : m_file(path)
+        {
+            using namespace mapped_table_detail;
+            auto const& header = validate(m_file, layout, table_key<K>::id);
+            m_count = header.count;
+            m_keys = section<uint32_t>(m_file, header.keysOffset);
+            m_strings = section<char>(m_file, header.stringsOffset);
+            m_stringBytes = header.stringBytes;
+            m_values = section<uint64_t>(m_file, header.valuesOffset);
+        }
+
+        auto key_at(size_t i) const
+        {
+            if constexpr (std::is_same_v<K, std::string>)
+            {
+                // The offsets are checked here rather than on open, so only those a lookup reads are ever read.
+                auto first = m_keys[i];
+                auto last = m_keys[i + 1];
+                if ((first > last) || (last > m_stringBytes))
+                {
+                    mapped_table_detail::corrupt_table();
+                }
+                return std::string_view(m_strings + first, last - first);
+            }
+            else
+            {
+                return m_keys[i];
+            }
+        }
+
+        mapped_file m_file;
+        size_t m_count = 0;
+        uint32_t const* m_keys = nullptr;
+        char const* m_strings = nullptr;
+        uint64_t m_stringBytes = 0;
+        uint64_t const* m_values = nullptr;
+    };
+
+    template<typename K> class mapped_sorted_table : public mapped_table_base<K>
+    {
+    public:
+        explicit mapped_sorted_table(std::filesystem::path const& path) : mapped_table_base<K>(path, table_layout::sorted) {}
+
+        template<typename TKey> uint64_t const* find(TKey const& key) const
+        {
+            size_t first = 0;
+            size_t count = this->m_count;
+            while (count > 0)
+            {
+                auto half = count / 2;
+                if (this->key_at(first + half) < key)
+                {
+                    first += half + 1;
+                    count -= half + 1;
+                }
+                else
+                {
+                    count = half;
+                }
+            }
+            return ((first < this->m_count) && (this->key_at(first) == key)) ? &this->m_values[first] : nullptr;
+        }
+    };
+
+    template<typename K> class mapped_perfect_hash_table : public mapped_table_base<K>
+    {
+    public:
+        explicit mapped_perfect_hash_table(std::filesystem::path const& path) : mapped_table_base<K>(path, table_layout::perfect_hash)
+        {
+            using namespace mapped_table_detail;
+            auto const& header = *section<table_header>(this->m_file, 0);
+            m_seed = header.seed;
+            m_bucketCount = header.bucketCount;
+            m_slotCount = header.slotCount;
+            m_pilots = section<uint32_t>(this->m_file, header.pilotsOffset);
+            m_remap = section<uint32_t>(this->m_file, header.remapOffset);
+            m_fingerprints = section<uint16_t>(this->m_file, header.fingerprintsOffset);
+        }
+
+        template<typename TKey> uint64_t const* find(TKey const& key) const
+        {
+            using namespace perfect_hash_detail;
+            if (this->m_count == 0)
+            {
+                return nullptr;
+            }
+
+            auto h = mix(table_hash<K>{}(key) ^ m_seed);
+            auto slot = minimal_slot(position(h, m_pilots[reduce(h, m_bucketCount)], m_slotCount), this->m_count, m_remap);
+            if (slot >= this->m_count)
+            {
+                mapped_table_detail::corrupt_table();
+            }
+            if (m_fingerprints[slot] != fingerprint(h))
+            {
+                return nullptr;
+            }
+            return (this->key_at(slot) == key) ? &this->m_values[slot] : nullptr;
+        }
+
+    private:
+        uint64_t m_seed = 0;
+        size_t m_bucketCount = 0;
+        size_t m_slotCount = 0;
+        uint32_t const* m_pilots = nullptr;
+        uint32_t const* m_remap = nullptr;
+        uint16_t const* m_fingerprints = nullptr;
+    };
+}
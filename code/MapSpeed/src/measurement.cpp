@@ -0,0 +1,225 @@
+#include "measurement.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MAP_SPEED_HAS_RDTSC 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace map_speed
+{
+    std::string_view counter_backend_name(counter_backend backend)
+    {
+        switch (backend)
+        {
+        case counter_backend::rdtsc: return "rdtsc";
+        case counter_backend::perf: return "perf";
+        default: return "none";
+        }
+    }
+
+    namespace
+    {
+#if defined(MAP_SPEED_HAS_RDTSC)
+        // lfence keeps the counter read from drifting into (or out of) the measured region.
+        uint64_t read_tsc_start()
+        {
+            _mm_lfence();
+            return __rdtsc();
+        }
+
+        uint64_t read_tsc_stop()
+        {
+            unsigned int aux;
+            auto value = __rdtscp(&aux);
+            _mm_lfence();
+            return value;
+        }
+#endif
+
+#if defined(__linux__)
+        int open_perf_event(uint32_t type, uint64_t config, int groupFd)
+        {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            attr.disabled = (groupFd == -1) ? 1 : 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0));
+        }
+#endif
+    }
+
+    hardware_counters::hardware_counters(counter_backend backend) : m_backend(backend)
+    {
+        if (m_backend == counter_backend::rdtsc)
+        {
+#if !defined(MAP_SPEED_HAS_RDTSC)
+            throw std::runtime_error("--counters rdtsc: not available on this architecture");
+#endif
+        }
+        else if (m_backend == counter_backend::perf)
+        {
+#if defined(__linux__)
+            // The group leader is cycles; every other event is read atomically alongside it. Events the PMU lacks
+            // (dTLB misses under many hypervisors, for one) are left out rather than failing the run.
+            struct event
+            {
+                uint32_t type;
+                uint64_t config;
+                uint64_t counter_sample::* field;
+                perf_event_flags flag;
+            };
+            const event events[] = {
+                { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, &counter_sample::cycles, perf_event_flags::none },
+                { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, &counter_sample::instructions, perf_event_flags::instructions },
+                { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, &counter_sample::branchMisses, perf_event_flags::branch_misses },
+                { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, &counter_sample::cacheMisses, perf_event_flags::cache_misses },
+                { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+                    &counter_sample::dtlbMisses, perf_event_flags::dtlb_misses },
+            };
+            for (auto const& e : events)
+            {
+                int fd = open_perf_event(e.type, e.config, m_perfFds.empty() ? -1 : m_perfFds.front());
+                if (fd < 0)
+                {
+                    if (!m_perfFds.empty())
+                    {
+                        continue;
+                    }
+
+                    auto error = errno;
+                    throw std::runtime_error(std::string("--counters perf: perf_event_open failed: ") + std::strerror(error) +
+                        " (check /proc/sys/kernel/perf_event_paranoid)");
+                }
+                m_perfFds.push_back(fd);
+                m_perfFields.push_back(e.field);
+                m_events = m_events | e.flag;
+            }
+#else
+            throw std::runtime_error("--counters perf: perf_event_open is only available on Linux");
+#endif
+        }
+    }
+
+    hardware_counters::~hardware_counters()
+    {
+        close_perf_events();
+    }
+
+    void hardware_counters::close_perf_events()
+    {
+#if defined(__linux__)
+        for (auto fd : m_perfFds)
+        {
+            close(fd);
+        }
+#endif
+        m_perfFds.clear();
+        m_perfFields.clear();
+    }
+
+    void hardware_counters::start()
+    {
+        if (m_backend == counter_backend::rdtsc)
+        {
+#if defined(MAP_SPEED_HAS_RDTSC)
+            m_startTicks = read_tsc_start();
+#endif
+        }
+#if defined(__linux__)
+        else if (!m_perfFds.empty())
+        {
+            ioctl(m_perfFds.front(), PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(m_perfFds.front(), PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
+    }
+
+    counter_sample hardware_counters::stop()
+    {
+        counter_sample sample;
+        if (m_backend == counter_backend::rdtsc)
+        {
+#if defined(MAP_SPEED_HAS_RDTSC)
+            sample.cycles = read_tsc_stop() - m_startTicks;
+#endif
+        }
+#if defined(__linux__)
+        else if (!m_perfFds.empty())
+        {
+            ioctl(m_perfFds.front(), PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+            // PERF_FORMAT_GROUP layout: { u64 nr; u64 time_enabled; u64 time_running; u64 values[nr]; }. When the
+            // group had to share the PMU with other events it ran for only part of the region, so scale it up.
+            uint64_t buffer[3 + 5] = {};
+            if ((read(m_perfFds.front(), buffer, sizeof(buffer)) > 0) && (buffer[2] > 0))
+            {
+                auto scale = static_cast<double>(buffer[1]) / static_cast<double>(buffer[2]);
+                for (size_t i = 0; (i < m_perfFields.size()) && (i < buffer[0]); i++)
+                {
+                    sample.*m_perfFields[i] = static_cast<uint64_t>(static_cast<double>(buffer[3 + i]) * scale);
+                }
+            }
+        }
+#endif
+        return sample;
+    }
+
+    double percentile(std::vector<double> values, double p)
+    {
+        if (values.empty())
+        {
+            return 0;
+        }
+
+        std::sort(values.begin(), values.end());
+        auto rank = static_cast<size_t>(std::ceil(p * values.size()));
+        return values[std::clamp<size_t>(rank, 1, values.size()) - 1];
+    }
+
+    double measurement::min_seconds() const
+    {
+        return seconds.empty() ? 0 : *std::min_element(seconds.begin(), seconds.end());
+    }
+
+    double measurement::median_seconds() const
+    {
+        return percentile(seconds, 0.5);
+    }
+
+    double measurement::p99_seconds() const
+    {
+        return percentile(seconds, 0.99);
+    }
+
+    double measurement::median_counter(uint64_t counter_sample::* field) const
+    {
+        std::vector<double> values;
+        for (auto const& c : counters)
+        {
+            values.push_back(static_cast<double>(c.*field));
+        }
+        return percentile(std::move(values), 0.5);
+    }
+}
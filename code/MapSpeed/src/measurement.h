@@ -0,0 +1,172 @@
+#pragma once
+
+#include "timer.h"
+
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace map_speed
+{
+    // Where the per-repetition cycle (and cache-miss) counts come from. Wall-clock time is always recorded.
+    enum class counter_backend
+    {
+        none,
+        rdtsc,  // x86 time-stamp counter; cycles only
+        perf,   // Linux perf_event_open group; core cycles, instructions, branch, cache and dTLB misses
+    };
+
+    std::string_view counter_backend_name(counter_backend backend);
+
+    struct measure_options
+    {
+        uint32_t warmup = 1;
+        uint32_t repetitions = 5;
+        counter_backend counters = counter_backend::none;
+    };
+
+    // The perf events beyond cycles, which not every PMU (or hypervisor) provides.
+    enum class perf_event_flags : uint32_t
+    {
+        none = 0,
+        instructions = 1,
+        branch_misses = 2,
+        cache_misses = 4,
+        dtlb_misses = 8,
+    };
+
+    constexpr perf_event_flags operator|(perf_event_flags a, perf_event_flags b)
+    {
+        return static_cast<perf_event_flags>(static_cast<uint32_t>(a) | static_cast<uint32_t>(b));
+    }
+
+    constexpr bool has_event(perf_event_flags set, perf_event_flags event)
+    {
+        return (static_cast<uint32_t>(set) & static_cast<uint32_t>(event)) != 0;
+    }
+
+    struct counter_sample
+    {
+        uint64_t cycles = 0;
+        uint64_t instructions = 0;
+        uint64_t branchMisses = 0;
+        uint64_t cacheMisses = 0;
+        uint64_t dtlbMisses = 0;
+    };
+
+    // Reads the selected hardware counters around a region. Construction throws std::runtime_error when the
+    // backend is not usable here (wrong architecture, no perf support, perf_event_paranoid too strict). The perf
+    // backend needs the cycles event; the others are counted when the PMU offers them, see events().
+    class hardware_counters
+    {
+    public:
+        explicit hardware_counters(counter_backend backend);
+        ~hardware_counters();
+        hardware_counters(hardware_counters const&) = delete;
+        hardware_counters& operator=(hardware_counters const&) = delete;
+
+        void start();
+        counter_sample stop();
+        perf_event_flags events() const { return m_events; }
+
+    private:
+        void close_perf_events();
+
+        counter_backend m_backend;
+        uint64_t m_startTicks = 0;
+        std::vector<int> m_perfFds;
+        std::vector<uint64_t counter_sample::*> m_perfFields;  // parallel to m_perfFds
+        perf_event_flags m_events = perf_event_flags::none;
+    };
+
+    // Every timed repetition of one benchmark loop. Statistics are derived on demand so reports can choose
+    // what to show.
+    struct measurement
+    {
+        counter_backend backend = counter_backend::none;
+        perf_event_flags events = perf_event_flags::none;  // the perf events counted besides cycles
+        uint32_t warmup = 0;
+        std::vector<double> seconds;
+        std::vector<counter_sample> counters;   // parallel to seconds; empty for counter_backend::none
+
+        uint32_t repetitions() const { return static_cast<uint32_t>(seconds.size()); }
+        double min_seconds() const;
+        double median_seconds() const;
+        double p99_seconds() const;
+        double median_cycles() const { return median_counter(&counter_sample::cycles); }
+        double median_instructions() const { return median_counter(&counter_sample::instructions); }
+        double median_branch_misses() const { return median_counter(&counter_sample::branchMisses); }
+        double median_cache_misses() const { return median_counter(&counter_sample::cacheMisses); }
+        double median_dtlb_misses() const { return median_counter(&counter_sample::dtlbMisses); }
+
+    private:
+        double median_counter(uint64_t counter_sample::* field) const;
+    };
+
+    // Nearest-rank percentile (p in [0, 1]) of an unsorted sample set; 0 when empty.
+    double percentile(std::vector<double> values, double p);
+
+    // A repetition that times itself, for work whose interesting interval is narrower than the whole call (for
+    // example threads measured from a shared start, excluding thread creation).
+    template<typename R> struct self_timed
+    {
+        R value{};
+        double seconds = 0;
+    };
+
+    template<typename T> struct is_self_timed : std::false_type {};
+    template<typename R> struct is_self_timed<self_timed<R>> : std::true_type {};
+
+    // Runs fn options.warmup times untimed, then options.repetitions times timed, recording each repetition
+    // into result. Returns what the last repetition of fn returned. When fn returns self_timed<R>, its own
+    // seconds are recorded instead of the wall time of the call, and the R is returned.
+    template<typename Fn> auto measure(measure_options const& options, measurement& result, Fn&& fn)
+    {
+        result.backend = options.counters;
+        result.warmup = options.warmup;
+        result.seconds.clear();
+        result.counters.clear();
+
+        for (uint32_t i = 0; i < options.warmup; i++)
+        {
+            (void)fn();
+        }
+
+        hardware_counters counters(options.counters);
+        result.events = counters.events();
+        auto repetitions = (options.repetitions == 0) ? 1 : options.repetitions;
+        decltype(fn()) last{};
+        for (uint32_t i = 0; i < repetitions; i++)
+        {
+            auto repetitionTimer = timer();
+            counters.start();
+            last = fn();
+            auto sample = counters.stop();
+            repetitionTimer.stop();
+
+            if constexpr (is_self_timed<decltype(last)>::value)
+            {
+                result.seconds.push_back(last.seconds);
+            }
+            else
+            {
+                result.seconds.push_back(repetitionTimer.duration());
+            }
+
+            if (options.counters != counter_backend::none)
+            {
+                result.counters.push_back(sample);
+            }
+        }
+
+        if constexpr (is_self_timed<decltype(last)>::value)
+        {
+            return last.value;
+        }
+        else
+        {
+            return last;
+        }
+    }
+}
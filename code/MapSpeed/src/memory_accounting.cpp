@@ -0,0 +1,168 @@
+#include "memory_accounting.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#include <sys/resource.h>
+#else
+#include <malloc.h>
+#include <sys/resource.h>
+#endif
+
+namespace map_speed
+{
+    namespace
+    {
+        std::atomic<bool> g_counting{ false };
+        std::atomic<uint64_t> g_allocations{ 0 };
+        std::atomic<int64_t> g_liveBytes{ 0 };
+        std::atomic<int64_t> g_peakBytes{ 0 };
+
+        size_t usable_size(void* p)
+        {
+#if defined(_WIN32)
+            return _msize(p);
+#elif defined(__APPLE__)
+            return malloc_size(p);
+#else
+            return malloc_usable_size(p);
+#endif
+        }
+
+        void note_allocation(size_t bytes)
+        {
+            if (g_counting.load(std::memory_order_relaxed))
+            {
+                g_allocations.fetch_add(1, std::memory_order_relaxed);
+                auto live = g_liveBytes.fetch_add(static_cast<int64_t>(bytes), std::memory_order_relaxed) + static_cast<int64_t>(bytes);
+                auto peak = g_peakBytes.load(std::memory_order_relaxed);
+                while ((live > peak) && !g_peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+                {
+                }
+            }
+        }
+
+        void note_free(size_t bytes)
+        {
+            if (g_counting.load(std::memory_order_relaxed))
+            {
+                g_liveBytes.fetch_sub(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+            }
+        }
+    }
+
+    allocation_scope::allocation_scope()
+    {
+        g_allocations.store(0, std::memory_order_relaxed);
+        g_liveBytes.store(0, std::memory_order_relaxed);
+        g_peakBytes.store(0, std::memory_order_relaxed);
+        g_counting.store(true, std::memory_order_seq_cst);
+    }
+
+    allocation_scope::~allocation_scope()
+    {
+        g_counting.store(false, std::memory_order_seq_cst);
+    }
+
+    allocation_stats allocation_scope::stats() const
+    {
+        return { g_allocations.load(std::memory_order_relaxed), g_liveBytes.load(std::memory_order_relaxed), g_peakBytes.load(std::memory_order_relaxed) };
+    }
+
+    void* counted_allocate(size_t size)
+    {
+        auto p = std::malloc(size ? size : 1);
+        if (!p)
+        {
+            throw std::bad_alloc();
+        }
+        note_allocation(usable_size(p));
+        return p;
+    }
+
+    void counted_free(void* p)
+    {
+        if (p)
+        {
+            note_free(usable_size(p));
+            std::free(p);
+        }
+    }
+
+    void* counted_allocate_aligned(size_t size, std::align_val_t alignment)
+    {
+        auto align = static_cast<size_t>(alignment);
+#if defined(_WIN32)
+        auto p = _aligned_malloc(size ? size : 1, align);
+        if (!p)
+        {
+            throw std::bad_alloc();
+        }
+        note_allocation(_aligned_msize(p, align, 0));
+#else
+        void* p = nullptr;
+        if (posix_memalign(&p, std::max(align, sizeof(void*)), size ? size : 1) != 0)
+        {
+            throw std::bad_alloc();
+        }
+        note_allocation(usable_size(p));
+#endif
+        return p;
+    }
+
+    void counted_free_aligned(void* p, std::align_val_t alignment)
+    {
+        if (p)
+        {
+#if defined(_WIN32)
+            note_free(_aligned_msize(p, static_cast<size_t>(alignment), 0));
+            _aligned_free(p);
+#else
+            (void)alignment;
+            note_free(usable_size(p));
+            std::free(p);
+#endif
+        }
+    }
+
+    void note_mapped_allocation(size_t bytes)
+    {
+        note_allocation(bytes);
+    }
+
+    void note_mapped_free(size_t bytes)
+    {
+        note_free(bytes);
+    }
+
+    uint64_t peak_rss_bytes()
+    {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters{};
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        {
+            return counters.PeakWorkingSetSize;
+        }
+        return 0;
+#else
+        rusage usage{};
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+        {
+            return 0;
+        }
+#if defined(__APPLE__)
+        return static_cast<uint64_t>(usage.ru_maxrss);          // bytes on macOS
+#else
+        return static_cast<uint64_t>(usage.ru_maxrss) * 1024;   // kilobytes on Linux
+#endif
+#endif
+    }
+}
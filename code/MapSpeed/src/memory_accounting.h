@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+/*
+    Heap accounting for container builds.
+
+    counted_allocate and counted_free wrap malloc and free so that, while an allocation_scope is open, every
+    allocation is counted and live and peak bytes are tracked. The library leaves the global allocator alone: a
+    program that wants its heap counted replaces operator new and delete with forwarders to these, as
+    map_speeds.cpp does, and without them every scope reports no heap traffic. Counting at the global allocator
+    rather than through a container's Allocator parameter also catches what the containers cannot see: the heap
+    buffers of std::string keys, vectors of pairs built inside a contender, and so on. Sizes are the allocator's
+    usable size for each block, so the figures include the allocator's own rounding.
+
+    Outside a scope counting only adds a relaxed load of one flag to each allocation.
+*/
+namespace map_speed
+{
+    struct allocation_stats
+    {
+        uint64_t allocations = 0;
+        int64_t liveBytes = 0;      // allocated minus freed while the scope was open
+        int64_t peakBytes = 0;      // the highest liveBytes reached while the scope was open
+    };
+
+    // Counts the heap traffic of everything that runs on any thread between construction and destruction.
+    // Scopes do not nest.
+    class allocation_scope
+    {
+    public:
+        allocation_scope();
+        ~allocation_scope();
+
+        allocation_scope(allocation_scope const&) = delete;
+        allocation_scope& operator=(allocation_scope const&) = delete;
+
+        allocation_stats stats() const;
+    };
+
+    // malloc and free with counting, for a program's replacement operator new and delete. Allocation throws
+    // std::bad_alloc on failure.
+    void* counted_allocate(size_t size);
+    void counted_free(void* p);
+    void* counted_allocate_aligned(size_t size, std::align_val_t alignment);
+    void counted_free_aligned(void* p, std::align_val_t alignment);
+
+    // Counts a region mapped directly from the OS (huge_pages.h) as one heap allocation of that many bytes.
+    void note_mapped_allocation(size_t bytes);
+    void note_mapped_free(size_t bytes);
+
+    // The process's peak resident set size so far, in bytes; 0 where the platform does not report it.
+    uint64_t peak_rss_bytes();
+}
@@ -0,0 +1,284 @@
+#pragma once
+
+#include "flat_hash_map.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/*
+    An immutable minimal perfect hash table built at runtime, in the style of PTHash.
+
+    Keys are hashed once to 64 bits and split into about n/4 buckets. Buckets are placed largest first: each one
+    searches for the smallest "pilot" value such that mixing the pilot into every member's hash sends them all to
+    distinct, still-free slots. There are about 2% more slots than keys (PTHash's load factor of 0.98), so the
+    last buckets still find a free slot within a few dozen pilots instead of a search that grows with n; the keys
+    that land past slot n are then moved to the holes below it through a small remap table, keeping the storage
+    minimal. A lookup is one pilot load plus one slot probe (and a remap load for those few keys), with no
+    collisions to chase - the same shape as frozen::unordered_map, but for key sets only known at startup.
+
+    A perfect hash maps every key, present or not, to some slot, so each slot also keeps a 16-bit fingerprint of
+    its key's hash. Most misses are rejected on the fingerprint without touching (or, for strings, comparing) the
+    stored key.
+
+    If placement stalls the whole build is retried with a different hash seed; keys must be unique.
+*/
+namespace map_speed
+{
+    // The lookup arithmetic, shared with the memory-mapped form of the table in mapped_table.h and, being
+    // constexpr, with the compile-time tables in static_lookup.h.
+    namespace perfect_hash_detail
+    {
+        // The splitmix64 finalizer.
+        constexpr uint64_t mix(uint64_t v)
+        {
+            v ^= v >> 30;
+            v *= 0xBF58476D1CE4E5B9ull;
+            v ^= v >> 27;
+            v *= 0x94D049BB133111EBull;
+            v ^= v >> 31;
+            return v;
+        }
+
+        // Maps h uniformly onto [0, n) with a multiply instead of a divide.
+        constexpr size_t reduce(uint64_t h, size_t n)
+        {
+#if defined(__SIZEOF_INT128__)
+            return static_cast<size_t>((static_cast<unsigned __int128>(h) * n) >> 64);
+#else
+            return static_cast<size_t>(h % n);
+#endif
+        }
+
+        constexpr uint16_t fingerprint(uint64_t h)
+        {
+            return static_cast<uint16_t>(h);
+        }
+
+        constexpr size_t position(uint64_t h, uint32_t pilot, size_t slotCount)
+        {
+            return reduce(mix(h ^ (pilot * 0x9E3779B97F4A7C15ull)), slotCount);
+        }
+
+        // Slots for n keys at a load factor of about 0.98.
+        constexpr size_t slot_count(size_t n)
+        {
+            return n + n / 50 + 1;
+        }
+
+        // A slot past the last key is remapped to the hole below n it stands for.
+        constexpr size_t minimal_slot(size_t slot, size_t n, uint32_t const* remap)
+        {
+            return (slot < n) ? slot : remap[slot - n];
+        }
+    }
+
+    template<typename K, typename V, typename Hash = flat_hash<K>> class perfect_hash_map
+    {
+    public:
+        perfect_hash_map() = default;
+
+        explicit perfect_hash_map(std::vector<std::pair<K, V>> items)
+        {
+            if (items.empty())
+            {
+                return;
+            }
+
+            std::vector<uint64_t> hashes(items.size());
+            for (uint64_t attempt = 0; attempt < max_seeds; attempt++)
+            {
+                m_seed = mix(attempt + 1);
+                for (size_t i = 0; i < items.size(); i++)
+                {
+                    hashes[i] = seeded(m_hash(items[i].first));
+                }
+
+                if (try_build(hashes))
+                {
+                    break;
+                }
+            }
+
+            if (m_pilots.empty())
+            {
+                throw std::runtime_error("perfect_hash_map: no seed placed every key; are the keys unique?");
+            }
+
+            m_keys.resize(items.size());
+            m_values.resize(items.size());
+            m_fingerprints.resize(items.size());
+            for (size_t i = 0; i < items.size(); i++)
+            {
+                auto slot = minimal_slot(position(hashes[i], m_pilots[bucket(hashes[i])]));
+                m_keys[slot] = std::move(items[i].first);
+                m_values[slot] = std::move(items[i].second);
+                m_fingerprints[slot] = fingerprint(hashes[i]);
+            }
+        }
+
+        size_t size() const { return m_keys.size(); }
+
+        template<typename TKey> V const* find(TKey const& key) const
+        {
+            if (m_slotCount == 0)
+            {
+                return nullptr;
+            }
+
+            auto h = seeded(m_hash(key));
+            auto slot = minimal_slot(position(h, m_pilots[bucket(h)]));
+            if (m_fingerprints[slot] != fingerprint(h))
+            {
+                return nullptr;
+            }
+            return (m_keys[slot] == key) ? &m_values[slot] : nullptr;
+        }
+
+        // The built table's parts, slot by slot, for writing it out (see mapped_table.h).
+        uint64_t seed() const { return m_seed; }
+        std::span<const uint32_t> pilots() const { return m_pilots; }
+        size_t slot_count() const { return m_slotCount; }
+        std::span<const uint32_t> remap() const { return m_remap; }
+        std::span<const uint16_t> fingerprints() const { return m_fingerprints; }
+        std::span<const K> keys() const { return m_keys; }
+        std::span<const V> values() const { return m_values; }
+
+    private:
+        static constexpr uint64_t max_seeds = 16;
+        static constexpr uint32_t max_pilot = 1u << 20;
+        static constexpr size_t keys_per_bucket = 4;
+
+        static uint64_t mix(uint64_t v) { return perfect_hash_detail::mix(v); }
+        static size_t reduce(uint64_t h, size_t n) { return perfect_hash_detail::reduce(h, n); }
+        static uint16_t fingerprint(uint64_t h) { return perfect_hash_detail::fingerprint(h); }
+
+        uint64_t seeded(uint64_t h) const
+        {
+            return mix(h ^ m_seed);
+        }
+
+        size_t bucket(uint64_t h) const
+        {
+            return reduce(h, m_pilots.size());
+        }
+
+        size_t position(uint64_t h, uint32_t pilot) const
+        {
+            return perfect_hash_detail::position(h, pilot, m_slotCount);
+        }
+
+        size_t minimal_slot(size_t slot) const
+        {
+            return perfect_hash_detail::minimal_slot(slot, m_keys.size(), m_remap.data());
+        }
+
+        bool try_build(std::vector<uint64_t> const& hashes)
+        {
+            auto n = hashes.size();
+            m_slotCount = perfect_hash_detail::slot_count(n);
+            m_pilots.assign(std::max<size_t>(1, n / keys_per_bucket), 0);
+            auto bucketCount = m_pilots.size();
+
+            // Counting sort of the key indexes by bucket, then of the buckets by descending size.
+            std::vector<uint32_t> bucketStart(bucketCount + 1, 0);
+            for (auto h : hashes)
+            {
+                bucketStart[bucket(h) + 1]++;
+            }
+            size_t largest = 0;
+            for (size_t b = 0; b < bucketCount; b++)
+            {
+                largest = std::max<size_t>(largest, bucketStart[b + 1]);
+                bucketStart[b + 1] += bucketStart[b];
+            }
+
+            std::vector<uint32_t> members(n);
+            auto fill = bucketStart;
+            for (size_t i = 0; i < n; i++)
+            {
+                members[fill[bucket(hashes[i])]++] = static_cast<uint32_t>(i);
+            }
+
+            std::vector<std::vector<uint32_t>> bySize(largest + 1);
+            for (size_t b = 0; b < bucketCount; b++)
+            {
+                bySize[bucketStart[b + 1] - bucketStart[b]].push_back(static_cast<uint32_t>(b));
+            }
+
+            std::vector<bool> taken(m_slotCount, false);
+            std::vector<size_t> slots;
+            for (size_t size = largest; size > 0; size--)
+            {
+                for (auto b : bySize[size])
+                {
+                    if (!place(hashes, std::span<const uint32_t>(members.data() + bucketStart[b], size), b, taken, slots))
+                    {
+                        m_pilots.clear();
+                        return false;
+                    }
+                }
+            }
+
+            // Every key placed past n left a hole below it; pair them up in order. Slots past n that no key took
+            // are never reached by a stored key, so any in-range index does for them.
+            m_remap.assign(m_slotCount - n, 0);
+            size_t hole = 0;
+            for (size_t slot = n; slot < m_slotCount; slot++)
+            {
+                if (taken[slot])
+                {
+                    while (taken[hole])
+                    {
+                        hole++;
+                    }
+                    m_remap[slot - n] = static_cast<uint32_t>(hole++);
+                }
+            }
+            return true;
+        }
+
+        // Finds the first pilot that sends every member of the bucket to a distinct free slot and claims them.
+        bool place(std::vector<uint64_t> const& hashes, std::span<const uint32_t> bucketMembers, size_t b, std::vector<bool>& taken, std::vector<size_t>& slots)
+        {
+            for (uint32_t pilot = 0; pilot < max_pilot; pilot++)
+            {
+                slots.clear();
+                bool fits = true;
+                for (auto i : bucketMembers)
+                {
+                    auto slot = position(hashes[i], pilot);
+                    if (taken[slot] || (std::find(slots.begin(), slots.end(), slot) != slots.end()))
+                    {
+                        fits = false;
+                        break;
+                    }
+                    slots.push_back(slot);
+                }
+
+                if (fits)
+                {
+                    for (auto slot : slots)
+                    {
+                        taken[slot] = true;
+                    }
+                    m_pilots[b] = pilot;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        std::vector<uint32_t> m_pilots;
+        std::vector<uint32_t> m_remap;
+        std::vector<uint16_t> m_fingerprints;
+        std::vector<K> m_keys;
+        std::vector<V> m_values;
+        uint64_t m_seed = 0;
+        size_t m_slotCount = 0;
+        Hash m_hash;
+    };
+}
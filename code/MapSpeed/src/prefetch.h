@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_ARM64) || defined(_M_ARM64EC))
+#include <intrin.h>
+#endif
+
+namespace map_speed
+{
+    // Hints that the cache line holding p will be read soon. Never faults, even for addresses past the end of an
+    // allocation, so callers may prefetch speculatively.
+    inline void prefetch_read(void const* p)
+    {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        _mm_prefetch(static_cast<char const*>(p), _MM_HINT_T0);
+#elif defined(_MSC_VER) && (defined(_M_ARM64) || defined(_M_ARM64EC))
+        __prefetch(p);
+#else
+        __builtin_prefetch(p, 0, 3);
+#endif
+    }
+
+    constexpr size_t cache_line_size = 64;
+}
@@ -0,0 +1,317 @@
+#pragma once
+
+#include "prefetch.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MAP_SPEED_STREE_AVX2 1
+#elif defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MAP_SPEED_STREE_SSE2 1
+#endif
+
+/*
+    Read-only ordered lookup tables with cache-friendlier layouts than a sorted array.
+
+    A binary search over a sorted array touches a new cache line at almost every step once N is large, and each
+    step depends on the previous one. Both layouts here keep the "sorted keys, parallel values" model of the
+    sorted-vector contender but arrange the keys so the memory system can help:
+
+    eytzinger_map - keys in BFS order of an implicit binary tree (node k has children 2k and 2k+1). The
+        search loop is branchless and prefetches the cache line holding the node's descendants several levels
+        down, so the next few misses overlap with the current comparison.
+
+    s_tree_map - keys in an implicit static B-tree of 16-key nodes (64 bytes for uint32_t). Each node is one
+        cache line, compared against the probe with SIMD, so a lookup takes log17(N) dependent misses instead of
+        log2(N).
+
+    Both are built once from unsorted (key, value) pairs; keys must be unique.
+*/
+namespace map_speed
+{
+    template<typename K, typename V> class eytzinger_map
+    {
+    public:
+        eytzinger_map() = default;
+
+        explicit eytzinger_map(std::vector<std::pair<K, V>> items)
+        {
+            std::sort(items.begin(), items.end(), [](auto const& a, auto const& b) { return a.first < b.first; });
+
+            // Slot 0 is unused so the children of k are simply 2k and 2k+1.
+            m_keys.resize(items.size() + 1);
+            m_values.resize(items.size() + 1);
+            size_t next = 0;
+            fill(items, next, 1);
+        }
+
+        size_t size() const { return m_keys.empty() ? 0 : m_keys.size() - 1; }
+
+        V const* find(K const& key) const
+        {
+            auto const n = size();
+            auto const keys = m_keys.data();
+            size_t k = 1;
+            while (k <= n)
+            {
+                prefetch_read(reinterpret_cast<void const*>(reinterpret_cast<uintptr_t>(keys) + k * prefetch_stride * sizeof(K)));
+                k = 2 * k + static_cast<size_t>(keys[k] < key);
+            }
+
+            return resolve(k, key);
+        }
+
+        // Looks up keys[i] into results[i]. Up to batch_width searches descend the tree together, one level per
+        // step, so each level's cache misses for the whole batch are in flight at the same time.
+        static constexpr size_t batch_width = 16;
+
+        void find_batch(std::span<const K> keys, std::span<V const*> results) const
+        {
+            auto const n = size();
+            auto const levels = std::bit_width(n);
+            size_t k[batch_width];
+            for (size_t base = 0; base < keys.size(); base += batch_width)
+            {
+                auto count = std::min(batch_width, keys.size() - base);
+                std::fill_n(k, count, size_t{ 1 });
+                for (size_t level = 0; level < levels; level++)
+                {
+                    for (size_t i = 0; i < count; i++)
+                    {
+                        if (k[i] <= n)
+                        {
+                            prefetch_read(&m_keys[std::min(k[i] * prefetch_stride, n)]);
+                            k[i] = 2 * k[i] + static_cast<size_t>(m_keys[k[i]] < keys[base + i]);
+                        }
+                    }
+                }
+
+                for (size_t i = 0; i < count; i++)
+                {
+                    results[base + i] = resolve(k[i], keys[base + i]);
+                }
+            }
+        }
+
+    private:
+        // Every right turn appended a 1 bit and every left turn a 0. The answer is where the last left turn
+        // happened: strip the trailing ones, then that final zero.
+        V const* resolve(size_t k, K const& key) const
+        {
+            k >>= std::countr_one(k) + 1;
+            return ((k != 0) && (m_keys[k] == key)) ? &m_values[k] : nullptr;
+        }
+
+        // The descendants of k that are log2(prefetch_stride) levels down are the prefetch_stride consecutive slots
+        // starting at k * prefetch_stride; with one cache line's worth of keys they all share a single line.
+        static constexpr size_t prefetch_stride = std::max<size_t>(1, cache_line_size / sizeof(K));
+
+        void fill(std::vector<std::pair<K, V>>& sorted, size_t& next, size_t k)
+        {
+            if (k < m_keys.size())
+            {
+                fill(sorted, next, 2 * k);
+                m_keys[k] = std::move(sorted[next].first);
+                m_values[k] = std::move(sorted[next].second);
+                next++;
+                fill(sorted, next, 2 * k + 1);
+            }
+        }
+
+        std::vector<K> m_keys;
+        std::vector<V> m_values;
+    };
+
+    template<typename K, typename V> class s_tree_map
+    {
+    public:
+        static constexpr size_t node_keys = 16;
+
+        s_tree_map() = default;
+
+        explicit s_tree_map(std::vector<std::pair<K, V>> items)
+        {
+            if (items.empty())
+            {
+                return;
+            }
+
+            std::sort(items.begin(), items.end(), [](auto const& a, auto const& b) { return a.first < b.first; });
+
+            // Unused key slots repeat the largest key. Probes above it are rejected before the search, so for
+            // every other probe the first key >= probe in sorted order is always a real one.
+            m_maxKey = items.back().first;
+            m_count = items.size();
+            auto nodeCount = (items.size() + node_keys - 1) / node_keys;
+            m_nodes.resize(nodeCount);
+            m_values.resize(nodeCount * node_keys);
+            size_t next = 0;
+            fill(items, next, 0);
+
+            // The leftmost path has the smallest indexes at every level, so it is the deepest one.
+            for (size_t k = 0; k < nodeCount; k = child(k, 0))
+            {
+                m_height++;
+            }
+        }
+
+        size_t size() const { return m_count; }
+
+        V const* find(K const& key) const
+        {
+            if ((m_count == 0) || (m_maxKey < key))
+            {
+                return nullptr;
+            }
+
+            auto const nodeCount = m_nodes.size();
+            size_t candidate = 0;
+            size_t k = 0;
+            while (k < nodeCount)
+            {
+                auto i = rank(m_nodes[k], key);
+                if (i < node_keys)
+                {
+                    candidate = k * node_keys + i;
+                }
+                k = child(k, i);
+            }
+
+            return resolve(candidate, key);
+        }
+
+        // Looks up keys[i] into results[i], descending up to batch_width searches one node level at a time and
+        // prefetching each search's next node before ranking the next search in the batch.
+        static constexpr size_t batch_width = 16;
+
+        void find_batch(std::span<const K> keys, std::span<V const*> results) const
+        {
+            auto const nodeCount = m_nodes.size();
+            size_t k[batch_width];
+            size_t candidate[batch_width];
+            for (size_t base = 0; base < keys.size(); base += batch_width)
+            {
+                auto count = std::min(batch_width, keys.size() - base);
+                std::fill_n(k, count, (m_count == 0) ? nodeCount : size_t{ 0 });
+                std::fill_n(candidate, count, size_t{ 0 });
+                for (size_t level = 0; level < m_height; level++)
+                {
+                    for (size_t i = 0; i < count; i++)
+                    {
+                        if (k[i] < nodeCount)
+                        {
+                            auto r = rank(m_nodes[k[i]], keys[base + i]);
+                            if (r < node_keys)
+                            {
+                                candidate[i] = k[i] * node_keys + r;
+                            }
+                            k[i] = child(k[i], r);
+                            if (k[i] < nodeCount)
+                            {
+                                prefetch_read(&m_nodes[k[i]]);
+                            }
+                        }
+                    }
+                }
+
+                for (size_t i = 0; i < count; i++)
+                {
+                    auto const& key = keys[base + i];
+                    results[base + i] = ((m_count == 0) || (m_maxKey < key)) ? nullptr : resolve(candidate[i], key);
+                }
+            }
+        }
+
+    private:
+        V const* resolve(size_t candidate, K const& key) const
+        {
+            auto const& candidateKey = m_nodes[candidate / node_keys].keys[candidate % node_keys];
+            return (candidateKey == key) ? &m_values[candidate] : nullptr;
+        }
+
+        struct alignas(cache_line_size) node
+        {
+            K keys[node_keys];
+        };
+
+        static size_t child(size_t k, size_t i)
+        {
+            return k * (node_keys + 1) + i + 1;
+        }
+
+        // Number of keys in the node that are less than key, i.e. the index of the first key >= key.
+        static size_t rank(node const& n, K const& key)
+        {
+            if constexpr (std::is_same_v<K, uint32_t>)
+            {
+#if defined(MAP_SPEED_STREE_AVX2) || defined(MAP_SPEED_STREE_SSE2)
+                // SSE/AVX only compare signed integers; flipping the sign bit of both sides makes that an unsigned compare.
+                auto const bias = static_cast<int>(0x80000000u);
+#endif
+#if defined(MAP_SPEED_STREE_AVX2)
+                auto probe = _mm256_set1_epi32(static_cast<int>(key ^ 0x80000000u));
+                auto flip = _mm256_set1_epi32(bias);
+                auto lo = _mm256_xor_si256(_mm256_load_si256(reinterpret_cast<__m256i const*>(n.keys)), flip);
+                auto hi = _mm256_xor_si256(_mm256_load_si256(reinterpret_cast<__m256i const*>(n.keys + 8)), flip);
+                auto lessLo = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(probe, lo)));
+                auto lessHi = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(probe, hi)));
+                return static_cast<size_t>(std::popcount(static_cast<unsigned>(lessLo)) + std::popcount(static_cast<unsigned>(lessHi)));
+#elif defined(MAP_SPEED_STREE_SSE2)
+                auto probe = _mm_set1_epi32(static_cast<int>(key ^ 0x80000000u));
+                auto flip = _mm_set1_epi32(bias);
+                unsigned mask = 0;
+                for (size_t j = 0; j < node_keys; j += 4)
+                {
+                    auto keys = _mm_xor_si128(_mm_load_si128(reinterpret_cast<__m128i const*>(n.keys + j)), flip);
+                    mask |= static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(probe, keys)))) << j;
+                }
+                return static_cast<size_t>(std::popcount(mask));
+#endif
+            }
+
+            size_t less = 0;
+            for (size_t j = 0; j < node_keys; j++)
+            {
+                less += static_cast<size_t>(n.keys[j] < key);
+            }
+            return less;
+        }
+
+        // In-order traversal of the implicit tree assigns sorted keys to slots.
+        void fill(std::vector<std::pair<K, V>>& sorted, size_t& next, size_t k)
+        {
+            if (k < m_nodes.size())
+            {
+                for (size_t i = 0; i < node_keys; i++)
+                {
+                    fill(sorted, next, child(k, i));
+                    if (next < sorted.size())
+                    {
+                        m_nodes[k].keys[i] = std::move(sorted[next].first);
+                        m_values[k * node_keys + i] = std::move(sorted[next].second);
+                        next++;
+                    }
+                    else
+                    {
+                        m_nodes[k].keys[i] = m_maxKey;
+                    }
+                }
+                fill(sorted, next, child(k, node_keys));
+            }
+        }
+
+        std::vector<node> m_nodes;
+        std::vector<V> m_values;
+        K m_maxKey{};
+        size_t m_count = 0;
+        size_t m_height = 0;
+    };
+}
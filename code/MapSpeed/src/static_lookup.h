@@ -0,0 +1,315 @@
+#pragma once
+
+#include "perfect_hash.h"
+#include "string_kernels.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+    A read-only map built entirely at compile time whose lookup strategy is chosen from its size and key type,
+    so a caller with a fixed key set gets the fastest of the compile-time structures without picking one:
+
+        linear_simd  - up to 16 32-bit integer keys, compared against the probe four at a time with SSE2;
+                       the keys fill at most four 16-byte vectors and nothing branches until the answer
+        linear       - up to 16 keys of any other type, scanned in order
+        binary       - up to binary_search_limit keys, or any count of keys that cannot be hashed at compile
+                       time: a branchless lower bound over the sorted keys, fully unrolled since N is known
+        perfect_hash - larger sets of integer or string-view keys: the PTHash scheme of perfect_hash.h
+                       (pilot per bucket, largest buckets first) run by the compiler, over 25% spare slots so
+                       the search stays well inside constexpr evaluation limits; a lookup is one pilot load,
+                       one slot load and one key compare
+
+    Build one with make_static_lookup from an array of (key, value) pairs with unique keys. Construction is
+    constexpr; when no seed places every key the build throws, which at compile time is a compile error.
+
+    Searching for pilots costs the compiler several million evaluation steps per thousand keys, so beyond about
+    5000 keys the default constexpr budgets run out. For those sizes a build step can construct the table at run
+    time, save seed(), pilots() and slots(), and emit them as constants for the adopting constructor, which only
+    copies (see static_table_gen.cpp).
+*/
+namespace map_speed
+{
+    enum class static_strategy
+    {
+        linear,
+        linear_simd,
+        binary,
+        perfect_hash,
+    };
+
+    constexpr std::string_view static_strategy_name(static_strategy strategy)
+    {
+        switch (strategy)
+        {
+        case static_strategy::linear: return "linear";
+        case static_strategy::linear_simd: return "linear_simd";
+        case static_strategy::binary: return "binary";
+        default: return "perfect_hash";
+        }
+    }
+
+    namespace static_lookup_detail
+    {
+        inline constexpr size_t linear_limit = 16;
+        inline constexpr size_t binary_search_limit = 64;
+
+        template<typename K> inline constexpr bool hashable = std::is_integral_v<K> || std::is_convertible_v<K const&, std::string_view>;
+
+        // A compile-time hash: the integer itself or FNV-1a of the characters, then mixed by the caller.
+        template<typename K> constexpr uint64_t key_hash(K const& key)
+        {
+            if constexpr (std::is_integral_v<K>)
+            {
+                return static_cast<uint64_t>(key);
+            }
+            else
+            {
+                uint64_t h = 0xCBF29CE484222325ull;
+                for (char c : std::string_view(key))
+                {
+                    h = (h ^ static_cast<uint8_t>(c)) * 0x100000001B3ull;
+                }
+                return h;
+            }
+        }
+
+        template<typename K> constexpr static_strategy choose(size_t n)
+        {
+            if (n <= linear_limit)
+            {
+#if defined(MAP_SPEED_X64_KERNELS)
+                if (std::is_integral_v<K> && (sizeof(K) == 4))
+                {
+                    return static_strategy::linear_simd;
+                }
+#endif
+                return static_strategy::linear;
+            }
+            return ((n <= binary_search_limit) || !hashable<K>) ? static_strategy::binary : static_strategy::perfect_hash;
+        }
+    }
+
+    template<typename K, typename V, size_t N> class static_lookup
+    {
+    public:
+        static constexpr static_strategy strategy = static_lookup_detail::choose<K>(N);
+
+    private:
+        static constexpr bool hashed = (strategy == static_strategy::perfect_hash);
+        // The SIMD scan reads whole 16-byte vectors, so its keys are padded to a multiple of four.
+        static constexpr size_t key_slots = (strategy == static_strategy::linear_simd) ? ((N + 3) & ~size_t{ 3 }) : N;
+        static constexpr size_t bucket_count = hashed ? std::max<size_t>(1, N / 4) : 0;
+        static constexpr size_t slot_count = hashed ? (N + N / 4 + 1) : 0;
+        static constexpr uint32_t max_seeds = 16;
+        static constexpr uint32_t max_pilot = 1u << 16;
+
+    public:
+        using slot_index = std::conditional_t<(N < UINT16_MAX), uint16_t, uint32_t>;
+        using pilot_array = std::array<uint32_t, bucket_count>;
+        using slot_array = std::array<slot_index, slot_count>;
+
+        // The scratch space is heap-allocated (transiently, when constant evaluated) so large tables built at run
+        // time do not need megabytes of stack.
+        constexpr explicit static_lookup(std::array<std::pair<K, V>, N> const& items)
+        {
+            std::vector<std::pair<K, V>> sorted(items.begin(), items.end());
+            std::sort(sorted.begin(), sorted.end(), [](auto const& a, auto const& b) { return a.first < b.first; });
+            for (size_t i = 0; i < N; i++)
+            {
+                m_keys[i] = sorted[i].first;
+                m_values[i] = sorted[i].second;
+            }
+
+            if constexpr (hashed)
+            {
+                build_hash();
+            }
+        }
+
+        // Adopts a hash layout saved from a table built over the same keys; sortedItems must be in key order.
+        constexpr static_lookup(std::array<std::pair<K, V>, N> const& sortedItems, uint64_t seed, pilot_array const& pilots, slot_array const& slots)
+            requires hashed
+            : m_pilots(pilots), m_slots(slots), m_seed(seed)
+        {
+            for (size_t i = 0; i < N; i++)
+            {
+                m_keys[i] = sortedItems[i].first;
+                m_values[i] = sortedItems[i].second;
+            }
+        }
+
+        static constexpr size_t size() { return N; }
+
+        constexpr uint64_t seed() const requires hashed { return m_seed; }
+        constexpr pilot_array const& pilots() const requires hashed { return m_pilots; }
+        constexpr slot_array const& slots() const requires hashed { return m_slots; }
+
+        constexpr V const* find(K const& key) const
+        {
+            if constexpr (strategy == static_strategy::linear_simd)
+            {
+#if defined(MAP_SPEED_X64_KERNELS)
+                if (!std::is_constant_evaluated())
+                {
+                    auto probe = _mm_set1_epi32(static_cast<int>(key));
+                    uint32_t found = 0;
+                    for (size_t i = 0; i < N; i += 4)
+                    {
+                        auto keys = _mm_load_si128(reinterpret_cast<__m128i const*>(m_keys.data() + i));
+                        found |= static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(keys, probe)))) << i;
+                    }
+                    found &= (1u << N) - 1;
+                    return (found != 0) ? &m_values[std::countr_zero(found)] : nullptr;
+                }
+#endif
+                return find_linear(key);
+            }
+            else if constexpr (strategy == static_strategy::linear)
+            {
+                return find_linear(key);
+            }
+            else if constexpr (strategy == static_strategy::binary)
+            {
+                // Halve the range without branching on the comparison; N is a constant, so this unrolls.
+                size_t base = 0;
+                for (size_t length = N; length > 1; length -= length / 2)
+                {
+                    base = (m_keys[base + length / 2] < key) ? base + length / 2 : base;
+                }
+                base += static_cast<size_t>(m_keys[base] < key);
+                return ((base < N) && (m_keys[base] == key)) ? &m_values[base] : nullptr;
+            }
+            else
+            {
+                using namespace perfect_hash_detail;
+                auto h = mix(static_lookup_detail::key_hash(key) ^ m_seed);
+                size_t index = m_slots[position(h, m_pilots[reduce(h, bucket_count)], slot_count)];
+                return ((index < N) && (m_keys[index] == key)) ? &m_values[index] : nullptr;
+            }
+        }
+
+    private:
+        constexpr V const* find_linear(K const& key) const
+        {
+            for (size_t i = 0; i < N; i++)
+            {
+                if (m_keys[i] == key)
+                {
+                    return &m_values[i];
+                }
+            }
+            return nullptr;
+        }
+
+        constexpr void build_hash()
+        {
+            using namespace perfect_hash_detail;
+            std::vector<uint64_t> hashes(N);
+            for (uint32_t attempt = 0; attempt < max_seeds; attempt++)
+            {
+                m_seed = mix(attempt + 1);
+                for (size_t i = 0; i < N; i++)
+                {
+                    hashes[i] = mix(static_lookup_detail::key_hash(m_keys[i]) ^ m_seed);
+                }
+
+                if (try_place(hashes))
+                {
+                    return;
+                }
+            }
+            throw std::logic_error("static_lookup: no seed placed every key; are the keys unique?");
+        }
+
+        constexpr bool try_place(std::vector<uint64_t> const& hashes)
+        {
+            using namespace perfect_hash_detail;
+            m_slots.fill(static_cast<slot_index>(N));
+            m_pilots.fill(0);
+
+            // Counting sort of the keys by bucket, then the buckets by descending size.
+            std::vector<uint32_t> bucketStart(bucket_count + 1);
+            for (auto h : hashes)
+            {
+                bucketStart[reduce(h, bucket_count) + 1]++;
+            }
+            for (size_t b = 0; b < bucket_count; b++)
+            {
+                bucketStart[b + 1] += bucketStart[b];
+            }
+
+            std::vector<uint32_t> members(N);
+            auto fill = bucketStart;
+            for (size_t i = 0; i < N; i++)
+            {
+                members[fill[reduce(hashes[i], bucket_count)]++] = static_cast<uint32_t>(i);
+            }
+
+            std::vector<uint32_t> order(bucket_count);
+            for (size_t b = 0; b < bucket_count; b++)
+            {
+                order[b] = static_cast<uint32_t>(b);
+            }
+            std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+                return (bucketStart[a + 1] - bucketStart[a]) > (bucketStart[b + 1] - bucketStart[b]);
+            });
+
+            std::vector<size_t> chosen(N);
+            for (auto b : order)
+            {
+                auto first = bucketStart[b];
+                auto count = bucketStart[b + 1] - first;
+                if (count == 0)
+                {
+                    break;
+                }
+
+                bool placed = false;
+                for (uint32_t pilot = 0; !placed && (pilot < max_pilot); pilot++)
+                {
+                    placed = true;
+                    for (size_t j = 0; placed && (j < count); j++)
+                    {
+                        auto slot = position(hashes[members[first + j]], pilot, slot_count);
+                        placed = (m_slots[slot] == N) && (std::find(chosen.begin(), chosen.begin() + j, slot) == chosen.begin() + j);
+                        chosen[j] = slot;
+                    }
+
+                    if (placed)
+                    {
+                        for (size_t j = 0; j < count; j++)
+                        {
+                            m_slots[chosen[j]] = static_cast<slot_index>(members[first + j]);
+                        }
+                        m_pilots[b] = pilot;
+                    }
+                }
+
+                if (!placed)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        alignas(16) std::array<K, key_slots> m_keys{};
+        std::array<V, N> m_values{};
+        std::array<uint32_t, bucket_count> m_pilots{};
+        std::array<slot_index, slot_count> m_slots{};
+        uint64_t m_seed = 0;
+    };
+
+    template<typename K, typename V, size_t N> constexpr auto make_static_lookup(std::array<std::pair<K, V>, N> const& items)
+    {
+        return static_lookup<K, V, N>(items);
+    }
+}
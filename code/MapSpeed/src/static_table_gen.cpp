@@ -0,0 +1,120 @@
+// static_table_gen.cpp : Build step that writes the compile-time datasets too large to generate in constexpr.
+//
+// Generating, sorting and perfect-hashing tables of more than about 5000 keys exhausts the compilers' constexpr
+// budgets, so this tool does that work at build time and emits the results as constant arrays. The header it
+// writes defines one struct per size with the same members as compile_time::make_static_map_test's result,
+// minus the frozen containers; its static_lookup adopts the saved hash layout instead of searching for one.
+//
+#include "static_lookup.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <unordered_set>
+
+using namespace map_speed;
+
+namespace
+{
+    template<typename TRange> void write_list(std::ostream& out, TRange const& items)
+    {
+        out << "{ {";
+        size_t column = 0;
+        for (auto const& item : items)
+        {
+            out << ((column++ % 8) ? " " : "\n            ");
+            if constexpr (requires { item.first; })
+            {
+                out << "{ " << item.first << "u, " << item.second << "u },";
+            }
+            else
+            {
+                out << item << "u,";
+            }
+        }
+        out << "\n        } }";
+    }
+
+    template<size_t TotalSize, size_t MissCount> void write_table(std::ostream& out, std::mt19937& rng)
+    {
+        constexpr size_t hitCount = TotalSize - MissCount;
+        using pair_type = std::pair<uint32_t, uint32_t>;
+
+        // Unique keys in random order, valued by position; the first hitCount are inserted, the rest are misses.
+        auto allContent = std::make_unique<std::array<pair_type, TotalSize>>();
+        std::unordered_set<uint32_t> seen;
+        for (size_t i = 0; i < TotalSize; i++)
+        {
+            uint32_t key;
+            do
+            {
+                key = static_cast<uint32_t>(rng());
+            } while (!seen.insert(key).second);
+            (*allContent)[i] = { key, static_cast<uint32_t>(i) };
+        }
+
+        auto sortedArray = std::make_unique<std::array<pair_type, hitCount>>();
+        std::copy_n(allContent->begin(), hitCount, sortedArray->begin());
+        std::sort(sortedArray->begin(), sortedArray->end(), [](auto const& a, auto const& b) { return a.first < b.first; });
+
+        using lookup_type = static_lookup<uint32_t, uint32_t, hitCount>;
+        static_assert(lookup_type::strategy == static_strategy::perfect_hash, "generated tables are for sizes that need hashing");
+        auto lookup = std::make_unique<lookup_type>(*sortedArray);
+
+        out << "    struct table_" << TotalSize << "_" << MissCount << "\n    {\n";
+        out << "        static constexpr size_t totalSize = " << TotalSize << ";\n";
+        out << "        static constexpr size_t missCount = " << MissCount << ";\n";
+        out << "        static constexpr std::array<std::pair<uint32_t, uint32_t>, " << TotalSize << "> allContent";
+        write_list(out, *allContent);
+        out << ";\n        static constexpr std::array<std::pair<uint32_t, uint32_t>, " << hitCount << "> sortedArray";
+        write_list(out, *sortedArray);
+        out << ";\n        static constexpr map_speed::static_lookup<uint32_t, uint32_t, " << hitCount << "> staticLookup{ sortedArray,\n";
+        out << "            " << lookup->seed() << "ull,\n        ";
+        write_list(out, lookup->pilots());
+        out << ",\n        ";
+        write_list(out, lookup->slots());
+        out << " };\n    };\n\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2)
+    {
+        std::cerr << "usage: static-table-gen <output header>\n";
+        return 1;
+    }
+
+    try
+    {
+        std::filesystem::path outputPath(argv[1]);
+        if (outputPath.has_parent_path())
+        {
+            std::filesystem::create_directories(outputPath.parent_path());
+        }
+
+        std::ofstream out(outputPath);
+        if (!out)
+        {
+            throw std::runtime_error("cannot open " + outputPath.string());
+        }
+
+        // A fixed seed keeps the generated header, and so the build, reproducible.
+        std::mt19937 rng(5489u);
+        out << "// Generated by static-table-gen; do not edit.\n";
+        out << "#pragma once\n\n#include \"static_lookup.h\"\n\n";
+        out << "namespace compile_time::generated\n{\n";
+        write_table<10000, 1000>(out, rng);
+        write_table<100000, 10000>(out, rng);
+        out << "}\n";
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << "static-table-gen: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
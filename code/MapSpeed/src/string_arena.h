@@ -0,0 +1,132 @@
+#pragma once
+
+#include "flat_hash_map.h"
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+    Compact storage for string keys.
+
+    A string_arena holds many strings back to back in one buffer. Each record is the string's 64-bit hash, its
+    32-bit length and then its characters, padded to 4 bytes; a string_handle is just the record's 32-bit byte
+    offset. Compared with a container of std::string this replaces a 32-byte string object plus (for longer
+    strings) a separate heap block per key with a 4-byte handle and 12 bytes of header, and the cached hash means
+    rehashing, and comparing two handles whose hashes differ, never touch the characters.
+
+    There is no interning: append stores every string it is given, even one already in the arena. The benchmark
+    keys are unique by construction (generateContent removes duplicates), so a lookup to share repeated strings
+    would find nothing to share and only add a hash probe to every build; and short strings already cost no
+    more than their record, with no separate block to save.
+
+    The functors below let the standard and flat containers key on handles while being probed with a plain
+    std::string_view; they hold a pointer to the arena, so a container using them must not outlive it.
+
+    The buffer's Allocator is a parameter so the characters can live on huge pages (huge_pages.h); string_arena
+    is the std::allocator form.
+*/
+namespace map_speed
+{
+    struct string_handle
+    {
+        uint32_t offset = 0;
+    };
+
+    template<typename Allocator = std::allocator<char>> class basic_string_arena
+    {
+    public:
+        // Avoids regrowing the buffer when the total character count is known up front.
+        void reserve(size_t stringCount, size_t characterCount)
+        {
+            m_bytes.reserve(stringCount * (header_size + alignment) + characterCount);
+        }
+
+        string_handle append(std::string_view s)
+        {
+            auto offset = m_bytes.size();
+            auto recordSize = (header_size + s.size() + alignment - 1) & ~(alignment - 1);
+            if ((offset + recordSize > std::numeric_limits<uint32_t>::max()) || (s.size() > std::numeric_limits<uint32_t>::max()))
+            {
+                throw std::length_error("string_arena: more than 4GB of strings");
+            }
+
+            auto h = flat_hash<std::string>{}(s);
+            auto length = static_cast<uint32_t>(s.size());
+            m_bytes.resize(offset + recordSize);
+            auto record = m_bytes.data() + offset;
+            std::memcpy(record, &h, sizeof(h));
+            std::memcpy(record + sizeof(h), &length, sizeof(length));
+            std::memcpy(record + header_size, s.data(), s.size());
+            return { static_cast<uint32_t>(offset) };
+        }
+
+        std::string_view view(string_handle h) const
+        {
+            uint32_t length;
+            auto record = m_bytes.data() + h.offset;
+            std::memcpy(&length, record + sizeof(uint64_t), sizeof(length));
+            return { record + header_size, length };
+        }
+
+        uint64_t hash(string_handle h) const
+        {
+            uint64_t value;
+            std::memcpy(&value, m_bytes.data() + h.offset, sizeof(value));
+            return value;
+        }
+
+        size_t size_bytes() const { return m_bytes.size(); }
+
+    private:
+        static constexpr size_t header_size = sizeof(uint64_t) + sizeof(uint32_t);
+        static constexpr size_t alignment = 4;
+
+        std::vector<char, Allocator> m_bytes;
+    };
+
+    using string_arena = basic_string_arena<>;
+
+    // Hashes handles from the arena's cache and string views the same way the arena did.
+    template<typename TArena> struct basic_arena_hash
+    {
+        using is_transparent = void;
+        TArena const* arena = nullptr;
+
+        uint64_t operator()(string_handle h) const { return arena->hash(h); }
+        uint64_t operator()(std::string_view s) const { return flat_hash<std::string>{}(s); }
+    };
+
+    template<typename TArena> struct basic_arena_equal
+    {
+        using is_transparent = void;
+        TArena const* arena = nullptr;
+
+        // Two handles with different cached hashes are told apart without reading either string.
+        bool operator()(string_handle a, string_handle b) const
+        {
+            return (a.offset == b.offset) || ((arena->hash(a) == arena->hash(b)) && (arena->view(a) == arena->view(b)));
+        }
+        bool operator()(string_handle a, std::string_view b) const { return arena->view(a) == b; }
+        bool operator()(std::string_view a, string_handle b) const { return a == arena->view(b); }
+    };
+
+    template<typename TArena> struct basic_arena_less
+    {
+        using is_transparent = void;
+        TArena const* arena = nullptr;
+
+        bool operator()(string_handle a, string_handle b) const { return arena->view(a) < arena->view(b); }
+        bool operator()(string_handle a, std::string_view b) const { return arena->view(a) < b; }
+        bool operator()(std::string_view a, string_handle b) const { return a < arena->view(b); }
+    };
+
+    using arena_hash = basic_arena_hash<string_arena>;
+    using arena_equal = basic_arena_equal<string_arena>;
+    using arena_less = basic_arena_less<string_arena>;
+}
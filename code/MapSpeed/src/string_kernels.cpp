@@ -0,0 +1,210 @@
+#include "string_kernels.h"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+#if defined(MAP_SPEED_X64_KERNELS)
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang compile each kernel for its own instruction set so the rest of the build keeps the baseline
+// target; MSVC allows the intrinsics anywhere.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define MAP_SPEED_TARGET(isa)
+#else
+#define MAP_SPEED_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace map_speed
+{
+    namespace
+    {
+        struct cpu_features
+        {
+            bool sse42 = false;
+            bool aes = false;
+            bool avx2 = false;
+        };
+
+        cpu_features detect_cpu_features()
+        {
+            cpu_features features;
+#if defined(MAP_SPEED_X64_KERNELS)
+#if defined(_MSC_VER) && !defined(__clang__)
+            int info[4];
+            __cpuid(info, 1);
+            features.sse42 = (info[2] & (1 << 20)) != 0;
+            features.aes = (info[2] & (1 << 25)) != 0;
+            auto osAvx = ((info[2] & (1 << 27)) != 0) && ((info[2] & (1 << 28)) != 0) && ((_xgetbv(0) & 6) == 6);
+            __cpuidex(info, 7, 0);
+            features.avx2 = osAvx && ((info[1] & (1 << 5)) != 0);
+#else
+            __builtin_cpu_init();
+            features.sse42 = __builtin_cpu_supports("sse4.2");
+            features.aes = __builtin_cpu_supports("aes");
+            features.avx2 = __builtin_cpu_supports("avx2");
+#endif
+#endif
+            return features;
+        }
+
+        cpu_features const& cpu()
+        {
+            static cpu_features const features = detect_cpu_features();
+            return features;
+        }
+
+#if defined(MAP_SPEED_X64_KERNELS)
+        using namespace string_kernel_detail;
+
+        MAP_SPEED_TARGET("sse4.2") uint64_t crc32_hash_impl(char const* p, size_t n)
+        {
+            uint64_t c0 = secret[2] ^ n;
+            uint64_t c1 = secret[3];
+            if (n >= 8)
+            {
+                size_t i = 0;
+                for (; i + 16 <= n; i += 16)
+                {
+                    c0 = _mm_crc32_u64(c0, read64(p + i));
+                    c1 = _mm_crc32_u64(c1, read64(p + i + 8));
+                }
+
+                // The last 1..15 bytes, re-reading some of the previous word rather than looping over bytes.
+                if (n - i > 8)
+                {
+                    c0 = _mm_crc32_u64(c0, read64(p + i));
+                }
+                if (i < n)
+                {
+                    c1 = _mm_crc32_u64(c1, read64(p + n - 8));
+                }
+            }
+            else if (n >= 4)
+            {
+                c0 = _mm_crc32_u32(static_cast<uint32_t>(c0), static_cast<uint32_t>(read32(p)));
+                c1 = _mm_crc32_u32(static_cast<uint32_t>(c1), static_cast<uint32_t>(read32(p + n - 4)));
+            }
+            else if (n > 0)
+            {
+                c0 = _mm_crc32_u32(static_cast<uint32_t>(c0), static_cast<uint32_t>(read_small(p, n)));
+            }
+
+            // CRC is linear; one multiply makes every output bit depend on every input bit.
+            return mix(((c0 << 32) | (c1 & 0xFFFFFFFFu)) ^ secret[0], n ^ secret[1]);
+        }
+
+        MAP_SPEED_TARGET("aes,sse4.1") uint64_t aes_hash_impl(char const* p, size_t n)
+        {
+            auto key0 = _mm_set_epi64x(static_cast<long long>(secret[0]), static_cast<long long>(secret[1]));
+            auto key1 = _mm_set_epi64x(static_cast<long long>(secret[2]), static_cast<long long>(secret[3]));
+            auto h = _mm_set_epi64x(static_cast<long long>(n), static_cast<long long>(secret[2]));
+            __m128i tail;
+            if (n <= 16)
+            {
+                tail = load_partial(p, n);
+            }
+            else
+            {
+                for (size_t i = 0; i + 16 < n; i += 16)
+                {
+                    h = _mm_aesenc_si128(_mm_xor_si128(h, _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i))), key0);
+                }
+                tail = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + n - 16));
+            }
+
+            // Three rounds spread every input byte across all 128 bits.
+            h = _mm_aesenc_si128(_mm_xor_si128(h, tail), key0);
+            h = _mm_aesenc_si128(h, key1);
+            h = _mm_aesenc_si128(h, key0);
+            return static_cast<uint64_t>(_mm_cvtsi128_si64(h)) ^ static_cast<uint64_t>(_mm_extract_epi64(h, 1));
+        }
+
+        MAP_SPEED_TARGET("avx2") int compare_avx2(std::string_view a, std::string_view b)
+        {
+            auto n = std::min(a.size(), b.size());
+            size_t i = 0;
+            for (; i + 32 <= n; i += 32)
+            {
+                auto va = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(a.data() + i));
+                auto vb = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(b.data() + i));
+                auto equal = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)));
+                if (equal != 0xFFFFFFFFu)
+                {
+                    return byte_difference(a.data(), b.data(), i + std::countr_one(equal));
+                }
+            }
+            return compare_sse2_from(a, b, i);
+        }
+
+        int compare_sse2(std::string_view a, std::string_view b)
+        {
+            return compare_sse2_from(a, b, 0);
+        }
+#endif
+
+        using compare_function = int (*)(std::string_view, std::string_view);
+
+        compare_function select_compare()
+        {
+#if defined(MAP_SPEED_X64_KERNELS)
+            return cpu().avx2 ? compare_avx2 : compare_sse2;
+#else
+            return [](std::string_view a, std::string_view b) { return a.compare(b); };
+#endif
+        }
+
+        compare_function const g_compare = select_compare();
+    }
+
+    bool kernel_supported(hash_kernel kernel)
+    {
+        switch (kernel)
+        {
+        case hash_kernel::crc32: return cpu().sse42;
+        case hash_kernel::aes: return cpu().aes;
+        default: return true;
+        }
+    }
+
+    bool kernel_supported(compare_kernel kernel)
+    {
+#if defined(MAP_SPEED_X64_KERNELS)
+        (void)kernel;
+        return true;
+#else
+        return kernel == compare_kernel::standard;
+#endif
+    }
+
+    uint64_t crc32_hash_bytes(char const* p, size_t n)
+    {
+#if defined(MAP_SPEED_X64_KERNELS)
+        return crc32_hash_impl(p, n);
+#else
+        (void)p;
+        (void)n;
+        throw std::logic_error("crc32 kernel is not available on this architecture");
+#endif
+    }
+
+    uint64_t aes_hash_bytes(char const* p, size_t n)
+    {
+#if defined(MAP_SPEED_X64_KERNELS)
+        return aes_hash_impl(p, n);
+#else
+        (void)p;
+        (void)n;
+        throw std::logic_error("aes kernel is not available on this architecture");
+#endif
+    }
+
+    int simd_compare_long(std::string_view a, std::string_view b)
+    {
+        return g_compare(a, b);
+    }
+}
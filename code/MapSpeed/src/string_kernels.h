@@ -0,0 +1,264 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define MAP_SPEED_X64_KERNELS 1
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__clang__) || defined(__GNUC__)
+#define MAP_SPEED_NO_ASAN __attribute__((no_sanitize_address))
+#else
+#define MAP_SPEED_NO_ASAN
+#endif
+
+/*
+    Hash and comparison kernels for short string keys.
+
+    The benchmark's random strings are 5 to 20 bytes, where std::hash (a byte-at-a-time FNV or a general
+    purpose murmur-style loop) and memcmp's setup cost dominate a lookup. The kernels here are specialised for
+    that range:
+
+    wyhash - reads the key as at most four overlapping 32/64-bit words and folds them with two 64x64->128
+        multiplies; portable.
+    crc32  - two interleaved CRC32C streams over 8-byte words (SSE4.2), folded with one multiply.
+    aes    - the key loaded as one or two overlapping 16-byte vectors and mixed with three AES rounds (AES-NI).
+    simd   - a three-way compare that finds the first differing byte with 16-byte (SSE2) equality masks, inline,
+        switching to an out-of-line 32-byte (AVX2) loop when both keys are at least 32 bytes long.
+
+    crc32, aes and the AVX2 compare path are compiled for their instruction sets individually and chosen at run
+    time; kernel_supported reports whether this CPU can run a kernel at all. SSE2 is part of x86-64 itself.
+*/
+namespace map_speed
+{
+    enum class hash_kernel
+    {
+        standard,
+        wyhash,
+        crc32,
+        aes,
+    };
+
+    enum class compare_kernel
+    {
+        standard,
+        simd,
+    };
+
+    bool kernel_supported(hash_kernel kernel);
+    bool kernel_supported(compare_kernel kernel);
+
+    namespace string_kernel_detail
+    {
+        constexpr uint64_t secret[4] = { 0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull };
+
+        inline void multiply_fold(uint64_t& a, uint64_t& b)
+        {
+#if defined(__SIZEOF_INT128__)
+            auto product = static_cast<unsigned __int128>(a) * b;
+            a = static_cast<uint64_t>(product);
+            b = static_cast<uint64_t>(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+            a = _umul128(a, b, &b);
+#else
+            auto ha = a >> 32, hb = b >> 32, la = static_cast<uint32_t>(a), lb = static_cast<uint32_t>(b);
+            auto rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+            auto t = rl + (rm0 << 32);
+            auto carry = static_cast<uint64_t>(t < rl);
+            auto lo = t + (rm1 << 32);
+            carry += static_cast<uint64_t>(lo < t);
+            b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+            a = lo;
+#endif
+        }
+
+        inline uint64_t mix(uint64_t a, uint64_t b)
+        {
+            multiply_fold(a, b);
+            return a ^ b;
+        }
+
+        inline uint64_t read64(char const* p)
+        {
+            uint64_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline uint64_t read32(char const* p)
+        {
+            uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        // Up to three bytes as first, middle and last, the way wyhash treats the shortest keys.
+        inline uint64_t read_small(char const* p, size_t n)
+        {
+            return (static_cast<uint64_t>(static_cast<uint8_t>(p[0])) << 16) |
+                (static_cast<uint64_t>(static_cast<uint8_t>(p[n >> 1])) << 8) | static_cast<uint8_t>(p[n - 1]);
+        }
+    }
+
+    // A wyhash-style hash. Keys of 4 to 16 bytes are covered by overlapping reads with no loop at all.
+    inline uint64_t wyhash_bytes(char const* p, size_t n)
+    {
+        using namespace string_kernel_detail;
+        auto seed = mix(secret[0], secret[1]);
+        uint64_t a, b;
+        if (n <= 16)
+        {
+            if (n >= 4)
+            {
+                auto step = (n >> 3) << 2;
+                a = (read32(p) << 32) | read32(p + step);
+                b = (read32(p + n - 4) << 32) | read32(p + n - 4 - step);
+            }
+            else if (n > 0)
+            {
+                a = read_small(p, n);
+                b = 0;
+            }
+            else
+            {
+                a = b = 0;
+            }
+        }
+        else
+        {
+            size_t i = n;
+            char const* q = p;
+            for (; i > 16; i -= 16, q += 16)
+            {
+                seed = mix(read64(q) ^ secret[1], read64(q + 8) ^ seed);
+            }
+            a = read64(p + n - 16);
+            b = read64(p + n - 8);
+        }
+
+        a ^= secret[1];
+        b ^= seed;
+        multiply_fold(a, b);
+        return mix(a ^ secret[0] ^ n, b ^ secret[1]);
+    }
+
+    uint64_t crc32_hash_bytes(char const* p, size_t n);
+    uint64_t aes_hash_bytes(char const* p, size_t n);
+
+    // The AVX2-dispatched compare for long keys.
+    int simd_compare_long(std::string_view a, std::string_view b);
+
+#if defined(MAP_SPEED_X64_KERNELS)
+    namespace string_kernel_detail
+    {
+        // Loads n < 16 bytes into the low lanes of a vector and zeroes the rest. Reading the full 16 bytes is
+        // safe whenever p points at a real byte and they do not cross into the next page; the bytes past n are
+        // masked off.
+        MAP_SPEED_NO_ASAN inline __m128i load_partial(char const* p, size_t n)
+        {
+            if (n == 0)
+            {
+                return _mm_setzero_si128();
+            }
+
+            if ((reinterpret_cast<uintptr_t>(p) & 4095) <= 4096 - 16)
+            {
+                auto keep = _mm_cmpgt_epi8(_mm_set1_epi8(static_cast<char>(n)), _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+                return _mm_and_si128(_mm_loadu_si128(reinterpret_cast<__m128i const*>(p)), keep);
+            }
+
+            alignas(16) char buffer[16] = {};
+            std::memcpy(buffer, p, n);
+            return _mm_load_si128(reinterpret_cast<__m128i const*>(buffer));
+        }
+
+        inline int byte_difference(char const* a, char const* b, size_t i)
+        {
+            return static_cast<int>(static_cast<uint8_t>(a[i])) - static_cast<int>(static_cast<uint8_t>(b[i]));
+        }
+
+        // Compares from byte i on in 16-byte steps, with a masked load for the final partial block.
+        inline int compare_sse2_from(std::string_view a, std::string_view b, size_t i)
+        {
+            auto n = std::min(a.size(), b.size());
+            for (; i + 16 <= n; i += 16)
+            {
+                auto va = _mm_loadu_si128(reinterpret_cast<__m128i const*>(a.data() + i));
+                auto vb = _mm_loadu_si128(reinterpret_cast<__m128i const*>(b.data() + i));
+                auto equal = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)));
+                if (equal != 0xFFFF)
+                {
+                    return byte_difference(a.data(), b.data(), i + std::countr_one(equal));
+                }
+            }
+
+            if (i < n)
+            {
+                auto rest = n - i;
+                auto equal = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(load_partial(a.data() + i, rest), load_partial(b.data() + i, rest))));
+                equal |= ~((1u << rest) - 1);
+                if (equal != 0xFFFFFFFFu)
+                {
+                    return byte_difference(a.data(), b.data(), i + std::countr_one(equal));
+                }
+            }
+
+            return (a.size() < b.size()) ? -1 : static_cast<int>(a.size() > b.size());
+        }
+    }
+#endif
+
+    // <0, 0 or >0 as a is less than, equal to or greater than b, comparing bytes as unsigned like std::string.
+    inline int simd_compare(std::string_view a, std::string_view b)
+    {
+#if defined(MAP_SPEED_X64_KERNELS)
+        if (std::min(a.size(), b.size()) >= 32)
+        {
+            return simd_compare_long(a, b);
+        }
+        return string_kernel_detail::compare_sse2_from(a, b, 0);
+#else
+        return a.compare(b);
+#endif
+    }
+
+    template<hash_kernel Kernel> struct kernel_hash;
+
+    template<> struct kernel_hash<hash_kernel::wyhash>
+    {
+        using is_transparent = void;
+        static constexpr std::string_view name = "wyhash";
+        uint64_t operator()(std::string_view s) const { return wyhash_bytes(s.data(), s.size()); }
+    };
+
+    template<> struct kernel_hash<hash_kernel::crc32>
+    {
+        using is_transparent = void;
+        static constexpr std::string_view name = "crc32";
+        uint64_t operator()(std::string_view s) const { return crc32_hash_bytes(s.data(), s.size()); }
+    };
+
+    template<> struct kernel_hash<hash_kernel::aes>
+    {
+        using is_transparent = void;
+        static constexpr std::string_view name = "aes";
+        uint64_t operator()(std::string_view s) const { return aes_hash_bytes(s.data(), s.size()); }
+    };
+
+    template<compare_kernel Kernel> struct kernel_less;
+
+    template<> struct kernel_less<compare_kernel::simd>
+    {
+        using is_transparent = void;
+        static constexpr std::string_view name = "simd";
+        bool operator()(std::string_view a, std::string_view b) const { return simd_compare(a, b) < 0; }
+    };
+}
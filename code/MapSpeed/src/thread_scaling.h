@@ -0,0 +1,79 @@
+#pragma once
+
+#include "prefetch.h"
+#include "timer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <latch>
+#include <thread>
+#include <vector>
+
+namespace map_speed
+{
+    template<typename R> struct threaded_run
+    {
+        R combined{};
+        std::vector<double> threadSeconds;
+        double wallSeconds = 0;     // from the first thread starting until the last one finished
+    };
+
+    // Runs fn(threadIndex) on threadCount threads that are released together, timing each thread from its own
+    // start to its own finish, and the whole run from the earliest start to the latest finish. Each thread writes
+    // its result into its own cache line so the harness does not add false sharing of its own to what is being
+    // measured. R must support +=.
+    template<typename R, typename Fn> threaded_run<R> run_threaded(uint32_t threadCount, Fn const& fn)
+    {
+        struct alignas(cache_line_size) slot
+        {
+            R result{};
+            timer threadTimer;
+        };
+
+        std::vector<slot> slots(threadCount);
+        std::latch start(1);
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount);
+        for (uint32_t i = 0; i < threadCount; i++)
+        {
+            threads.emplace_back([&, i] {
+                start.wait();
+                slots[i].threadTimer = timer();
+                slots[i].result = fn(i);
+                slots[i].threadTimer.stop();
+            });
+        }
+
+        start.count_down();
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+
+        threaded_run<R> run;
+        auto first = slots.front().threadTimer.start;
+        auto last = slots.front().threadTimer.end;
+        for (auto const& s : slots)
+        {
+            run.combined += s.result;
+            run.threadSeconds.push_back(s.threadTimer.duration());
+            first = std::min(first, s.threadTimer.start);
+            last = std::max(last, s.threadTimer.end);
+        }
+        run.wallSeconds = std::chrono::duration<double>(last - first).count();
+        return run;
+    }
+
+    // Expands a single --threads N into the powers of two below N, then N itself: 8 gives 1,2,4,8 and 6 gives
+    // 1,2,4,6.
+    inline std::vector<uint32_t> expand_thread_counts(uint32_t maxThreads)
+    {
+        std::vector<uint32_t> counts;
+        for (uint32_t t = 1; t < maxThreads; t *= 2)
+        {
+            counts.push_back(t);
+        }
+        counts.push_back(maxThreads);
+        return counts;
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <chrono>
+
+namespace map_speed
+{
+    struct timer {
+        std::chrono::high_resolution_clock::time_point start;
+        std::chrono::high_resolution_clock::time_point end;
+
+        timer() : start(std::chrono::high_resolution_clock::now()) {}
+
+        void stop()
+        {
+            end = std::chrono::high_resolution_clock::now();
+        }
+
+        double duration() const
+        {
+            return std::chrono::duration_cast<std::chrono::duration<double>>(end - start).count();
+        }
+    };
+}
@@ -0,0 +1,274 @@
+#pragma once
+
+#include "content.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_set>
+#include <vector>
+
+/*
+    Key distributions and access patterns, so the benchmark can be run on something closer to production traffic
+    than unique uniform keys searched in a uniform shuffle.
+
+    Key distributions decide what the keys look like:
+        random     - the original generator: 5-20 uppercase letters, or uniform 32-bit integers
+        paths      - file-system style paths sharing long directory prefixes (strings only)
+        guids      - 36-character registry-format GUIDs (strings only)
+        sequential - dense IDs: "key-00000000" upward, or consecutive integers
+
+    Access patterns decide the order and frequency in which they are searched for:
+        uniform    - every key exactly once per pass, shuffled (the original behaviour)
+        zipf:S     - ranks drawn from a Zipf distribution with exponent S over a random ranking of the keys
+        hot:F:P    - a fraction F of the keys receives a fraction P of the lookups
+        sorted     - every key once per pass, in ascending order
+        trace:PATH - replays PATH, one key per line; its distinct keys, in order of first appearance, become the
+                     key set, and the first N of them are inserted at size point N
+*/
+namespace map_speed
+{
+    enum class key_distribution
+    {
+        random,
+        paths,
+        guids,
+        sequential,
+    };
+
+    enum class access_kind
+    {
+        uniform,
+        zipf,
+        hot_set,
+        sorted,
+        trace,
+    };
+
+    struct access_pattern
+    {
+        access_kind kind = access_kind::uniform;
+        double zipfExponent = 0.99;
+        double hotFraction = 0.1;
+        double hotProbability = 0.9;
+        std::string tracePath;
+    };
+
+    inline std::string_view key_distribution_name(key_distribution distribution)
+    {
+        switch (distribution)
+        {
+        case key_distribution::paths: return "paths";
+        case key_distribution::guids: return "guids";
+        case key_distribution::sequential: return "sequential";
+        default: return "random";
+        }
+    }
+
+    // The pattern in the form --access accepts, e.g. "zipf:0.99".
+    inline std::string access_pattern_name(access_pattern const& pattern)
+    {
+        std::ostringstream name;
+        switch (pattern.kind)
+        {
+        case access_kind::zipf:
+            name << "zipf:" << pattern.zipfExponent;
+            return name.str();
+        case access_kind::hot_set:
+            name << "hot:" << pattern.hotFraction << ':' << pattern.hotProbability;
+            return name.str();
+        case access_kind::sorted: return "sorted";
+        case access_kind::trace: return "trace:" + pattern.tracePath;
+        default: return "uniform";
+        }
+    }
+
+    // The index'th key of a distribution; random ones draw from g_random and ignore index.
+    template<typename T> T generateKey(key_distribution distribution, uint64_t index);
+
+    template<> inline std::string generateKey<std::string>(key_distribution distribution, uint64_t index)
+    {
+        char buffer[64];
+        switch (distribution)
+        {
+        case key_distribution::paths:
+        {
+            static constexpr char const* roots[] = { "/usr/share/app", "/var/lib/service", "/home/build/src", "/opt/vendor/runtime" };
+            static constexpr char const* extensions[] = { "json", "txt", "bin", "log", "cpp", "h" };
+            auto root = roots[g_random() % std::size(roots)];
+            auto extension = extensions[g_random() % std::size(extensions)];
+            std::snprintf(buffer, sizeof(buffer), "%s/module%02u/part%03u/file%06u.%s", root,
+                static_cast<unsigned>(g_random() % 16), static_cast<unsigned>(g_random() % 256), static_cast<unsigned>(g_random() % 1000000), extension);
+            return buffer;
+        }
+
+        case key_distribution::guids:
+        {
+            auto a = g_random(), b = g_random(), c = g_random(), d = g_random();
+            std::snprintf(buffer, sizeof(buffer), "%08X-%04X-%04X-%04X-%04X%08X", static_cast<unsigned>(a), static_cast<unsigned>(b >> 16),
+                static_cast<unsigned>(b & 0xFFFF), static_cast<unsigned>(c >> 16), static_cast<unsigned>(c & 0xFFFF), static_cast<unsigned>(d));
+            return buffer;
+        }
+
+        case key_distribution::sequential:
+            std::snprintf(buffer, sizeof(buffer), "key-%08llu", static_cast<unsigned long long>(index));
+            return buffer;
+
+        default:
+            return generateRandom<std::string>();
+        }
+    }
+
+    template<> inline uint32_t generateKey<uint32_t>(key_distribution distribution, uint64_t index)
+    {
+        return (distribution == key_distribution::sequential) ? static_cast<uint32_t>(index) : generateRandom<uint32_t>();
+    }
+
+    // As generateContent, but drawing keys from the given distribution.
+    template<typename T> std::vector<T> generateContent(key_distribution distribution, uint64_t length)
+    {
+        if (distribution == key_distribution::random)
+        {
+            return generateContent<T>(length);
+        }
+
+        std::vector<T> content;
+        content.reserve(length);
+        for (uint64_t i = 0; i < length; i++)
+        {
+            content.push_back(generateKey<T>(distribution, i));
+        }
+
+        if (distribution != key_distribution::sequential)
+        {
+            sortUnique(content);
+        }
+        std::shuffle(content.begin(), content.end(), g_random);
+        return content;
+    }
+
+    // Reads a key trace, one key per line. Integer traces must hold one decimal value per line.
+    template<typename T> std::vector<T> read_trace(std::string const& path)
+    {
+        std::ifstream in(path);
+        if (!in)
+        {
+            throw std::runtime_error("cannot open trace file " + path);
+        }
+
+        std::vector<T> keys;
+        std::string line;
+        for (uint64_t lineNumber = 1; std::getline(in, line); lineNumber++)
+        {
+            if (!line.empty() && (line.back() == '\r'))
+            {
+                line.pop_back();
+            }
+
+            if constexpr (std::is_same_v<T, std::string>)
+            {
+                keys.push_back(std::move(line));
+            }
+            else
+            {
+                if (line.empty())
+                {
+                    continue;
+                }
+
+                T value{};
+                auto [end, error] = std::from_chars(line.data(), line.data() + line.size(), value);
+                if ((error != std::errc()) || (end != line.data() + line.size()))
+                {
+                    throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": not an integer key: " + line);
+                }
+                keys.push_back(value);
+            }
+        }
+        return keys;
+    }
+
+    // The distinct keys of a trace in order of first appearance.
+    template<typename T> std::vector<T> distinct_keys(std::vector<T> const& trace)
+    {
+        std::unordered_set<T> seen;
+        std::vector<T> keys;
+        for (auto const& key : trace)
+        {
+            if (seen.insert(key).second)
+            {
+                keys.push_back(key);
+            }
+        }
+        return keys;
+    }
+
+    // One pass of searches over keys, in the pattern's order and frequency. Passes for the sampled patterns are
+    // as long as keys itself so operation counts stay comparable with the uniform pattern.
+    template<typename T> std::vector<T> make_access_stream(access_pattern const& pattern, std::vector<T> const& keys)
+    {
+        std::vector<T> stream;
+        if (keys.empty())
+        {
+            return stream;
+        }
+
+        switch (pattern.kind)
+        {
+        case access_kind::zipf:
+        {
+            // Rank i (the i'th key in the current order) has weight 1 / (i + 1)^s.
+            std::vector<double> cumulative(keys.size());
+            double total = 0;
+            for (size_t i = 0; i < keys.size(); i++)
+            {
+                total += 1.0 / std::pow(static_cast<double>(i + 1), pattern.zipfExponent);
+                cumulative[i] = total;
+            }
+
+            std::uniform_real_distribution<double> draw(0.0, total);
+            stream.reserve(keys.size());
+            for (size_t i = 0; i < keys.size(); i++)
+            {
+                auto rank = std::upper_bound(cumulative.begin(), cumulative.end(), draw(g_random)) - cumulative.begin();
+                stream.push_back(keys[std::min<size_t>(rank, keys.size() - 1)]);
+            }
+            break;
+        }
+
+        case access_kind::hot_set:
+        {
+            auto hotCount = std::clamp<size_t>(static_cast<size_t>(keys.size() * pattern.hotFraction), 1, keys.size());
+            std::bernoulli_distribution hot(pattern.hotProbability);
+            std::uniform_int_distribution<size_t> hotKey(0, hotCount - 1);
+            std::uniform_int_distribution<size_t> coldKey(std::min(hotCount, keys.size() - 1), keys.size() - 1);
+            stream.reserve(keys.size());
+            for (size_t i = 0; i < keys.size(); i++)
+            {
+                stream.push_back(keys[hot(g_random) ? hotKey(g_random) : coldKey(g_random)]);
+            }
+            break;
+        }
+
+        case access_kind::sorted:
+            stream = keys;
+            std::sort(stream.begin(), stream.end());
+            break;
+
+        default:
+            stream = keys;
+            std::shuffle(stream.begin(), stream.end(), g_random);
+            break;
+        }
+        return stream;
+    }
+}
@@ -1,50 +1,314 @@
+// main.cpp : Compares strategies for mapping a large read-only file: time to first byte, sequential and random
+// read throughput, and the page faults each costs. With no --file it maps its own executable, as it always has.
+//
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
 #include <iostream>
-#include <windows.h>
+#include <random>
+#include <string>
+#include <vector>
 
-int main(int, char**){
+using namespace mem_map;
 
-    // Get the path to the executable, then memory map it using read-only large page support.
-    wchar_t exePath[MAX_PATH];
-    GetModuleFileNameW(NULL, exePath, MAX_PATH);
+namespace
+{
+    struct options
+    {
+        std::filesystem::path file;
+        std::vector<map_strategy> strategies{ map_strategy::plain, map_strategy::populate, map_strategy::sequential, map_strategy::random, map_strategy::huge };
+        std::filesystem::path hugetlbfs;
+        uint64_t randomReads = 1'000'000;
+        uint32_t repetitions = 3;
+        bool cold = true;
+        bool help = false;
+    };
 
-    // Open this file for read access.
-    HANDLE hFile = CreateFileW(exePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-    if (hFile == INVALID_HANDLE_VALUE) {
-        std::wcerr << L"Failed to open file: " << exePath << L" Error: " << GetLastError() << std::endl;
-        return 1;
+    // One repetition of one strategy. Each pass maps the file afresh (from a cold cache unless --warm).
+    struct sample
+    {
+        double firstByteSeconds = 0;
+        double sequentialSeconds = 0;
+        double randomSeconds = 0;
+        page_faults sequentialFaults;
+        page_faults randomFaults;
+        std::string backing;
+        uint64_t checksum = 0;
+    };
+
+    using clock_type = std::chrono::steady_clock;
+
+    double seconds_since(clock_type::time_point start)
+    {
+        return std::chrono::duration<double>(clock_type::now() - start).count();
     }
 
-    // Create a file mapping object with large page support.
-    HANDLE hMap = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
-    if (hMap == NULL) {
-        std::wcerr << L"Failed to create file mapping. Error: " << GetLastError() << std::endl;
-        CloseHandle(hFile);
-        return 1;
+    page_faults faults_since(page_faults const& before)
+    {
+        auto now = current_page_faults();
+        return { now.minor - before.minor, now.major - before.major };
     }
-    
-    // Map the view of the file into memory.
-    void* pMapView = MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
-    if (pMapView == NULL) {
-        std::wcerr << L"Failed to map view of file. Error: " << GetLastError() << std::endl;
-        CloseHandle(hMap);
-        CloseHandle(hFile);
-        return 1;
+
+    // Sums the file a word at a time so every byte is read and the loop cannot be discarded.
+    uint64_t read_sequential(std::span<const std::byte> bytes)
+    {
+        uint64_t sum = 0;
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= bytes.size(); i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            std::memcpy(&word, bytes.data() + i, sizeof(word));
+            sum += word;
+        }
+        for (; i < bytes.size(); i++)
+        {
+            sum += static_cast<uint64_t>(bytes[i]);
+        }
+        return sum;
+    }
+
+    uint64_t read_random(std::span<const std::byte> bytes, std::vector<size_t> const& offsets)
+    {
+        uint64_t sum = 0;
+        for (auto offset : offsets)
+        {
+            sum += static_cast<uint64_t>(bytes[offset]);
+        }
+        return sum;
+    }
+
+    sample run_once(options const& opts, map_strategy strategy, std::vector<size_t> const& offsets)
+    {
+        sample s;
+
+        // Time to first byte and random reads share a mapping: the random pass is what a lookup-heavy consumer
+        // of the file sees right after opening it.
+        {
+            if (opts.cold)
+            {
+                evict_file_cache(opts.file);
+            }
+
+            auto faults = current_page_faults();
+            auto start = clock_type::now();
+            mapped_file view(opts.file, strategy, opts.hugetlbfs);
+            s.checksum += static_cast<uint64_t>(view.bytes()[0]);
+            s.firstByteSeconds = seconds_since(start);
+
+            auto randomStart = clock_type::now();
+            s.checksum += read_random(view.bytes(), offsets);
+            s.randomSeconds = seconds_since(randomStart);
+            s.randomFaults = faults_since(faults);
+        }
+
+        {
+            if (opts.cold)
+            {
+                evict_file_cache(opts.file);
+            }
+
+            auto faults = current_page_faults();
+            auto start = clock_type::now();
+            mapped_file view(opts.file, strategy, opts.hugetlbfs);
+            s.checksum += read_sequential(view.bytes());
+            s.sequentialSeconds = seconds_since(start);
+            s.sequentialFaults = faults_since(faults);
+            s.backing = view.backing();
+        }
+        return s;
     }
 
-    // Determine the page properties of the mapped view
-    SYSTEM_INFO sysInfo;
-    GetSystemInfo(&sysInfo);
-    std::wcout << L"System Page Size: " << sysInfo.dwPageSize
-                << L", Allocation Granularity: " << sysInfo.dwAllocationGranularity << std::endl;
-    std::wcout << L"Mapped View Address: " << pMapView << std::endl;
-    std::wcout << L"Large Page Size: " << GetLargePageMinimum() << std::endl;
+    template<typename Fn> double median_of(std::vector<sample> const& samples, Fn&& field)
+    {
+        std::vector<double> values;
+        for (auto const& s : samples)
+        {
+            values.push_back(static_cast<double>(field(s)));
+        }
+        std::sort(values.begin(), values.end());
+        return values[values.size() / 2];
+    }
 
-    WIN32_MEMORY_REGION_INFORMATION  mbi;
-    if (!QueryVirtualMemoryInformation(GetCurrentProcess(), pMapView, MemoryRegionInfo, &mbi, sizeof(mbi), NULL)) {
-        std::wcerr << L"QueryVirtualMemoryInformation failed. Error: " << GetLastError() << std::endl;
-    } else {
-        std::wcout << L"Region Size: " << mbi.RegionSize << std::endl;
+    std::vector<std::string> split(std::string const& list)
+    {
+        std::vector<std::string> parts;
+        size_t start = 0;
+        while (start <= list.size())
+        {
+            auto comma = list.find(',', start);
+            if (comma == std::string::npos)
+            {
+                comma = list.size();
+            }
+            parts.push_back(list.substr(start, comma - start));
+            start = comma + 1;
+        }
+        return parts;
+    }
+
+    map_strategy parse_strategy(std::string const& name)
+    {
+        for (auto strategy : { map_strategy::plain, map_strategy::populate, map_strategy::sequential, map_strategy::random, map_strategy::huge, map_strategy::hugetlbfs })
+        {
+            if (name == map_strategy_name(strategy))
+            {
+                return strategy;
+            }
+        }
+        throw std::invalid_argument("unknown strategy " + name);
+    }
+
+    char const* usage =
+        "usage: MemMapLargePages [options]\n"
+        "  --file PATH              file to map (default: this executable)\n"
+        "  --strategies a,b,...     plain, populate, sequential, random, huge, hugetlbfs\n"
+        "                           (default: all but hugetlbfs)\n"
+        "  --hugetlbfs DIR          hugetlbfs mount to stage copies in; adds the hugetlbfs strategy\n"
+        "  --random-reads N         single-byte reads at random offsets per pass (default: 1000000)\n"
+        "  --repetitions N          repetitions per strategy; medians are reported (default: 3)\n"
+        "  --warm                   do not drop the file from the OS cache before each pass\n"
+        "  --help                   print this message\n";
+
+    options parse_options(int argc, char** argv, std::filesystem::path const& self)
+    {
+        options opts;
+        opts.file = self;
+        bool strategiesGiven = false;
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            auto next = [&]() -> std::string {
+                if (i + 1 >= argc)
+                {
+                    throw std::invalid_argument(arg + ": missing value");
+                }
+                return argv[++i];
+            };
+
+            if ((arg == "--help") || (arg == "-h") || (arg == "/?"))
+            {
+                opts.help = true;
+            }
+            else if (arg == "--file")
+            {
+                opts.file = next();
+            }
+            else if (arg == "--strategies")
+            {
+                opts.strategies.clear();
+                for (auto const& name : split(next()))
+                {
+                    opts.strategies.push_back(parse_strategy(name));
+                }
+                strategiesGiven = true;
+            }
+            else if (arg == "--hugetlbfs")
+            {
+                opts.hugetlbfs = next();
+            }
+            else if (arg == "--random-reads")
+            {
+                opts.randomReads = std::stoull(next());
+            }
+            else if (arg == "--repetitions")
+            {
+                opts.repetitions = std::max(1, std::stoi(next()));
+            }
+            else if (arg == "--warm")
+            {
+                opts.cold = false;
+            }
+            else
+            {
+                throw std::invalid_argument("unknown option " + arg);
+            }
+        }
+
+        if (!opts.hugetlbfs.empty() && !strategiesGiven)
+        {
+            opts.strategies.push_back(map_strategy::hugetlbfs);
+        }
+        return opts;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        auto opts = parse_options(argc, argv, std::filesystem::absolute(argv[0]));
+        if (opts.help)
+        {
+            std::cout << usage;
+            return 0;
+        }
+
+        auto fileSize = std::filesystem::file_size(opts.file);
+
+        std::cout << "File: " << opts.file.string() << " (" << fileSize << " bytes)\n";
+        std::cout << "System page size: " << system_page_size() << ", large page size: " << large_page_size() << "\n";
+        std::cout << (opts.cold ? "Each pass starts from a cold file cache where the OS allows.\n" : "Passes run against a warm file cache.\n");
+
+        // The same offsets for every strategy, so the random passes touch the same pages.
+        std::mt19937_64 rng(1);
+        std::uniform_int_distribution<size_t> offset(0, static_cast<size_t>(fileSize) - 1);
+        std::vector<size_t> offsets(opts.randomReads);
+        for (auto& o : offsets)
+        {
+            o = offset(rng);
+        }
+
+        std::cout << "\n" << std::left << std::setw(12) << "strategy" << std::right
+            << std::setw(12) << "first byte" << std::setw(12) << "seq MB/s" << std::setw(16) << "seq faults"
+            << std::setw(14) << "random ns" << std::setw(16) << "random faults" << "  backing\n";
+
+        uint64_t checksum = 0;
+        for (auto strategy : opts.strategies)
+        {
+            std::vector<sample> samples;
+            try
+            {
+                for (uint32_t r = 0; r < opts.repetitions; r++)
+                {
+                    samples.push_back(run_once(opts, strategy, offsets));
+                    checksum += samples.back().checksum;
+                }
+            }
+            catch (std::exception const& e)
+            {
+                std::cout << std::left << std::setw(12) << map_strategy_name(strategy) << "  skipped: " << e.what() << "\n";
+                continue;
+            }
+
+            auto faults = [](page_faults const& f) { return std::to_string(f.minor) + "/" + std::to_string(f.major); };
+            auto seqSeconds = median_of(samples, [](sample const& s) { return s.sequentialSeconds; });
+            auto randomSeconds = median_of(samples, [](sample const& s) { return s.randomSeconds; });
+            auto const& last = samples.back();
+
+            std::cout << std::left << std::setw(12) << map_strategy_name(strategy) << std::right << std::fixed
+                << std::setw(10) << std::setprecision(1) << median_of(samples, [](sample const& s) { return s.firstByteSeconds; }) * 1e6 << "us"
+                << std::setw(12) << std::setprecision(0) << (static_cast<double>(fileSize) / 1e6) / seqSeconds
+                << std::setw(16) << faults(last.sequentialFaults)
+                << std::setw(14) << std::setprecision(1) << ((opts.randomReads != 0) ? randomSeconds * 1e9 / opts.randomReads : 0.0)
+                << std::setw(16) << faults(last.randomFaults) << "  " << last.backing << "\n";
+        }
+
+        std::cout << "\nFaults are minor/major for the last repetition; first byte includes opening and mapping (and the\n"
+            "copy, for the huge strategies). Checksum " << checksum << "\n";
+    }
+    catch (std::invalid_argument const& e)
+    {
+        std::cerr << "MemMapLargePages: " << e.what() << "\n" << usage;
+        return 1;
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << "MemMapLargePages: " << e.what() << "\n";
+        return 1;
     }
 
-    std::wcout << L"Hello, from MemMapLargePages! Executable Path: " << exePath << std::endl;
+    return 0;
 }
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+
+/*
+    A read-only view of a file, mapped with one of several strategies so they can be compared:
+
+        plain       map the file and let pages fault in on first touch
+        populate    map and prefault the whole file up front (MAP_POPULATE; PrefetchVirtualMemory on Windows)
+        sequential  map with a sequential-access hint (MADV_SEQUENTIAL; FILE_FLAG_SEQUENTIAL_SCAN)
+        random      map with a random-access hint, which turns off readahead (MADV_RANDOM; FILE_FLAG_RANDOM_ACCESS)
+        huge        read the file into anonymous huge pages (MAP_HUGETLB, else transparent huge pages;
+                    MEM_LARGE_PAGES on Windows, else ordinary pages)
+        hugetlbfs   copy the file into a hugetlbfs mount and map that copy (POSIX only)
+
+    The huge strategies trade a copy at open for far fewer TLB misses afterwards. There is one implementation
+    per platform, mapped_file_posix.cpp and mapped_file_win32.cpp; construction throws std::runtime_error
+    when the file cannot be opened or the strategy is unsupported here.
+*/
+namespace mem_map
+{
+    enum class map_strategy
+    {
+        plain,
+        populate,
+        sequential,
+        random,
+        huge,
+        hugetlbfs,
+    };
+
+    inline std::string_view map_strategy_name(map_strategy strategy)
+    {
+        switch (strategy)
+        {
+        case map_strategy::plain: return "plain";
+        case map_strategy::populate: return "populate";
+        case map_strategy::sequential: return "sequential";
+        case map_strategy::random: return "random";
+        case map_strategy::huge: return "huge";
+        default: return "hugetlbfs";
+        }
+    }
+
+    class mapped_file
+    {
+    public:
+        // hugetlbfsDirectory is only used by map_strategy::hugetlbfs.
+        mapped_file(std::filesystem::path const& path, map_strategy strategy, std::filesystem::path const& hugetlbfsDirectory = {});
+        ~mapped_file();
+        mapped_file(mapped_file const&) = delete;
+        mapped_file& operator=(mapped_file const&) = delete;
+
+        std::span<const std::byte> bytes() const { return { m_data, m_size }; }
+
+        // What the view is backed by, as far as the platform says: for example "4K pages" or "2048K pages,
+        // 12M huge". Call after the view has been touched.
+        std::string backing() const;
+
+    private:
+        void close();
+        void fill(int fd, std::filesystem::path const& path);  // POSIX: copies the file into the huge strategies' memory
+
+        std::byte* m_data = nullptr;
+        size_t m_size = 0;
+        size_t m_mappedSize = 0;    // the mapping's length, which the huge strategies round up
+        bool m_anonymous = false;   // the huge strategies copy the file instead of mapping it
+        bool m_hugePages = false;   // and got explicit huge (large) pages to copy it into
+        std::filesystem::path m_stagedPath;  // hugetlbfs copy, removed on close
+#if defined(_WIN32)
+        void* m_file = nullptr;
+        void* m_mapping = nullptr;
+#endif
+    };
+
+    struct page_faults
+    {
+        uint64_t minor = 0;     // resolved without I/O (page already cached); Windows counts every fault here
+        uint64_t major = 0;     // needed I/O
+    };
+
+    page_faults current_page_faults();
+
+    // Drops the file's pages from the OS cache where the platform allows, so the next mapping reads from disk.
+    void evict_file_cache(std::filesystem::path const& path);
+
+    size_t system_page_size();
+    size_t large_page_size();   // 0 where there are none
+}
@@ -0,0 +1,316 @@
+#include "mapped_file.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mem_map
+{
+    namespace
+    {
+        // error defaults to errno as the caller sees it; pass it in when cleanup runs between the failure and here.
+        [[noreturn]] void fail(std::filesystem::path const& path, std::string const& what, int error = errno)
+        {
+            throw std::runtime_error(path.string() + ": " + what + ": " + std::strerror(error));
+        }
+
+        // Closes a descriptor on every exit path.
+        struct file_descriptor
+        {
+            int fd;
+            ~file_descriptor()
+            {
+                if (fd >= 0)
+                {
+                    ::close(fd);
+                }
+            }
+        };
+
+        size_t round_up(size_t n, size_t granularity)
+        {
+            return (n + granularity - 1) / granularity * granularity;
+        }
+
+        // Reads the whole file into memory that is already mapped.
+        void read_into(int fd, std::byte* target, size_t size, std::filesystem::path const& path)
+        {
+            size_t done = 0;
+            while (done < size)
+            {
+                auto got = ::pread(fd, target + done, size - done, static_cast<off_t>(done));
+                if (got <= 0)
+                {
+                    fail(path, "read");
+                }
+                done += static_cast<size_t>(got);
+            }
+        }
+
+        // Anonymous memory on explicit huge pages, else on ordinary pages advised for transparent huge pages.
+        std::byte* map_huge_anonymous(size_t length, bool& hugePages)
+        {
+#if defined(MAP_HUGETLB)
+            auto p = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            hugePages = (p != MAP_FAILED);
+            if (hugePages)
+            {
+                return static_cast<std::byte*>(p);
+            }
+#endif
+            auto p2 = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p2 == MAP_FAILED)
+            {
+                return nullptr;
+            }
+#if defined(MADV_HUGEPAGE)
+            ::madvise(p2, length, MADV_HUGEPAGE);
+#endif
+            return static_cast<std::byte*>(p2);
+        }
+    }
+
+    mapped_file::mapped_file(std::filesystem::path const& path, map_strategy strategy, std::filesystem::path const& hugetlbfsDirectory)
+    {
+        file_descriptor file{ ::open(path.c_str(), O_RDONLY) };
+        if (file.fd < 0)
+        {
+            fail(path, "open");
+        }
+
+        struct stat info{};
+        if (::fstat(file.fd, &info) != 0)
+        {
+            fail(path, "stat");
+        }
+        m_size = static_cast<size_t>(info.st_size);
+        if (m_size == 0)
+        {
+            throw std::runtime_error(path.string() + ": empty file");
+        }
+
+        if (strategy == map_strategy::huge)
+        {
+            auto hugeSize = large_page_size();
+            m_mappedSize = round_up(m_size, hugeSize ? hugeSize : system_page_size());
+            m_data = map_huge_anonymous(m_mappedSize, m_hugePages);
+            if (!m_data)
+            {
+                fail(path, "mmap");
+            }
+            m_anonymous = true;
+            fill(file.fd, path);
+            return;
+        }
+
+        if (strategy == map_strategy::hugetlbfs)
+        {
+            // hugetlbfs files cannot be written, only sized and mapped; the copy goes through the mapping.
+            if (hugetlbfsDirectory.empty())
+            {
+                throw std::runtime_error("hugetlbfs: no hugetlbfs mount given (--hugetlbfs DIR)");
+            }
+
+            m_stagedPath = hugetlbfsDirectory / ("mem-map-" + std::to_string(::getpid()) + "-" + path.filename().string());
+            file_descriptor staged{ ::open(m_stagedPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600) };
+            if (staged.fd < 0)
+            {
+                fail(m_stagedPath, "open");
+            }
+
+            m_mappedSize = round_up(m_size, large_page_size() ? large_page_size() : system_page_size());
+            if (::ftruncate(staged.fd, static_cast<off_t>(m_mappedSize)) != 0)
+            {
+                // close() removes the staged file, which can change errno, and forgets its path.
+                auto error = errno;
+                auto stagedPath = m_stagedPath;
+                close();
+                fail(stagedPath, "ftruncate", error);
+            }
+
+            auto p = ::mmap(nullptr, m_mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, staged.fd, 0);
+            if (p == MAP_FAILED)
+            {
+                auto error = errno;
+                auto stagedPath = m_stagedPath;
+                close();
+                fail(stagedPath, "mmap", error);
+            }
+            m_data = static_cast<std::byte*>(p);
+            m_hugePages = true;
+            fill(file.fd, path);
+            return;
+        }
+
+        int flags = MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+        if (strategy == map_strategy::populate)
+        {
+            flags |= MAP_POPULATE;
+        }
+#endif
+        auto p = ::mmap(nullptr, m_size, PROT_READ, flags, file.fd, 0);
+        if (p == MAP_FAILED)
+        {
+            fail(path, "mmap");
+        }
+        m_data = static_cast<std::byte*>(p);
+        m_mappedSize = m_size;
+
+        switch (strategy)
+        {
+        case map_strategy::sequential:
+            ::madvise(p, m_size, MADV_SEQUENTIAL);
+            break;
+        case map_strategy::random:
+            ::madvise(p, m_size, MADV_RANDOM);
+            break;
+#if !defined(MAP_POPULATE)
+        case map_strategy::populate:
+            ::madvise(p, m_size, MADV_WILLNEED);
+            break;
+#endif
+        default:
+            break;
+        }
+    }
+
+    void mapped_file::fill(int fd, std::filesystem::path const& path)
+    {
+        try
+        {
+            read_into(fd, m_data, m_size, path);
+        }
+        catch (...)
+        {
+            close();
+            throw;
+        }
+    }
+
+    mapped_file::~mapped_file()
+    {
+        close();
+    }
+
+    void mapped_file::close()
+    {
+        if (m_data)
+        {
+            ::munmap(m_data, m_mappedSize);
+            m_data = nullptr;
+        }
+
+        if (!m_stagedPath.empty())
+        {
+            std::error_code ignored;
+            std::filesystem::remove(m_stagedPath, ignored);
+            m_stagedPath.clear();
+        }
+    }
+
+    std::string mapped_file::backing() const
+    {
+#if defined(__linux__)
+        // The view's entry in /proc/self/smaps: a header line starting with its address range, then fields.
+        std::ifstream smaps("/proc/self/smaps");
+        std::ostringstream start;
+        start << std::hex << reinterpret_cast<uintptr_t>(m_data) << "-";
+        std::string line;
+        bool inView = false;
+        std::string kernelPageSize;
+        uint64_t hugeKb = 0;
+        while (std::getline(smaps, line))
+        {
+            auto first = line.substr(0, line.find(' '));
+            if ((first.find('-') != std::string::npos) && !first.empty() && (first.back() != ':'))
+            {
+                if (inView)
+                {
+                    break;
+                }
+                inView = (line.rfind(start.str(), 0) == 0);
+                continue;
+            }
+
+            if (!inView)
+            {
+                continue;
+            }
+
+            std::istringstream fields(line);
+            std::string name;
+            uint64_t kb = 0;
+            fields >> name >> kb;
+            if (name == "KernelPageSize:")
+            {
+                kernelPageSize = std::to_string(kb) + "K pages";
+            }
+            else if ((name == "AnonHugePages:") || (name == "FilePmdMapped:") || (name == "ShmemPmdMapped:"))
+            {
+                hugeKb += kb;
+            }
+        }
+
+        if (kernelPageSize.empty())
+        {
+            return "unknown";
+        }
+        return (hugeKb != 0) ? (kernelPageSize + ", " + std::to_string(hugeKb / 1024) + "M huge") : kernelPageSize;
+#else
+        return m_hugePages ? "huge pages" : (m_anonymous ? "anonymous" : "file");
+#endif
+    }
+
+    page_faults current_page_faults()
+    {
+        rusage usage{};
+        ::getrusage(RUSAGE_SELF, &usage);
+        return { static_cast<uint64_t>(usage.ru_minflt), static_cast<uint64_t>(usage.ru_majflt) };
+    }
+
+    void evict_file_cache(std::filesystem::path const& path)
+    {
+#if defined(POSIX_FADV_DONTNEED)
+        file_descriptor file{ ::open(path.c_str(), O_RDONLY) };
+        if (file.fd >= 0)
+        {
+            ::posix_fadvise(file.fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+#else
+        (void)path;
+#endif
+    }
+
+    size_t system_page_size()
+    {
+        return static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    }
+
+    size_t large_page_size()
+    {
+#if defined(__linux__)
+        // "Hugepagesize:       2048 kB"
+        std::ifstream meminfo("/proc/meminfo");
+        std::string line;
+        while (std::getline(meminfo, line))
+        {
+            if (line.rfind("Hugepagesize:", 0) == 0)
+            {
+                size_t kb = 0;
+                std::istringstream(line.substr(13)) >> kb;
+                return kb * 1024;
+            }
+        }
+#endif
+        return 0;
+    }
+}
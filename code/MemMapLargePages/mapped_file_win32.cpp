@@ -0,0 +1,194 @@
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <windows.h>
+#include <psapi.h>
+
+namespace mem_map
+{
+    namespace
+    {
+        // error defaults to GetLastError() as the caller sees it; pass it in when cleanup runs in between.
+        [[noreturn]] void fail(std::filesystem::path const& path, std::string const& what, DWORD error = GetLastError())
+        {
+            throw std::runtime_error(path.string() + ": " + what + " failed, error " + std::to_string(error));
+        }
+
+        size_t round_up(size_t n, size_t granularity)
+        {
+            return (n + granularity - 1) / granularity * granularity;
+        }
+    }
+
+    mapped_file::mapped_file(std::filesystem::path const& path, map_strategy strategy, std::filesystem::path const&)
+    {
+        if (strategy == map_strategy::hugetlbfs)
+        {
+            throw std::runtime_error("hugetlbfs: not available on Windows");
+        }
+
+        DWORD flags = FILE_ATTRIBUTE_NORMAL;
+        if (strategy == map_strategy::sequential)
+        {
+            flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+        }
+        else if (strategy == map_strategy::random)
+        {
+            flags |= FILE_FLAG_RANDOM_ACCESS;
+        }
+
+        m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE)
+        {
+            m_file = nullptr;
+            fail(path, "CreateFileW");
+        }
+
+        LARGE_INTEGER size{};
+        if (!GetFileSizeEx(m_file, &size) || (size.QuadPart == 0))
+        {
+            close();
+            throw std::runtime_error(path.string() + ": empty or unreadable file");
+        }
+        m_size = static_cast<size_t>(size.QuadPart);
+
+        if (strategy == map_strategy::huge)
+        {
+            // Large pages need SeLockMemoryPrivilege; without it the copy lands on ordinary pages.
+            auto large = GetLargePageMinimum();
+            m_mappedSize = large ? round_up(m_size, large) : m_size;
+            m_data = static_cast<std::byte*>(VirtualAlloc(nullptr, m_mappedSize, MEM_RESERVE | MEM_COMMIT | (large ? MEM_LARGE_PAGES : 0), PAGE_READWRITE));
+            m_hugePages = (large != 0) && (m_data != nullptr);
+            if (!m_data)
+            {
+                m_mappedSize = m_size;
+                m_data = static_cast<std::byte*>(VirtualAlloc(nullptr, m_size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+            }
+            if (!m_data)
+            {
+                auto error = GetLastError();
+                close();
+                fail(path, "VirtualAlloc", error);
+            }
+            m_anonymous = true;
+
+            size_t done = 0;
+            while (done < m_size)
+            {
+                DWORD got = 0;
+                auto chunk = static_cast<DWORD>((std::min<size_t>)(m_size - done, 1u << 30));
+                if (!ReadFile(m_file, m_data + done, chunk, &got, nullptr) || (got == 0))
+                {
+                    auto error = GetLastError();
+                    close();
+                    fail(path, "ReadFile", error);
+                }
+                done += got;
+            }
+            return;
+        }
+
+        m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!m_mapping)
+        {
+            auto error = GetLastError();
+            close();
+            fail(path, "CreateFileMappingW", error);
+        }
+
+        m_data = static_cast<std::byte*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!m_data)
+        {
+            auto error = GetLastError();
+            close();
+            fail(path, "MapViewOfFile", error);
+        }
+        m_mappedSize = m_size;
+
+        if (strategy == map_strategy::populate)
+        {
+            WIN32_MEMORY_RANGE_ENTRY range{ m_data, m_size };
+            PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+        }
+    }
+
+    mapped_file::~mapped_file()
+    {
+        close();
+    }
+
+    void mapped_file::close()
+    {
+        if (m_data)
+        {
+            if (m_anonymous)
+            {
+                VirtualFree(m_data, 0, MEM_RELEASE);
+            }
+            else
+            {
+                UnmapViewOfFile(m_data);
+            }
+            m_data = nullptr;
+        }
+
+        if (m_mapping)
+        {
+            CloseHandle(m_mapping);
+            m_mapping = nullptr;
+        }
+
+        if (m_file)
+        {
+            CloseHandle(m_file);
+            m_file = nullptr;
+        }
+    }
+
+    std::string mapped_file::backing() const
+    {
+        WIN32_MEMORY_REGION_INFORMATION region{};
+        if (!QueryVirtualMemoryInformation(GetCurrentProcess(), m_data, MemoryRegionInfo, &region, sizeof(region), nullptr))
+        {
+            return "unknown";
+        }
+
+        std::string kind = m_anonymous ? "private" : "mapped";
+        if (m_hugePages)
+        {
+            kind += ", large pages";
+        }
+        return kind + ", region " + std::to_string(region.RegionSize / 1024) + "K";
+    }
+
+    page_faults current_page_faults()
+    {
+        PROCESS_MEMORY_COUNTERS counters{};
+        GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+        return { counters.PageFaultCount, 0 };
+    }
+
+    void evict_file_cache(std::filesystem::path const& path)
+    {
+        // Opening a file unbuffered flushes its pages from the system cache.
+        auto file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, nullptr);
+        if (file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(file);
+        }
+    }
+
+    size_t system_page_size()
+    {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwPageSize;
+    }
+
+    size_t large_page_size()
+    {
+        return GetLargePageMinimum();
+    }
+}